@@ -46,6 +46,10 @@
 		mutex_destroy(&dbg->__api_##api.mtx);			\
 	} while (0)
 
+#define ARG_TOKEN_IS(s, str)						\
+	((s)->to - (s)->from == strlen(str) &&				\
+	 !strncmp((s)->from, str, (s)->to - (s)->from))
+
 /******** ******** ******** ******** ******** ******** ******** ********
  ******** ******** ********       types       ******** ******** ********
  ******** ******** ******** ******** ******** ******** ******** ********/
@@ -195,6 +199,25 @@ int call_ofs_create_magic(struct ofs_api *api, const struct api_args *args)
 	return rc;
 }
 
+/******** ******** api: ofs_link_magic ******** ********/
+int call_ofs_link_magic(struct ofs_api *api, const struct api_args *args)
+{
+	struct ofs_dbg *dbg = api->dbg;
+	struct ofs_root *root = dbg->root;
+	int rc;
+	oid_t folder = (oid_t){root->sb, args->folder};
+	oid_t target = (oid_t){root->sb, args->target};
+
+	if (args->name == NULL)
+		return -EINVAL;
+	if (args->target == 0)
+		return -EINVAL;
+	rc = ofs_link_magic(root, target, folder, args->name);
+	if (!rc)
+		api->result = args->target;
+	return rc;
+}
+
 /******** ******** api: ofs_rmdir_magic ******** ********/
 int call_ofs_rmdir_magic(struct ofs_api *api, const struct api_args *args)
 {
@@ -451,6 +474,20 @@ ssize_t ofsdebug_api_write(struct file *file, const char __user *buf,
 			args.recursively = true;
 			break;
 		case ARG_FLAGS:
+			if (ARG_TOKEN_IS(&tmp[0], "exchange")) {
+				args.flags = RENAME_EXCHANGE;
+			} else if (ARG_TOKEN_IS(&tmp[0], "noreplace")) {
+				args.flags = RENAME_NOREPLACE;
+			} else {
+				int f;
+
+				rc = match_int(&tmp[0], &f);
+				if (rc < 0) {
+					rc = -EINVAL;
+					goto out_putname;
+				}
+				args.flags = (unsigned int)f;
+			}
 			break;
 		}
 	}
@@ -509,6 +546,7 @@ int ofsdebug_construct(struct ofs_root *root)
 	OFSAPI_EXPORT(dbg, ofs_mkdir_magic, call_ofs_mkdir_magic);
 	OFSAPI_EXPORT(dbg, ofs_symlink_magic, call_ofs_symlink_magic);
 	OFSAPI_EXPORT(dbg, ofs_create_magic, call_ofs_create_magic);
+	OFSAPI_EXPORT(dbg, ofs_link_magic, call_ofs_link_magic);
 	OFSAPI_EXPORT(dbg, ofs_rmdir_magic, call_ofs_rmdir_magic);
 	OFSAPI_EXPORT(dbg, ofs_unlink_magic, call_ofs_unlink_magic);
 	OFSAPI_EXPORT(dbg, ofs_rm_singularity, call_ofs_rm_singularity);
@@ -535,6 +573,7 @@ void ofsdebug_destruct(struct ofs_root *root)
 	OFSAPI_DESTROY(dbg, ofs_mkdir_magic);
 	OFSAPI_DESTROY(dbg, ofs_symlink_magic);
 	OFSAPI_DESTROY(dbg, ofs_create_magic);
+	OFSAPI_DESTROY(dbg, ofs_link_magic);
 	OFSAPI_DESTROY(dbg, ofs_rmdir_magic);
 	OFSAPI_DESTROY(dbg, ofs_unlink_magic);
 	OFSAPI_DESTROY(dbg, ofs_rm_singularity);
@@ -41,6 +41,7 @@ struct ofs_dbg {
 	OFSAPI(ofs_mkdir_magic);
 	OFSAPI(ofs_symlink_magic);
 	OFSAPI(ofs_create_magic);
+	OFSAPI(ofs_link_magic);
 	OFSAPI(ofs_rmdir_magic);
 	OFSAPI(ofs_unlink_magic);
 	OFSAPI(ofs_rm_singularity);
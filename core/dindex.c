@@ -0,0 +1,641 @@
+/**
+ * @file
+ * @brief C source of the ofs (octagram filesystem, outlandish filesystem, or
+ *        odd filesystem) kernel module
+ * @author Octagram Sun <octagram@qq.com>
+ * @version 0.1.0
+ * @date 2015
+ * @copyright Octagram Sun <octagram@qq.com>
+ *
+ * @note
+ * C source about the ordered index of directory entries. 1 tab == 8 spaces.
+ * @note
+ * Every directory and singularity keeps its children in a red-black tree
+ * sorted by a readdir position. A child gets the next position when it is
+ * linked into the folder, and keeps it until it is removed or moved out.
+ * So seekdir, telldir and resuming readdir find the child in O(log n)
+ * instead of walking the list d_subdirs. readdir walks the tree under RCU
+ * and doesn't hold any lock of the folder while emitting the children, and
+ * the number of children (<b><em>struct ofs_inode</em></b>.nr_children)
+ * is kept with the tree.
+ */
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ******** ********    header files   ******** ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+#include "ofs.h"
+#include "fs.h"
+#include "log.h"
+#include "rbtree.h"
+#include "dindex.h"
+#include "lazy.h"
+#include "ofs_ioctl.h"
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ******** ********       macro       ******** ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ******** ********       types       ******** ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+/**
+ * @brief a child copied by @ref ofs_dindex_next()
+ */
+struct ofs_dindex_child {
+	loff_t pos;			/**< readdir position */
+	ino_t ino;			/**< inode number */
+	umode_t mode;			/**< type and authority */
+	unsigned char type;		/**< DT_* type */
+	unsigned int nlink;		/**< number of hard links */
+	loff_t size;			/**< size */
+	struct timespec mtime;		/**< last modification time */
+	unsigned int len;		/**< length of name */
+	char *name;			/**< buffer of name (NAME_MAX + 1) */
+};
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ********         function prototypes         ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ******** ********   .sdata & .data  ******** ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ********      function implementations       ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+/******** ******** index ******** ********/
+/**
+ * @brief allocate the index of a folder if it has none
+ * @param dir: inode of the folder
+ * @retval 0: OK
+ * @retval -ENOMEM: no memory
+ * @note
+ * * Call this function under locking dir->i_mutex.
+ */
+int ofs_dindex_attach(struct inode *dir)
+{
+	struct ofs_inode *oi = OFS_INODE(dir);
+	struct ofs_dindex *idx;
+
+	if (oi->dindex)
+		return 0;
+	idx = kmalloc(sizeof(struct ofs_dindex), GFP_KERNEL);
+	if (idx == NULL)
+		return -ENOMEM;
+	spin_lock_init(&idx->lock);
+	seqcount_init(&idx->seq);
+	rbtree_init(&idx->tree);
+	idx->next_pos = OFS_DINDEX_FIRST_POS;
+	smp_wmb(); /* initialize the index before publishing it */
+	ACCESS_ONCE(oi->dindex) = idx;
+	return 0;
+}
+
+/**
+ * @brief free an index
+ * @param idx: the index
+ * @note
+ * * The index must be empty. Every child dentry holds a reference of the
+ *   parent dentry, so all entries have been released before the folder
+ *   inode is destroyed.
+ */
+void ofs_dindex_free(struct ofs_dindex *idx)
+{
+	WARN_ON(idx->tree.root != NULL);
+	kfree(idx);
+}
+
+/**
+ * @brief link an entry into the index of a folder
+ * @note
+ * * Call this function under locking <b><em>oi->dindex->lock</em></b>.
+ * * The new position is always the largest one.
+ */
+static
+void ofs_dindex_insert(struct ofs_inode *oi, struct ofs_dirent *newde)
+{
+	struct ofs_dindex *idx = oi->dindex;
+	struct rbtree_node **new;
+	struct ofs_dirent *de;
+	ptr_t lpc;
+
+	newde->pos = idx->next_pos++;
+	new = &idx->tree.root;
+	lpc = (ptr_t)new;
+	while (*new) {
+		de = rbtree_entry(*new, struct ofs_dirent, node);
+		if (newde->pos < de->pos) {
+			new = &((*new)->left);
+			lpc = (ptr_t)new;
+		} else {
+			new = &((*new)->right);
+			lpc = (ptr_t)new | RBTREE_RIGHT;
+		}
+	}
+	write_seqcount_begin(&idx->seq);
+	rbtree_lpc(&newde->node, lpc);
+	rbtree_insert_color(&idx->tree, &newde->node);
+	write_seqcount_end(&idx->seq);
+	oi->nr_children++;
+}
+
+/**
+ * @brief unlink an entry from the index of a folder
+ * @note
+ * * Call this function under locking <b><em>oi->dindex->lock</em></b>.
+ */
+static
+void ofs_dindex_remove(struct ofs_inode *oi, struct ofs_dirent *de)
+{
+	struct ofs_dindex *idx = oi->dindex;
+
+	write_seqcount_begin(&idx->seq);
+	rbtree_rm(&idx->tree, &de->node);
+	write_seqcount_end(&idx->seq);
+	oi->nr_children--;
+}
+
+/**
+ * @brief find the first entry whose position is not less than pos
+ * @param idx: the index
+ * @param pos: the position
+ * @param result: return the position of the entry
+ * @return the entry
+ * @retval NULL: no such entry
+ * @note
+ * * Call this function under rcu_read_lock(). The entry may be removed or
+ *   moved to another folder after returning. The position is read while
+ *   the entry is in the index.
+ */
+static
+struct ofs_dirent *ofs_dindex_lookup_rcu(struct ofs_dindex *idx, loff_t pos,
+					 loff_t *result)
+{
+	struct rbtree_node *n;
+	struct ofs_dirent *de, *ge;
+	loff_t gepos;
+	unsigned int seq, steps;
+
+	do {
+		seq = read_seqcount_begin(&idx->seq);
+		ge = NULL;
+		gepos = 0;
+		n = ACCESS_ONCE(idx->tree.root);
+		for (steps = 0; n && steps < OFS_RBTREE_WALK_MAX; steps++) {
+			de = rbtree_entry(n, struct ofs_dirent, node);
+			if (de->pos < pos) {
+				n = ACCESS_ONCE(n->right);
+			} else {
+				ge = de;
+				gepos = de->pos;
+				if (gepos == pos)
+					break;
+				n = ACCESS_ONCE(n->left);
+			}
+		}
+	} while (read_seqcount_retry(&idx->seq, seq));
+	*result = gepos;
+	return ge;
+}
+
+/**
+ * @brief add a child dentry to the index of its folder
+ * @param dir: inode of the folder
+ * @param dentry: the child dentry
+ * @retval 0: OK
+ * @retval -ENOMEM: no memory
+ * @note
+ * * Call this function under locking dir->i_mutex before instantiating
+ *   the dentry.
+ * * A negative dentry kept by option "negdcache" isn't kept any more.
+ */
+int ofs_dindex_add(struct inode *dir, struct dentry *dentry)
+{
+	struct ofs_dirent *de;
+
+	de = ofs_dindex_alloc_entry(dir);
+	if (IS_ERR(de))
+		return PTR_ERR(de);
+	ofs_dindex_add_entry(dir, dentry, de);
+	return 0;
+}
+
+/**
+ * @brief allocate an entry to add a child to the index of its folder later
+ * @param dir: inode of the folder
+ * @return the entry
+ * @retval -ENOMEM: no memory
+ * @note
+ * * Call this function under locking dir->i_mutex.
+ * * Add the entry by @ref ofs_dindex_add_entry() or free it by kfree().
+ *   It is used when the child can't be removed if the index fails to grow.
+ */
+struct ofs_dirent *ofs_dindex_alloc_entry(struct inode *dir)
+{
+	struct ofs_dirent *de;
+	int rc;
+
+	rc = ofs_dindex_attach(dir);
+	if (rc)
+		return ERR_PTR(rc);
+	de = kmalloc(sizeof(struct ofs_dirent), GFP_KERNEL);
+	if (de == NULL)
+		return ERR_PTR(-ENOMEM);
+	return de;
+}
+
+/**
+ * @brief add a child dentry to the index of its folder with an entry
+ *        allocated by @ref ofs_dindex_alloc_entry()
+ * @param dir: inode of the folder
+ * @param dentry: the child dentry
+ * @param de: the entry
+ * @note
+ * * Call this function under locking dir->i_mutex.
+ */
+void ofs_dindex_add_entry(struct inode *dir, struct dentry *dentry,
+			  struct ofs_dirent *de)
+{
+	struct ofs_dindex *idx = OFS_INODE(dir)->dindex;
+
+	rbtree_init_node(&de->node);
+	de->dentry = dentry;
+	ofs_negd_forget(dentry);
+	spin_lock(&idx->lock);
+	ofs_dindex_insert(OFS_INODE(dir), de);
+	spin_unlock(&idx->lock);
+	dentry->d_fsdata = de;
+}
+
+/**
+ * @brief remove a child dentry from the index of its folder
+ * @param dir: inode of the folder
+ * @param dentry: the child dentry
+ * @note
+ * * Call this function under locking dir->i_mutex, or when nobody else
+ *   can reach the dentry.
+ * * It does nothing if the dentry isn't in the index.
+ */
+void ofs_dindex_del(struct inode *dir, struct dentry *dentry)
+{
+	struct ofs_dindex *idx = OFS_INODE(dir)->dindex;
+	struct ofs_dirent *de = dentry->d_fsdata;
+
+	if (de == NULL)
+		return;
+	spin_lock(&idx->lock);
+	ofs_dindex_remove(OFS_INODE(dir), de);
+	spin_unlock(&idx->lock);
+	ACCESS_ONCE(dentry->d_fsdata) = NULL;
+	kfree_rcu(de, rcu);
+}
+
+/**
+ * @brief move a child dentry to the index of another folder
+ * @param iold: inode of the old folder
+ * @param inew: inode of the new folder
+ * @param dentry: the child dentry
+ * @note
+ * * Call this function under locking iold->i_mutex and inew->i_mutex.
+ *   The new folder must have an index (see @ref ofs_dindex_attach()).
+ * * The child keeps its position if it stays in the same folder. Otherwise
+ *   it gets the next position of the new folder.
+ */
+void ofs_dindex_move(struct inode *iold, struct inode *inew,
+		     struct dentry *dentry)
+{
+	struct ofs_dindex *oldidx = OFS_INODE(iold)->dindex;
+	struct ofs_dindex *newidx = OFS_INODE(inew)->dindex;
+	struct ofs_dirent *de = dentry->d_fsdata;
+
+	if (de == NULL || oldidx == newidx)
+		return;
+	spin_lock(&oldidx->lock);
+	ofs_dindex_remove(OFS_INODE(iold), de);
+	spin_unlock(&oldidx->lock);
+	rbtree_init_node(&de->node);
+	spin_lock(&newidx->lock);
+	ofs_dindex_insert(OFS_INODE(inew), de);
+	spin_unlock(&newidx->lock);
+}
+
+/**
+ * @brief release the entry of a dentry that is being killed
+ * @param dentry: the dentry
+ * @note
+ * * Called by dentry operation d_release. The parent is still referenced
+ *   by the dentry, so its inode is valid.
+ */
+void ofs_dindex_release(struct dentry *dentry)
+{
+	if (dentry->d_fsdata == NULL || IS_ROOT(dentry))
+		return;
+	ofs_dindex_del(dentry->d_parent->d_inode, dentry);
+}
+
+/******** ******** readdir ******** ********/
+/**
+ * @brief copy the first positive child whose position is not less than pos
+ * @param idx: index of the folder
+ * @param dir: dentry of the folder
+ * @param pos: the position
+ * @param child: return the child. child->name must be a buffer.
+ * @retval true: found
+ * @retval false: no more child
+ * @note
+ * * The tree is walked under RCU. Child dentries in the index have been
+ *   hashed, so they are freed after a RCU grace period too. The entry is
+ *   checked again under locking d_lock of the child, and the name and the
+ *   attributes are copied there because the child may be renamed after
+ *   unlocking.
+ */
+static
+bool ofs_dindex_next(struct ofs_dindex *idx, struct dentry *dir, loff_t pos,
+		     struct ofs_dindex_child *child)
+{
+	struct ofs_dirent *de;
+	struct dentry *d;
+	struct inode *inode;
+	bool found = false;
+
+	rcu_read_lock();
+	while (!found) {
+		de = ofs_dindex_lookup_rcu(idx, pos, &child->pos);
+		if (de == NULL)
+			break;
+		d = de->dentry;
+		spin_lock(&d->d_lock);
+		if (d->d_fsdata == de && d->d_parent == dir &&
+		    ofs_simple_positive(d)) {
+			inode = d->d_inode;
+			child->len = d->d_name.len;
+			memcpy(child->name, d->d_name.name, child->len);
+			child->name[child->len] = '\0';
+			child->ino = inode->i_ino;
+			child->mode = inode->i_mode;
+			child->type = ofs_dt_type(inode);
+			child->nlink = inode->i_nlink;
+			child->size = S_ISDIR(inode->i_mode) ?
+				      ofs_nr_children(OFS_INODE(inode)) :
+				      i_size_read(inode);
+			child->mtime = inode->i_mtime;
+			found = true;
+		}
+		spin_unlock(&d->d_lock);
+		pos = child->pos + 1;
+	}
+	rcu_read_unlock();
+	return found;
+}
+
+/**
+ * @brief readdir with the index
+ * @param file: file struct of the opened folder
+ * @param ctx: directory context
+ * @retval errno: Indicate the error code
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * ctx->pos is the position of the next child to emit. If dir_emit() fails
+ *   (short buffer or EFAULT), ctx->pos still points to the child, and the
+ *   next call finds it again in O(log n).
+ * * No lock of the folder is held while emitting a child.
+ * * When the index is exhausted, the next batch of children of a lazy magic
+ *   folder is materialized and emitted. inode.i_mutex is held by
+ *   iterate_dir().
+ */
+int ofs_dindex_iterate(struct file *file, struct dir_context *ctx)
+{
+	struct dentry *dir = file->f_path.dentry;
+	struct ofs_dindex *idx;
+	struct ofs_dindex_child child;
+	int rc = 0;
+
+	if (!dir_emit_dots(file, ctx))
+		return 0;
+	child.name = __getname();
+	if (child.name == NULL)
+		return -ENOMEM;
+again:
+	idx = ACCESS_ONCE(OFS_INODE(dir->d_inode)->dindex);
+	smp_rmb(); /* pairs with smp_wmb() in ofs_dindex_attach() */
+	while (idx && ofs_dindex_next(idx, dir, ctx->pos, &child)) {
+		ctx->pos = child.pos;
+		if (!dir_emit(ctx, child.name, child.len, child.ino,
+			      child.type))
+			goto out_putname;
+		ctx->pos = child.pos + 1;
+	}
+	/* the index is exhausted, materialize the next batch */
+	rc = 0;
+	if (ACCESS_ONCE(OFS_INODE(dir->d_inode)->nr_dormant))
+		rc = ofs_lazy_materialize_batch(dir, OFS_LAZY_BATCH);
+	if (rc > 0)
+		goto again;
+
+out_putname:
+	__putname(child.name);
+	return rc;
+}
+
+/**
+ * @brief ioctl OFS_IOC_READDIRPLUS: read children and their attributes
+ * @param file: file struct of the opened folder
+ * @param arg: (struct ofs_readdirplus __user *) the argument
+ * @retval 0: OK. arg->nr records are filled, and arg->pos is the cursor
+ *            of the next call.
+ * @retval -EINVAL: The buffer is too small for the first record.
+ * @retval errno: Indicate the error code
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * It is the same as readdir followed by stat of every child, but without
+ *   looking up the children. "." and ".." are not returned.
+ * * As readdir, the children of a lazy magic folder are materialized one
+ *   batch at a time when the index is exhausted.
+ */
+long ofs_dindex_readdirplus(struct file *file,
+			    struct ofs_readdirplus __user *arg)
+{
+	struct dentry *dir = file->f_path.dentry;
+	struct ofs_readdirplus rdp;
+	struct ofs_dindex *idx;
+	struct ofs_dindex_child child;
+	struct ofs_dirent_plus rec;
+	char __user *buf;
+	size_t len, reclen;
+	loff_t pos;
+	long rc = 0;
+
+	if (copy_from_user(&rdp, arg, sizeof(rdp)))
+		return -EFAULT;
+	if (rdp.pos < 0)
+		return -EINVAL;
+	buf = (char __user *)(unsigned long)rdp.buf;
+	len = rdp.len;
+	pos = max_t(loff_t, rdp.pos, OFS_DINDEX_FIRST_POS);
+	rdp.nr = 0;
+
+	child.name = __getname();
+	if (child.name == NULL)
+		return -ENOMEM;
+again:
+	idx = ACCESS_ONCE(OFS_INODE(dir->d_inode)->dindex);
+	smp_rmb(); /* pairs with smp_wmb() in ofs_dindex_attach() */
+	while (idx && ofs_dindex_next(idx, dir, pos, &child)) {
+		reclen = ALIGN(offsetof(struct ofs_dirent_plus, name) +
+			       child.len + 1, sizeof(__u64));
+		if (reclen > len) {
+			if (rdp.nr == 0)
+				rc = -EINVAL;
+			goto out_putname;
+		}
+		rec.ino = child.ino;
+		rec.size = child.size;
+		rec.mtime_sec = child.mtime.tv_sec;
+		rec.mtime_nsec = child.mtime.tv_nsec;
+		rec.mode = child.mode;
+		rec.nlink = child.nlink;
+		rec.reclen = reclen;
+		rec.type = child.type;
+		rec.namelen = child.len;
+		if (copy_to_user(buf, &rec, sizeof(rec)) ||
+		    copy_to_user(buf + offsetof(struct ofs_dirent_plus, name),
+				 child.name, child.len + 1)) {
+			rc = -EFAULT;
+			goto out_putname;
+		}
+		buf += reclen;
+		len -= reclen;
+		rdp.nr++;
+		pos = child.pos + 1;
+	}
+	/* the index is exhausted, materialize the next batch */
+	rc = 0;
+	if (ACCESS_ONCE(OFS_INODE(dir->d_inode)->nr_dormant)) {
+		mutex_lock(&dir->d_inode->i_mutex);
+		rc = ofs_lazy_materialize_batch(dir, OFS_LAZY_BATCH);
+		mutex_unlock(&dir->d_inode->i_mutex);
+		if (rc > 0)
+			goto again;
+	}
+
+out_putname:
+	__putname(child.name);
+	if (rc)
+		return rc;
+
+	rdp.pos = pos;
+	if (copy_to_user(arg, &rdp, sizeof(rdp)))
+		return -EFAULT;
+	return 0;
+}
+
+/**
+ * @brief get the first positive child whose position is not less than *pos
+ * @param dir: dentry of the folder
+ * @param pos: the position. It is set to the position after the child.
+ * @return the child dentry with a reference
+ * @retval NULL: no more child
+ * @note
+ * * Call this function under locking dir->d_inode->i_mutex, so the child
+ *   can't be renamed or removed by others.
+ */
+struct dentry *ofs_dindex_get_child(struct dentry *dir, loff_t *pos)
+{
+	struct ofs_dindex *idx = OFS_INODE(dir->d_inode)->dindex;
+	struct ofs_dirent *de;
+	struct dentry *d = NULL;
+	loff_t p;
+
+	if (idx == NULL)
+		return NULL;
+	rcu_read_lock();
+	while ((de = ofs_dindex_lookup_rcu(idx, *pos, &p)) != NULL) {
+		d = de->dentry;
+		*pos = p + 1;
+		spin_lock(&d->d_lock);
+		if (d->d_fsdata == de && d->d_parent == dir &&
+		    ofs_simple_positive(d)) {
+			dget_dlock(d);
+			spin_unlock(&d->d_lock);
+			break;
+		}
+		spin_unlock(&d->d_lock);
+	}
+	rcu_read_unlock();
+	return de ? d : NULL;
+}
+
+/**
+ * @brief copy at most max positive children whose positions are not less
+ *        than *pos
+ * @param dir: dentry of the folder
+ * @param pos: the position. It is set to the position after the last copied
+ *             child.
+ * @param batch: buffer of the children
+ * @param max: size of batch
+ * @return the number of children copied
+ * @note
+ * * No lock of the folder is held. Every child is copied under RCU and its
+ *   own d_lock by @ref ofs_dindex_next().
+ */
+unsigned int ofs_dindex_copy_children(struct dentry *dir, loff_t *pos,
+				      struct ofs_child *batch,
+				      unsigned int max)
+{
+	struct ofs_dindex *idx;
+	struct ofs_dindex_child child;
+	unsigned int n = 0;
+	loff_t p = max_t(loff_t, *pos, OFS_DINDEX_FIRST_POS);
+
+	idx = ACCESS_ONCE(OFS_INODE(dir->d_inode)->dindex);
+	if (idx == NULL)
+		return 0;
+	smp_rmb(); /* pairs with smp_wmb() in ofs_dindex_attach() */
+	while (n < max) {
+		child.name = batch[n].name;
+		if (!ofs_dindex_next(idx, dir, p, &child))
+			break;
+		batch[n].oid = (oid_t){dir->d_sb, child.ino};
+		batch[n].mode = child.mode;
+		batch[n].len = child.len;
+		n++;
+		p = child.pos + 1;
+	}
+	*pos = p;
+	return n;
+}
+
+/**
+ * @brief llseek with the index
+ * @param file: file struct of the opened folder
+ * @param offset: position
+ * @param whence: SEEK_SET or SEEK_CUR (See man lseek for detail.)
+ * @return the position
+ * @retval >=0: the position
+ * @retval errno: Indicate the error code
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * Only the position is changed. The child is found by the next readdir.
+ * * file->f_pos is protected by file->f_pos_lock held by VFS.
+ */
+loff_t ofs_dindex_llseek(struct file *file, loff_t offset, int whence)
+{
+	switch (whence) {
+	case SEEK_CUR:
+		offset += file->f_pos;
+	case SEEK_SET:
+		if (offset >= 0)
+			break;
+	default:
+		return -EINVAL;
+	}
+	if (offset != file->f_pos) {
+		file->f_pos = offset;
+		file->f_version = 0;
+	}
+	return offset;
+}
@@ -0,0 +1,125 @@
+/**
+ * @file
+ * @brief C header for the ofs (octagram filesystem, outlandish filesystem, or
+ *        odd filesystem) kernel module
+ * @author Octagram Sun <octagram@qq.com>
+ * @version 0.1.0
+ * @date 2015
+ * @copyright Octagram Sun <octagram@qq.com>
+ *
+ * @note
+ * C header about the ordered index of directory entries, is used in ofs
+ * internal.
+ * 1 tab == 8 spaces.
+ */
+
+#ifndef __OFS_DINDEX_H__
+#define __OFS_DINDEX_H__
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ******** ********    header files   ******** ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+#include <linux/types.h>
+#include <linux/spinlock.h>
+#include <linux/seqlock.h>
+#include <linux/rcupdate.h>
+#include "rbtree.h"
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ******** ********       macro       ******** ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+/**
+ * @brief the first position of children. Position 0 and 1 are "." and "..".
+ */
+#define OFS_DINDEX_FIRST_POS		2
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ******** ********       types       ******** ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+struct ofs_readdirplus;
+struct ofs_child;
+
+/**
+ * @brief entry of a child dentry in the ordered index of its parent
+ * @note
+ * * It is pointed by dentry->d_fsdata of the child.
+ * * It is freed after a RCU grace period.
+ */
+struct ofs_dirent {
+	struct rbtree_node node;	/**< link in the index */
+	loff_t pos;			/**< readdir position. It never changes
+					 *   while the child stays in the
+					 *   folder.
+					 */
+	struct dentry *dentry;		/**< the child dentry */
+	struct rcu_head rcu;		/**< rcu head to free the entry */
+};
+
+/**
+ * @brief ordered index of the children of a directory or a singularity
+ * @note
+ * * Positions are never reused, so a position returned by telldir stays
+ *   valid until the folder is destroyed.
+ * * It is allocated when the first child is linked into the folder.
+ * * Writers change the tree under <b><em>lock</em></b>. Readers walk the
+ *   tree under RCU and retry if <b><em>seq</em></b> changes.
+ */
+struct ofs_dindex {
+	spinlock_t lock;		/**< protects the tree */
+	seqcount_t seq;			/**< changed by writers under the lock */
+	struct rbtree tree;		/**< entries sorted by position */
+	loff_t next_pos;		/**< position of the next new child */
+};
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ********         function prototypes         ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+extern
+int ofs_dindex_attach(struct inode *dir);
+
+extern
+void ofs_dindex_free(struct ofs_dindex *idx);
+
+extern
+int ofs_dindex_add(struct inode *dir, struct dentry *dentry);
+
+extern
+struct ofs_dirent *ofs_dindex_alloc_entry(struct inode *dir);
+
+extern
+void ofs_dindex_add_entry(struct inode *dir, struct dentry *dentry,
+			  struct ofs_dirent *de);
+
+extern
+void ofs_dindex_del(struct inode *dir, struct dentry *dentry);
+
+extern
+void ofs_dindex_move(struct inode *iold, struct inode *inew,
+		     struct dentry *dentry);
+
+extern
+void ofs_dindex_release(struct dentry *dentry);
+
+extern
+int ofs_dindex_iterate(struct file *file, struct dir_context *ctx);
+
+extern
+struct dentry *ofs_dindex_get_child(struct dentry *dir, loff_t *pos);
+
+extern
+unsigned int ofs_dindex_copy_children(struct dentry *dir, loff_t *pos,
+				      struct ofs_child *batch,
+				      unsigned int max);
+
+extern
+loff_t ofs_dindex_llseek(struct file *file, loff_t offset, int whence);
+
+extern
+long ofs_dindex_readdirplus(struct file *file,
+			    struct ofs_readdirplus __user *arg);
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ******** ********   .sdata & .data  ******** ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+
+#endif /* dindex.h */
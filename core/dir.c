@@ -18,10 +18,18 @@
 #include "fs.h"
 #include "log.h"
 #include "dir.h"
+#include "lazy.h"
+#include "dindex.h"
+#include "ofs_ioctl.h"
 
 /******** ******** ******** ******** ******** ******** ******** ********
  ******** ******** ********       macro       ******** ******** ********
  ******** ******** ******** ******** ******** ******** ******** ********/
+/**
+ * @brief Max unlinked children that @ref ofs_dir_unlinkbatch() holds before
+ *        unlocking the parent to dput them.
+ */
+#define OFS_UNLINKBATCH_DPUT		(PAGE_SIZE / sizeof(struct dentry *))
 
 /******** ******** ******** ******** ******** ******** ******** ********
  ******** ******** ********       types       ******** ******** ********
@@ -30,6 +38,8 @@
 /******** ******** ******** ******** ******** ******** ******** ********
  ******** ********         function prototypes         ******** ********
  ******** ******** ******** ******** ******** ******** ******** ********/
+static inline
+void ofs_d_instantiate_singularity(struct dentry *dentry, struct inode *inode);
 
 /******** ******** ******** ******** ******** ******** ******** ********
  ******** ******** ********   .sdata & .data  ******** ******** ********
@@ -116,6 +126,26 @@ struct dentry *ofs_dir_iops_lookup(struct inode *iparent, struct dentry *dentry,
 		return ERR_PTR(-ENAMETOOLONG);
 	if (!dentry->d_sb->s_d_op)
 		d_set_d_op(dentry, &ofs_dops);
+	if (((struct ofs_root *)iparent->i_sb->s_fs_info)->lazy) {
+		struct ofs_dirent *de;
+		struct inode *newi;
+
+		newi = ofs_lazy_materialize(iparent, dentry, &de);
+		if (IS_ERR(newi))
+			return ERR_CAST(newi);
+		if (newi) {
+			if (OFS_INODE(newi)->state & OI_SINGULARITY) {
+				ofs_d_instantiate_singularity(dentry, newi);
+				d_rehash(dentry);
+			} else {
+				d_add(dentry, newi);
+			}
+			ofs_dindex_add_entry(iparent, dentry, de);
+			ofs_lazy_attach(dentry);
+			return NULL;
+		}
+	}
+	ofs_negd_keep(dentry);
 	d_add(dentry, NULL);
 	return NULL;
 }
@@ -151,7 +181,8 @@ int ofs_dir_iops_permission(struct inode *inode, int mask)
  * @note
  * * This function is called under locking oldd->d_inode.i_mutex and
  *   iparent->i_mutex.
- * * Can't link a magic file by userspace syscall.
+ * * Can't link a magic file by userspace syscall. Only
+ *   @ref ofs_link_magic() flags the folder with OI_LINKING_MAGIC_CHILD.
  * @remark
  * * The function can't be used in ISR (Interrupt Service Routine).
  */
@@ -159,9 +190,20 @@ int ofs_dir_iops_link(struct dentry *oldd, struct inode *iparent,
 		      struct dentry *newd)
 {
 	struct inode *inode = oldd->d_inode;
+	int rc;
 
 	ofs_dbg("oldd<%p>==\"%pd\"; iparent<%p>; newd<%p>==\"%pd\";\n",
 		oldd, oldd, iparent, newd, newd);
+	if (OFS_INODE(inode)->state & OI_MAGIC) {
+		if (!(OFS_INODE(iparent)->state & OI_LINKING_MAGIC_CHILD)) {
+			ofs_err("Can't link a magic ofs inode by userspace "
+				"syscall.\n");
+			return -ENOSYS;
+		}
+	}
+	rc = ofs_dindex_add(iparent, newd);
+	if (rc)
+		return rc;
 	inode->i_ctime = iparent->i_ctime = iparent->i_mtime = CURRENT_TIME;
 	inc_nlink(inode);
 	ihold(inode);
@@ -199,6 +241,11 @@ int ofs_dir_iops_mknod(struct inode *iparent, struct dentry *newd,
 	oiparent = OFS_INODE(iparent);
 	newi = ofs_new_inode(iparent->i_sb, iparent, mode, dev, false);
 	if (newi) {
+		ret = ofs_dindex_add(iparent, newd);
+		if (ret) {
+			iput(newi);
+			return ret;
+		}
 		d_instantiate(newd, newi);
 		dget(newd);
 		ret = 0;
@@ -268,6 +315,11 @@ int ofs_dir_iops_create(struct inode *iparent, struct dentry *newd,
 	newi = ofs_new_inode(iparent->i_sb, iparent, mode | S_IFREG, 0,
 			     is_singularity);
 	if (newi) {
+		ret = ofs_dindex_add(iparent, newd);
+		if (ret) {
+			iput(newi);
+			return ret;
+		}
 		if (is_singularity) {
 			ofs_d_instantiate_singularity(newd, newi);
 			inc_nlink(iparent); /* entry "child_singularity/.." */
@@ -308,7 +360,22 @@ int ofs_dir_iops_symlink(struct inode *iparent, struct dentry *newd,
 			     0, false);
 	if (newi) {
 		int l = strlen(symname) + 1;
-		error = page_symlink(newi, symname, l);
+
+		if (l <= CONFIG_OFS_FAST_SYMLINK_MAX) {
+			/* short target: a slab string instead of a page */
+			error = -ENOMEM;
+			OFS_INODE(newi)->link = kmemdup(symname, l,
+							GFP_KERNEL);
+			if (OFS_INODE(newi)->link) {
+				newi->i_op = &ofs_fast_symlink_iops;
+				newi->i_size = l - 1;
+				error = 0;
+			}
+		} else {
+			error = page_symlink(newi, symname, l);
+		}
+		if (!error)
+			error = ofs_dindex_add(iparent, newd);
 		if (!error) {
 			d_instantiate(newd, newi);
 			dget(newd);
@@ -352,6 +419,11 @@ int ofs_dir_iops_mkdir(struct inode *iparent, struct dentry *newd, umode_t mode)
 	oiparent = OFS_INODE(iparent);
 	newi = ofs_new_inode(iparent->i_sb, iparent, mode | S_IFDIR, 0, false);
 	if (newi) {
+		ret = ofs_dindex_add(iparent, newd);
+		if (ret) {
+			iput(newi);
+			return ret;
+		}
 		d_instantiate(newd, newi);
 		dget(newd);
 		inc_nlink(iparent); /* entry of "child/.." */
@@ -393,14 +465,17 @@ int ofs_dir_iops_rmdir(struct inode *iparent, struct dentry *dentry)
 		if (!(oiparent->state & OI_REMOVING_MAGIC_CHILD))
 			return -ENOSYS;
 	}
-	if (!simple_empty(dentry))
+	if (!ofs_folder_empty(inode) || !ofs_lazy_empty(oi))
 		return -ENOTEMPTY;
+	if (oi->magic == dentry)
+		ofs_lazy_forget(oi);
 	inode->i_ctime = iparent->i_ctime = iparent->i_mtime = CURRENT_TIME;
 	/* drop_nlink() twice */
 	WARN_ON(inode->i_nlink < 2);
 	inode->__i_nlink -= 2;
 	if (!inode->i_nlink)
 		atomic_long_inc(&inode->i_sb->s_remove_count);
+	ofs_dindex_del(iparent, dentry);
 	dput(dentry);
 	drop_nlink(iparent); /* rm "dentry/.." of parent */
 	return 0;
@@ -443,9 +518,11 @@ int ofs_dir_iops_unlink(struct inode *iparent, struct dentry *dentry)
 				return -EPERM;
 			drop_nlink(iparent);
 		}
+		ofs_lazy_forget(oi);
 	}
 	inode->i_ctime = iparent->i_ctime = iparent->i_mtime = CURRENT_TIME;
 	drop_nlink(inode);
+	ofs_dindex_del(iparent, dentry);
 	dput(dentry);
 	return 0;
 
@@ -462,8 +539,10 @@ int ofs_dir_iops_unlink(struct inode *iparent, struct dentry *dentry)
  *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
  *                 /usr/include/asm-generic/errno-base.h</a></b>).
  * @note
- * * TODO rename2 flags: RENAME_EXCHANGE, RENAME_NOREPLACE and RENAME_WITHOUT
- * * TODO what is RENAME_WITHOUT?
+ * * RENAME_NOREPLACE is checked by VFS before calling this function.
+ * * RENAME_EXCHANGE swaps <b><em>dold</em></b> and <b><em>newd</em></b>.
+ *   A magic child can be exchanged only by @ref ofs_rename_magic().
+ * * TODO RENAME_WHITEOUT
  * * <i>mv</i> the <b><em>dold</em></b> in
  *   the <b><em>ioldparent</em></b> to the <b><em>inewparent</em></b>
  *   with the new name <b><em>newd</em></b>.
@@ -498,6 +577,30 @@ int ofs_dir_iops_rename2(struct inode *ioldparent, struct dentry *dold,
 	}
 
 	if (flags & RENAME_EXCHANGE) {
+		int rc;
+
+		if (newi && (newoi->magic == newd)) {
+			if (!(oinewparent->state & OI_RENAMING_MAGIC_CHILD)) {
+				ofs_err("Can't rename a magic ofs inode by "
+					"userspace syscall.\n");
+				return -ENOSYS;
+			}
+			if (!oioldparent->magic) {
+				ofs_err("Old parent<%p> is not magic.\n",
+					oioldparent);
+				return -ENOENT;
+			}
+		}
+		rc = ofs_lazy_exchange(oiold->magic == dold ? oiold : NULL,
+				       ioldparent, dold,
+				       (newi && newoi->magic == newd) ?
+				       newoi : NULL,
+				       inewparent, newd);
+		if (rc)
+			return rc;
+
+		ofs_dindex_move(ioldparent, inewparent, dold);
+		ofs_dindex_move(inewparent, ioldparent, newd);
 		new_is_fdr = d_is_dir(newd);
 		if (old_is_fdr) {
 			drop_nlink(ioldparent);
@@ -508,8 +611,10 @@ int ofs_dir_iops_rename2(struct inode *ioldparent, struct dentry *dold,
 			inc_nlink(ioldparent);
 		}
 	} else {
+		int rc;
+
 		new_is_fdr = old_is_fdr;
-		if (!simple_empty(newd)) {
+		if (!ofs_folder_empty(newi)) {
 			ofs_err("Can't replace a non-empty directory.\n");
 			return -ENOTEMPTY;
 		}
@@ -520,7 +625,20 @@ int ofs_dir_iops_rename2(struct inode *ioldparent, struct dentry *dold,
 					"inode<%p>.\n", newoi);
 				return -EPERM;
 			}
+		}
+		rc = ofs_dindex_attach(inewparent);
+		if (rc)
+			return rc;
+		if (oiold->magic == dold) {
+			rc = ofs_lazy_move(oiold, inewparent, newd);
+			if (rc)
+				return rc;
+		}
+
+		ofs_dindex_move(ioldparent, inewparent, dold);
+		if (newi) {
 			drop_nlink(newi);
+			ofs_dindex_del(inewparent, newd);
 			dput(newd);
 			if (new_is_fdr) {
 				drop_nlink(newi);
@@ -536,6 +654,8 @@ int ofs_dir_iops_rename2(struct inode *ioldparent, struct dentry *dold,
 
 	ioldparent->i_ctime = ioldparent->i_mtime = inewparent->i_ctime =
 		inewparent->i_mtime = iold->i_ctime = CURRENT_TIME;
+	if (flags & RENAME_EXCHANGE)
+		newi->i_ctime = iold->i_ctime;
 
 	return 0;
 }
@@ -566,12 +686,22 @@ int ofs_dir_iops_setattr(struct dentry *dentry, struct iattr *iattr)
  * @retval errno: Indicate the error code
  *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
  *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * The size of a directory is the number of its children.
  */
 int ofs_dir_iops_getattr(struct vfsmount *mnt, struct dentry *dentry,
 			 struct kstat *stat)
 {
+	int rc;
+
 //	ofs_dbg("mnt<%p>; dentry<%p>; stat<%p>;\n", mnt, dentry, stat);
-	return simple_getattr(mnt, dentry, stat);
+	rc = simple_getattr(mnt, dentry, stat);
+	if (!rc) {
+		struct ofs_inode *oi = OFS_INODE(dentry->d_inode);
+
+		stat->size = ofs_nr_children(oi);
+	}
+	return rc;
 }
 
 /******** file_operations ********/
@@ -587,8 +717,8 @@ int ofs_dir_iops_getattr(struct vfsmount *mnt, struct dentry *dentry,
  *                 /usr/include/asm-generic/errno-base.h</a></b>).
  * @note
  * * When llseek callback is used with readdir (iterate). The position is the
- *   sequence number of child dentry in the directory. It is the relevant of
- *   the order that child dentries linked in the list d_subdirs.
+ *   position of the child in the ordered index of the directory. The child
+ *   is found by the next readdir in O(log n).
  */
 loff_t ofs_dir_fops_llseek(struct file *file, loff_t offset, int whence)
 {
@@ -597,7 +727,7 @@ loff_t ofs_dir_fops_llseek(struct file *file, loff_t offset, int whence)
 		"offset==%lld; whence==%d;\n",
 		oi, file, file->f_path.dentry, file->f_path.dentry,
 		offset, whence);
-	return dcache_dir_lseek(file, offset, whence);
+	return ofs_dindex_llseek(file, offset, whence);
 }
 
 /**
@@ -662,13 +792,18 @@ ssize_t ofs_dir_fops_read_iter(struct kiocb *iocb, struct iov_iter *iter)
  * @retval errno: Indicate the error code
  *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
  *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * The index is read under RCU, so this function doesn't need i_mutex.
+ *   But VFS of linux 3.19 has no iterate_shared and always calls iterate
+ *   under locking i_mutex. Readers that scan a folder in parallel can use
+ *   @ref OFS_IOC_READDIRPLUS, which doesn't take i_mutex.
  */
 int ofs_dir_fops_iterate(struct file *file, struct dir_context *ctx)
 {
 	struct ofs_inode *oi = FILE_TO_OFS_INODE(file);
 	ofs_dbg("oi<%p>; file<%p>; dentry<%p>==\"%pd\"; ctx<%p>;\n",
 		oi, file, file->f_path.dentry, file->f_path.dentry, ctx);
-	return dcache_readdir(file, ctx);
+	return ofs_dindex_iterate(file, ctx);
 }
 
 /**
@@ -679,6 +814,8 @@ int ofs_dir_fops_iterate(struct file *file, struct dir_context *ctx)
  * @retval errno: Indicate the error code
  *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
  *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * See <b><i>ofs_ioctl.h</i></b> for the commands.
  */
 long ofs_dir_fops_unlocked_ioctl(struct file *file, unsigned int cmd,
 				 unsigned long args)
@@ -687,7 +824,200 @@ long ofs_dir_fops_unlocked_ioctl(struct file *file, unsigned int cmd,
 
 	ofs_dbg("oi<%p>; file<%p>; dentry<%p>==\"%pd\"; cmd==%u; args==%lu;\n",
 		oi, file, file->f_path.dentry, file->f_path.dentry, cmd, args);
-	return -EISDIR;
+	switch (cmd) {
+	case OFS_IOC_READDIRPLUS:
+		return ofs_dindex_readdirplus(file,
+				(struct ofs_readdirplus __user *)args);
+	case OFS_IOC_UNLINKBATCH:
+		return ofs_dir_unlinkbatch(file,
+				(struct ofs_unlinkbatch __user *)args);
+	default:
+		return -EISDIR;
+	}
+}
+
+/**
+ * @brief get the next child to unlink for @ref ofs_dir_unlinkbatch()
+ * @param dp: the parent
+ * @param names: the names or the prefix
+ * @param len: length of names
+ * @param prefix: Is names a prefix ?
+ * @param off: offset of the next name in names
+ * @param pos: readdir position of the next child to match the prefix
+ * @return the positive child dentry with a reference
+ * @retval NULL: no more child
+ * @retval errno: Indicate the error code
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * Call this function under locking dp->d_inode->i_mutex.
+ */
+static
+struct dentry *ofs_unlinkbatch_next(struct dentry *dp, const char *names,
+				    size_t len, bool prefix, size_t *off,
+				    loff_t *pos)
+{
+	struct dentry *d;
+	const char *name;
+	size_t l;
+
+	if (prefix) {
+		while ((d = ofs_dindex_get_child(dp, pos)) != NULL) {
+			/* d_name is stable under locking the parent. */
+			if (d->d_name.len >= len &&
+			    !memcmp(d->d_name.name, names, len) &&
+			    !d_is_dir(d) &&
+			    OFS_INODE(d->d_inode)->magic != d)
+				return d;
+			dput(d);
+		}
+		return NULL;
+	}
+
+	while (*off < len) {
+		name = names + *off;
+		l = strnlen(name, len - *off);
+		*off += l + 1;
+		if (l == 0)
+			continue;
+		d = lookup_one_len(name, dp, l);
+		if (IS_ERR(d))
+			return d;
+		if (ofs_simple_positive(d))
+			return d;
+		dput(d);
+	}
+	return NULL;
+}
+
+/**
+ * @brief unlink a child for @ref ofs_dir_unlinkbatch()
+ * @param file: file struct of the opened parent
+ * @param d: the child
+ * @retval 0: OK
+ * @retval -ENOENT: The child has gone while breaking the delegation.
+ * @retval errno: Indicate the error code
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * Call this function under locking the parent. The lock may be released
+ *   and taken again to break a delegation.
+ * * Magic nodes are protected by @ref ofs_dir_iops_unlink().
+ */
+static
+int ofs_unlinkbatch_hlp(struct file *file, struct dentry *d)
+{
+	struct dentry *dp = file->f_path.dentry;
+	struct inode *ip = dp->d_inode;
+	struct inode *idelegated;
+	int rc;
+
+	if (d_is_dir(d))
+		return -EISDIR;
+retry_deleg:
+	idelegated = NULL;
+	rc = security_path_unlink(&file->f_path, d);
+	if (rc)
+		return rc;
+	rc = vfs_unlink(ip, d, &idelegated);
+	if (idelegated) {
+		mutex_unlock(&ip->i_mutex);
+		rc = break_deleg_wait(&idelegated);
+		mutex_lock_nested(&ip->i_mutex, I_MUTEX_PARENT);
+		if (rc)
+			return rc;
+		if (d->d_parent != dp || !ofs_simple_positive(d))
+			return -ENOENT;
+		goto retry_deleg;
+	}
+	return rc;
+}
+
+/**
+ * @brief ioctl OFS_IOC_UNLINKBATCH: unlink many children
+ * @param file: file struct of the opened folder
+ * @param arg: (struct ofs_unlinkbatch __user *) the argument
+ * @retval 0: OK. arg->nr is the number of unlinked children.
+ * @retval errno: Indicate the error code. arg->nr is still set.
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * The parent is locked once for up to @ref OFS_UNLINKBATCH_DPUT children.
+ *   The unlinked children are dput after unlocking, so the last iput of
+ *   them doesn't hold the parent.
+ * * Children matching a prefix are found by the folder index.
+ */
+long ofs_dir_unlinkbatch(struct file *file, struct ofs_unlinkbatch __user *arg)
+{
+	struct dentry *dp = file->f_path.dentry;
+	struct inode *ip = dp->d_inode;
+	struct ofs_unlinkbatch ub;
+	struct dentry **victims, *d;
+	unsigned int nv = 0, i;
+	char *names;
+	size_t off = 0;
+	loff_t pos = OFS_DINDEX_FIRST_POS;
+	bool prefix;
+	long rc;
+
+	if (copy_from_user(&ub, arg, sizeof(ub)))
+		return -EFAULT;
+	if (ub.len > OFS_UNLINKBATCH_MAX || (ub.flags & ~OFS_UNLINK_PREFIX))
+		return -EINVAL;
+	prefix = ub.flags & OFS_UNLINK_PREFIX;
+	names = memdup_user((const void __user *)(unsigned long)ub.names,
+			    ub.len);
+	if (IS_ERR(names))
+		return PTR_ERR(names);
+	victims = (struct dentry **)__get_free_page(GFP_KERNEL);
+	if (victims == NULL) {
+		rc = -ENOMEM;
+		goto out_kfree;
+	}
+	rc = mnt_want_write_file(file);
+	if (rc)
+		goto out_free_page;
+
+	ub.nr = 0;
+	mutex_lock_nested(&ip->i_mutex, I_MUTEX_PARENT);
+	for (;;) {
+		d = ofs_unlinkbatch_next(dp, names, ub.len, prefix, &off, &pos);
+		if (IS_ERR_OR_NULL(d)) {
+			rc = PTR_ERR_OR_ZERO(d);
+			break;
+		}
+		rc = ofs_unlinkbatch_hlp(file, d);
+		if (rc) {
+			dput(d);
+			if (rc == -ENOENT) {
+				rc = 0;
+				continue;
+			}
+			break;
+		}
+		ub.nr++;
+		victims[nv++] = d;
+		if (nv == OFS_UNLINKBATCH_DPUT) {
+			mutex_unlock(&ip->i_mutex);
+			for (i = 0; i < nv; i++)
+				dput(victims[i]);
+			nv = 0;
+			cond_resched();
+			mutex_lock_nested(&ip->i_mutex, I_MUTEX_PARENT);
+		}
+	}
+	mutex_unlock(&ip->i_mutex);
+	for (i = 0; i < nv; i++)
+		dput(victims[i]);
+	mnt_drop_write_file(file);
+	if (put_user(ub.nr, &arg->nr))
+		rc = -EFAULT;
+
+out_free_page:
+	free_page((unsigned long)victims);
+out_kfree:
+	kfree(names);
+	return rc;
 }
 
 /**
@@ -717,7 +1047,8 @@ int ofs_dir_fops_open(struct inode *inode, struct file *file)
 
 	ofs_dbg("oi<%p>; file<%p>; dentry<%p>==\"%pd\";\n",
 		oi, file, file->f_path.dentry, file->f_path.dentry);
-	return dcache_dir_open(inode, file);
+	atomic_inc(&oi->nr_opened);
+	return 0;
 }
 
 /**
@@ -734,7 +1065,8 @@ int ofs_dir_fops_release(struct inode *inode, struct file *file)
 
 	ofs_dbg("oi<%p>; file<%p>; dentry<%p>==\"%pd\";\n",
 		oi, file, file->f_path.dentry, file->f_path.dentry);
-	return dcache_dir_close(inode, file);
+	atomic_dec(&oi->nr_opened);
+	return 0;
 }
 
 /**
@@ -25,6 +25,7 @@
 /******** ******** ******** ******** ******** ******** ******** ********
  ******** ******** ********       types       ******** ******** ********
  ******** ******** ******** ******** ******** ******** ******** ********/
+struct ofs_unlinkbatch;
 
 /******** ******** ******** ******** ******** ******** ******** ********
  ******** ********         function prototypes         ******** ********
@@ -119,6 +120,10 @@ int ofs_dir_fops_release(struct inode *inode, struct file *file);
 extern
 int ofs_dir_fops_fsync(struct file *file, loff_t start, loff_t end, int dsync);
 
+/******** ******** ioctl ******** ********/
+extern
+long ofs_dir_unlinkbatch(struct file *file, struct ofs_unlinkbatch __user *arg);
+
 /******** ******** ******** ******** ******** ******** ******** ********
  ******** ******** ********   .sdata & .data  ******** ******** ********
  ******** ******** ******** ******** ******** ******** ******** ********/
@@ -38,11 +38,17 @@
 #include <linux/spinlock.h>
 #include <linux/limits.h>
 #include <linux/fs_struct.h>
+#include <linux/migrate.h>
 #include <asm/uaccess.h>
 
 #include "fs.h"
 #include "rbtree.h"
 #include "log.h"
+#include "lazy.h"
+#include "dindex.h"
+#include "huge.h"
+#include "swap.h"
+#include "zpage.h"
 
 #ifdef CONFIG_OFS_SYSFS
 #include "omsys.h"
@@ -72,6 +78,17 @@ enum ofs_option {
 	OPT_UID,	/**< option "uid=%d" */
 	OPT_GID,	/**< option "gid=%d" */
 	OPT_MAGIC,	/**< option "magic" */
+	OPT_LAZY,	/**< option "lazy" */
+	OPT_NEGDCACHE,	/**< option "negdcache=%s" */
+	OPT_HUGE,	/**< option "huge=%s" */
+	OPT_SIZE,	/**< option "size=%s" */
+	OPT_NR_INODES,	/**< option "nr_inodes=%s" */
+	OPT_SWAP,	/**< option "swap" */
+	OPT_COMPRESS,	/**< option "compress=%u" */
+	OPT_DEDUP,	/**< option "dedup" */
+	OPT_NODEDUP,	/**< option "nodedup" */
+	OPT_NOWAIT,	/**< option "nowait" */
+	OPT_NONOWAIT,	/**< option "nonowait" */
 	OPT_ERR,	/**< error option */
 };
 
@@ -111,10 +128,35 @@ static
 int ofs_sops_show_options(struct seq_file *seq, struct dentry *rootd);
 
 /******** ******** dentry_operations ******** ********/
+static
+int ofs_dops_revalidate(struct dentry *dentry, unsigned int flags);
+
 static
 int ofs_dops_delete_dentry(const struct dentry *dentry);
 
+static
+void ofs_dops_release(struct dentry *dentry);
+
 /******** ******** memory mapping ******** ********/
+static
+int ofs_aops_readpage(struct file *file, struct page *page);
+
+static
+int ofs_aops_write_begin(struct file *file, struct address_space *mapping,
+			 loff_t pos, unsigned len, unsigned flags,
+			 struct page **pagep, void **fsdata);
+
+static
+void ofs_aops_invalidatepage(struct page *page, unsigned int offset,
+			     unsigned int length);
+
+static
+int ofs_aops_releasepage(struct page *page, gfp_t gfp);
+
+static
+int ofs_aops_migratepage(struct address_space *mapping, struct page *newpage,
+			 struct page *page, enum migrate_mode mode);
+
 static
 int ofs_set_page_dirty_no_writeback(struct page *page);
 
@@ -127,6 +169,17 @@ static const match_table_t ofs_tokens = {
 	{OPT_UID, "uid=%u"},
 	{OPT_GID, "gid=%u"},
 	{OPT_MAGIC, "magic"},
+	{OPT_LAZY, "lazy"},
+	{OPT_NEGDCACHE, "negdcache=%s"},
+	{OPT_HUGE, "huge=%s"},
+	{OPT_SIZE, "size=%s"},
+	{OPT_NR_INODES, "nr_inodes=%s"},
+	{OPT_SWAP, "swap"},
+	{OPT_COMPRESS, "compress=%u"},
+	{OPT_DEDUP, "dedup"},
+	{OPT_NODEDUP, "nodedup"},
+	{OPT_NOWAIT, "nowait"},
+	{OPT_NONOWAIT, "nonowait"},
 	{OPT_ERR, NULL},
 };
 
@@ -156,6 +209,19 @@ DEFINE_PER_CPU(ino_t, ofs_ino) = 0;
 /******** ******** dentry_operations ******** ********/
 const struct dentry_operations ofs_dops = {
 	.d_delete = ofs_dops_delete_dentry,
+	.d_release = ofs_dops_release,
+};
+
+/**
+ * @brief dentry operations of a negative dentry kept by option "negdcache"
+ * @note
+ * * Only these dentries are revalidated, so the other path components
+ *   don't make the indirect call.
+ */
+static const struct dentry_operations ofs_negd_dops = {
+	.d_revalidate = ofs_dops_revalidate,
+	.d_delete = ofs_dops_delete_dentry,
+	.d_release = ofs_dops_release,
 };
 
 /******** ******** backing device infomations ******** ********/
@@ -170,10 +236,13 @@ struct backing_dev_info ofs_backing_dev_info = {
 
 /******** ******** memory mapping ******** ********/
 static struct address_space_operations ofs_aops = {
-	.readpage = simple_readpage,
-	.write_begin = simple_write_begin,
+	.readpage = ofs_aops_readpage,
+	.write_begin = ofs_aops_write_begin,
 	.write_end = simple_write_end,
 	.set_page_dirty = ofs_set_page_dirty_no_writeback,
+	.invalidatepage = ofs_aops_invalidatepage,
+	.releasepage = ofs_aops_releasepage,
+	.migratepage = ofs_aops_migratepage,
 };
 
 /******** ******** ******** ******** ******** ******** ******** ********
@@ -199,6 +268,9 @@ int ofs_parse_options(struct ofs_mount_opts *mo, char *data, bool remount)
 	int token;
 	int rc;
 	char *p;
+	char *str;
+	char *rest;
+	unsigned long long size;
 	umode_t mode;
 	uid_t uid = 0;
 	gid_t gid = 0;
@@ -248,6 +320,76 @@ int ofs_parse_options(struct ofs_mount_opts *mo, char *data, bool remount)
 				continue;
 			mo->is_magic = true;
 			break;
+		case OPT_LAZY:
+			if (remount)
+				continue;
+			mo->is_lazy = true;
+			break;
+		case OPT_NEGDCACHE:
+			str = match_strdup(&args[0]);
+			if (str == NULL)
+				return -ENOMEM;
+			size = memparse(str, &rest);
+			rc = *rest ? -EINVAL : 0;
+			kfree(str);
+			if (rc)
+				return rc;
+			mo->negdcache = (unsigned long)min_t(unsigned long long,
+							     size, ULONG_MAX);
+			break;
+		case OPT_HUGE:
+			str = match_strdup(&args[0]);
+			if (str == NULL)
+				return -ENOMEM;
+			rc = ofs_huge_parse(str);
+			kfree(str);
+			if (rc < 0)
+				return rc;
+			mo->huge = rc;
+			break;
+		case OPT_SIZE:
+			str = match_strdup(&args[0]);
+			if (str == NULL)
+				return -ENOMEM;
+			rc = ofs_parse_size(str, &mo->max_blocks);
+			kfree(str);
+			if (rc)
+				return rc;
+			break;
+		case OPT_NR_INODES:
+			str = match_strdup(&args[0]);
+			if (str == NULL)
+				return -ENOMEM;
+			size = memparse(str, &rest);
+			rc = *rest ? -EINVAL : 0;
+			kfree(str);
+			if (rc)
+				return rc;
+			mo->max_inodes = (unsigned long)min_t(unsigned long long,
+							      size, ULONG_MAX);
+			break;
+		case OPT_SWAP:
+			if (remount)
+				continue;
+			mo->is_swap = true;
+			break;
+		case OPT_COMPRESS:
+			rc = match_int(&args[0], (int *)&mo->compress);
+			if (rc < 0)
+				return -EINVAL;
+			break;
+		case OPT_DEDUP:
+			mo->dedup = true;
+			break;
+		case OPT_NODEDUP:
+			mo->dedup = false;
+			break;
+		case OPT_NOWAIT:
+			mo->nowait = true;
+			break;
+		case OPT_NONOWAIT:
+			mo->nowait = false;
+			break;
 		}
 	}
 
@@ -298,9 +440,27 @@ int ofs_fill_superblock(struct super_block *sb, char *magic,
 		goto out_return;
 	}
 	memcpy(&newroot->mo, mo, sizeof(struct ofs_mount_opts));
+	atomic_long_set(&newroot->nr_negd, 0);
+	rc = percpu_counter_init(&newroot->negd_hits, 0, GFP_KERNEL);
+	if (rc)
+		goto out_kfree;
+	rc = percpu_counter_init(&newroot->negd_misses, 0, GFP_KERNEL);
+	if (rc)
+		goto out_kfree;
+	rc = percpu_counter_init(&newroot->used_blocks, 0, GFP_KERNEL);
+	if (rc)
+		goto out_kfree;
+	rc = percpu_counter_init(&newroot->used_inodes, 0, GFP_KERNEL);
+	if (rc)
+		goto out_kfree;
 	newroot->sb = sb;
+	newroot->zs = NULL;
+	rc = ofs_zstore_set(newroot, mo->compress);
+	if (rc)
+		goto out_kfree;
 	newroot->is_registered = false;
 	init_rwsem(&newroot->rwsem);
+	INIT_LIST_HEAD(&newroot->node);
 #ifdef CONFIG_OFS_SYSFS
 	newroot->omobj = NULL;
 #endif
@@ -348,11 +508,21 @@ int ofs_fill_superblock(struct super_block *sb, char *magic,
 		spin_unlock(&newroot->rootoi->inode.i_lock);
 		rbtree = ofs_get_rbtree(newroot->rootoi);
 		ofs_rbtree_insert(rbtree, newroot->rootoi);
+		if (mo->is_lazy) {
+			rc = ofs_lazy_construct(newroot);
+			if (rc)
+				goto out_kfree;
+		}
 	}
 
 	return 0;
 
 out_kfree:
+	ofs_zstore_destroy(newroot);
+	percpu_counter_destroy(&newroot->used_inodes);
+	percpu_counter_destroy(&newroot->used_blocks);
+	percpu_counter_destroy(&newroot->negd_misses);
+	percpu_counter_destroy(&newroot->negd_hits);
 	kfree(newroot);
 	sb->s_fs_info = NULL;
 out_return:
@@ -399,8 +569,9 @@ int ofs_set_super(struct super_block *sb, void *data)
  * @param dev_name: When magic user mounting, <b<em>>dev_name</em></b> is 
  *                  the magic string to identify the magic mount.
  *                  It is unused in other mount mode.
- * @param data: When kernel mounting, <b><em>data</em></b> is the magic string.
- *              In other mounting mode, <b><em>data</em></b> is the options
+ * @param data: When kernel mounting, <b><em>data</em></b> is
+ *              <b><em>struct ofs_kmount_data</em></b> (the magic string
+ *              and the options). In other mounting mode, <b><em>data</em></b> is the options
  *              (Passed by "-o option" of <b><i>mount</i></b> cmd).
  * @retval dentry: The root directory dentry of the filesystem if successed.
  * @retval errno: Indicate the error code
@@ -421,21 +592,45 @@ struct dentry *ofs_mount(struct file_system_type *fst, int flags,
 {
 	struct inode *rooti = NULL;
 	char *magic = NULL;
+	char *options;
+	struct ofs_kmount_data *kd;
 	struct super_block *sb = NULL;
 	struct ofs_root *root = NULL;
-	struct ofs_mount_opts mo = { OFS_DEFAULT_MODE,
-		make_kuid(current_user_ns(), 0),
-		make_kgid(current_user_ns(), 0),
-		false,
+	struct ofs_mount_opts mo = {
+		.mode = OFS_DEFAULT_MODE,
+		.kuid = make_kuid(current_user_ns(), 0),
+		.kgid = make_kgid(current_user_ns(), 0),
+		.is_magic = false,
+		.is_lazy = false,
+		.negdcache = 0,
+		.huge = OFS_HUGE_NEVER,
+		.max_blocks = 0,
+		.max_inodes = 0,
+		.is_swap = false,
+		.compress = 0,
+		.dedup = false,
+		.nowait = false,
 	};
 	int ret = 0;
 
-	ofs_dbg("dev_name==%s; data==\"%s\"; %s;\n",
-		dev_name, (char *)data,
+	ofs_dbg("dev_name==%s; data<%p>; %s;\n",
+		dev_name, data,
 		flags & MS_KERNMOUNT ? "kernmount" : "usermount");
 
 	if (flags & MS_KERNMOUNT) {
-		magic = data;
+		kd = (struct ofs_kmount_data *)data;
+		magic = kd->magic;
+		if (kd->options) {
+			options = kstrdup(kd->options, GFP_KERNEL);
+			if (options == NULL)
+				return ERR_PTR(-ENOMEM);
+			ret = ofs_parse_options(&mo, options, false);
+			kfree(options);
+			if (ret) {
+				ofs_err("wrong mount options!\n");
+				return ERR_PTR(ret);
+			}
+		}
 		mo.is_magic = true;
 	} else {		/* user mount */
 		ret = ofs_parse_options(&mo, data, false);
@@ -487,7 +682,13 @@ struct dentry *ofs_mount(struct file_system_type *fst, int flags,
 static
 void ofs_kill_sb(struct super_block *sb)
 {
+	struct ofs_root *root = (struct ofs_root *)sb->s_fs_info;
+
 	ofs_dbg("sb<%p>;\n", sb);
+	if (root && root->lazy)
+		ofs_lazy_shutdown(root);
+	if (root)
+		ofs_zstore_stop(root);
 	kill_litter_super(sb);
 }
 
@@ -496,7 +697,7 @@ void ofs_kill_sb(struct super_block *sb)
  * @brief Get the unique ofs inode number from a percpu variable
  * @return the inode number
  */
-static ino_t get_next_ofs_ino(void)
+ino_t get_next_ofs_ino(void)
 {
 	ino_t *p = &get_cpu_var(ofs_ino);
 	ino_t res = *p;
@@ -521,10 +722,44 @@ static ino_t get_next_ofs_ino(void)
  * @param mode: mode
  * @param dev: device number
  * @retval pointer: the new inode
- * @retval NULL: can't alloc a new inode
+ * @retval NULL: can't alloc a new inode, or the limit of option "nr_inodes"
+ *               is reached.
  */
 struct inode *ofs_new_inode(struct super_block *sb, const struct inode *iparent,
 			    umode_t mode, dev_t dev, bool is_singularity)
+{
+	struct ofs_root *root = (struct ofs_root *)sb->s_fs_info;
+	unsigned long max = ACCESS_ONCE(root->mo.max_inodes);
+	struct inode *newi;
+
+	if (max && percpu_counter_compare(&root->used_inodes, max) >= 0)
+		return NULL;
+	percpu_counter_inc(&root->used_inodes);
+	newi = ofs_new_inode_unlimited(sb, iparent, mode, dev, is_singularity);
+	if (newi == NULL) {
+		percpu_counter_dec(&root->used_inodes);
+		return NULL;
+	}
+	OFS_INODE(newi)->state |= OI_ACCOUNTED;
+	return newi;
+}
+
+/**
+ * @brief Alloc a new ofs inode without counting it in option "nr_inodes"
+ * @param sb: super block
+ * @param iparent: parent inode
+ * @param mode: mode
+ * @param dev: device number
+ * @retval pointer: the new inode
+ * @retval NULL: can't alloc a new inode
+ * @note
+ * * Used to materialize a node that exists as a record already (see
+ *   option "lazy").
+ */
+struct inode *ofs_new_inode_unlimited(struct super_block *sb,
+				      const struct inode *iparent,
+				      umode_t mode, dev_t dev,
+				      bool is_singularity)
 {
 	struct inode *newi;
 	struct ofs_inode *newoi;
@@ -552,6 +787,13 @@ struct inode *ofs_new_inode(struct super_block *sb, const struct inode *iparent,
 			newi->i_fop = &ofs_singularity_fops;
 			newoi->ofsops = &ofs_singularity_ofsops;
 			inc_nlink(newi);
+		} else if (((struct ofs_root *)sb->s_fs_info)->mo.is_swap) {
+			newi->i_op = &ofs_swap_iops;
+			newi->i_fop = &ofs_swap_fops;
+			if (ofs_swap_attach(newi)) {
+				iput(newi);
+				return NULL;
+			}
 		} else {
 			newi->i_op = &ofs_regfile_iops;
 			newi->i_fop = &ofs_regfile_fops;
@@ -589,6 +831,16 @@ void ofs_inode_init_once(void *data)
 	oi->state = 0;
 	oi->ofsops = NULL;
 	oi->symlink = OFS_NULL_OID;
+	oi->rec = NULL;
+	oi->link = NULL;
+	oi->dindex = NULL;
+	oi->nr_children = 0;
+	oi->nr_dormant = 0;
+	atomic_set(&oi->nr_opened, 0);
+	oi->swap = NULL;
+	oi->swap_pages = 0;
+	INIT_RADIX_TREE(&oi->zpages, GFP_NOWAIT);
+	spin_lock_init(&oi->zlock);
 	inode_init_once(&oi->inode);
 }
 
@@ -601,7 +853,6 @@ void ofs_file_init_once(void *data)
 {
 	struct ofs_file *of = (struct ofs_file *)data;
 
-	of->cursor = NULL;
 	of->priv = NULL;
 }
 
@@ -618,8 +869,11 @@ struct inode *ofs_sops_alloc_inode(struct super_block *sb)
 
 	newoi = kmem_cache_alloc(ofs_inode_cache, GFP_KERNEL);
 	ofs_dbg("sb<%p>; newoi<%p>;\n", sb, newoi);
-	if (newoi)
+	if (newoi) {
+		rbtree_init_node(&newoi->rbnode);
+		newoi->rec = NULL;
 		return &newoi->inode;
+	}
 	else
 		return NULL;
 }
@@ -635,10 +889,20 @@ static
 void ofs_destroy_inode_rcu_callback(struct rcu_head *head)
 {
 	struct inode *inode;
+	struct ofs_inode *oi;
 
 	inode = container_of(head, struct inode, i_rcu);
 	ofs_dbg("inode<%p>;\n", inode);
-	kmem_cache_free(ofs_inode_cache, OFS_INODE(inode));
+	oi = OFS_INODE(inode);
+	if (oi->link) {
+		kfree(oi->link);
+		oi->link = NULL;
+	}
+	if (oi->dindex) {
+		ofs_dindex_free(oi->dindex);
+		oi->dindex = NULL;
+	}
+	kmem_cache_free(ofs_inode_cache, oi);
 }
 
 /**
@@ -648,7 +912,17 @@ void ofs_destroy_inode_rcu_callback(struct rcu_head *head)
 static
 void ofs_sops_destroy_inode(struct inode *inode)
 {
+	struct ofs_inode *oi = OFS_INODE(inode);
+
 	ofs_dbg("inode<%p>;\n", inode);
+	if (oi->state & OI_ACCOUNTED) {
+		oi->state &= ~OI_ACCOUNTED;
+		percpu_counter_dec(&((struct ofs_root *)inode->i_sb->s_fs_info)->
+				   used_inodes);
+	}
+	if (oi->swap)
+		ofs_swap_detach(inode);
+	ofs_zpage_truncate(inode, 0, ULONG_MAX);
 	call_rcu(&inode->i_rcu, ofs_destroy_inode_rcu_callback);
 }
 
@@ -701,6 +975,16 @@ void ofs_sops_put_super(struct super_block *sb)
 	root = (struct ofs_root *)(sb->s_fs_info);
 	if (root) {
 		BUG_ON(root->is_registered);
+		if (root->lazy)
+			ofs_lazy_destruct(root);
+		ofs_dbg("negdcache: hits==%lld; misses==%lld;\n",
+			percpu_counter_sum(&root->negd_hits),
+			percpu_counter_sum(&root->negd_misses));
+		ofs_zstore_destroy(root);
+		percpu_counter_destroy(&root->used_inodes);
+		percpu_counter_destroy(&root->used_blocks);
+		percpu_counter_destroy(&root->negd_misses);
+		percpu_counter_destroy(&root->negd_hits);
 		kfree(root);
 		sb->s_fs_info = NULL;
 	}
@@ -716,25 +1000,67 @@ static
 int ofs_sops_remount_fs(struct super_block *sb, int *flags, char *data)
 {
 	struct ofs_root *root = (struct ofs_root *)(sb->s_fs_info);
+	struct ofs_mount_opts mo = root->mo;
 	int err = 0;
 
 	ofs_dbg("sb<%p>; data<%s>;\n", sb, data);
-	err = ofs_parse_options(&(root->mo), data, true);
-	return err;
+	err = ofs_parse_options(&mo, data, true);
+	if (err)
+		return err;
+	err = ofs_zstore_set(root, mo.compress);
+	if (err)
+		return err;
+	err = ofs_set_limit(&root->used_blocks, &root->mo.max_blocks,
+			    mo.max_blocks);
+	if (err)
+		return err;
+	err = ofs_set_limit(&root->used_inodes, &root->mo.max_inodes,
+			    mo.max_inodes);
+	if (err)
+		return err;
+	ACCESS_ONCE(root->mo.negdcache) = mo.negdcache;
+	ACCESS_ONCE(root->mo.huge) = mo.huge;
+	ACCESS_ONCE(root->mo.dedup) = mo.dedup;
+	ACCESS_ONCE(root->mo.nowait) = mo.nowait;
+	return 0;
 }
 
 /**
  * @brief super operation to get the status of a filesystem
- * @param sb: super block
+ * @param dentry: a dentry in the filesystem
+ * @param buf: return the status
+ * @retval 0: OK.
  * @note
- * * This function will be called by kill_litter_super() after all inode iput()
- *   in fsnotify_unmount_inodes(). So, kfree() root here.
+ * * The pages of file data and the inodes in use are reported. Without
+ *   option "size", the total is the RAM; without option "nr_inodes", the
+ *   total is the number of inodes in use.
  */
 static
 int ofs_sops_statfs(struct dentry *dentry, struct kstatfs *buf)
 {
+	struct ofs_root *root = (struct ofs_root *)dentry->d_sb->s_fs_info;
+	unsigned long max;
+	s64 used;
+
 	ofs_dbg("dentry<%p>; buf<%p>;\n", dentry, buf);
-	return simple_statfs(dentry, buf);
+	buf->f_type = dentry->d_sb->s_magic;
+	buf->f_bsize = PAGE_CACHE_SIZE;
+	buf->f_namelen = NAME_MAX;
+
+	max = ACCESS_ONCE(root->mo.max_blocks);
+	if (max == 0)
+		max = totalram_pages;
+	used = percpu_counter_sum_positive(&root->used_blocks);
+	buf->f_blocks = max;
+	buf->f_bfree = buf->f_bavail = used < max ? max - used : 0;
+
+	max = ACCESS_ONCE(root->mo.max_inodes);
+	used = percpu_counter_sum_positive(&root->used_inodes);
+	if (max == 0)
+		max = used;
+	buf->f_files = max;
+	buf->f_ffree = used < max ? max - used : 0;
+	return 0;
 }
 
 /**
@@ -755,12 +1081,55 @@ int ofs_sops_show_options(struct seq_file *seq, struct dentry *rootd)
 	seq_printf(seq, ",gid=%u",
 		   from_kgid_munged(&init_user_ns, root->mo.kgid));
 	seq_printf(seq, "%s", root->mo.is_magic ? ",magic" : "");
+	seq_printf(seq, "%s", root->lazy ? ",lazy" : "");
+	if (root->mo.negdcache)
+		seq_printf(seq, ",negdcache=%lu", root->mo.negdcache);
+	if (root->mo.huge != OFS_HUGE_NEVER)
+		seq_printf(seq, ",huge=%s", ofs_huge_name(root->mo.huge));
+	if (root->mo.max_blocks)
+		seq_printf(seq, ",size=%luk",
+			   root->mo.max_blocks << (PAGE_CACHE_SHIFT - 10));
+	if (root->mo.max_inodes)
+		seq_printf(seq, ",nr_inodes=%lu", root->mo.max_inodes);
+	seq_printf(seq, "%s", root->mo.is_swap ? ",swap" : "");
+	if (root->mo.compress)
+		seq_printf(seq, ",compress=%u", root->mo.compress);
+	seq_printf(seq, "%s", root->mo.dedup ? ",dedup" : "");
+	seq_printf(seq, "%s", root->mo.nowait ? ",nowait" : "");
 
 	return 0;
 }
 
 /******** ******** dentry_operations ******** ********/
 
+/**
+ * @brief dentry operation to check whether a cached dentry is still valid
+ * @param dentry: dentry found in the dcache
+ * @param flags: lookup flags
+ * @retval 1: valid.
+ * @note
+ * * The dcache is always right in ofs. This function only counts the
+ *   lookups that hit a negative dentry kept by option "negdcache" (see
+ *   ofs_negd_dops).
+ * * It may be called in RCU-walk mode (LOOKUP_RCU), so it must not sleep.
+ * * Only the hits in RCU-walk mode are counted. A ref-walk of a path
+ *   usually retries a failed RCU-walk of the same path, so counting it too
+ *   would count the same hit twice.
+ */
+static
+int ofs_dops_revalidate(struct dentry *dentry, unsigned int flags)
+{
+	struct ofs_root *root;
+
+	if ((flags & LOOKUP_RCU) &&
+	    ACCESS_ONCE(dentry->d_fsdata) == OFS_NEGD_KEPT &&
+	    ACCESS_ONCE(dentry->d_inode) == NULL) {
+		root = (struct ofs_root *)dentry->d_sb->s_fs_info;
+		percpu_counter_inc(&root->negd_hits);
+	}
+	return 1;
+}
+
 /**
  * @brief dentry operation to tell the caller whether to delete the dentry.
  * @param dentry: dentry to be deleted
@@ -769,20 +1138,431 @@ int ofs_sops_show_options(struct seq_file *seq, struct dentry *rootd)
  * @note
  * * VFS need this function return 1 to kill dentry. See <em>dput()</em> in
  *   <b><i>fs/dcache.c</em></b> for detail.
+ * * A negative dentry kept by option "negdcache" stays in the LRU list of
+ *   the dcache, and is reclaimed by the dcache shrinker or the umount.
+ *   Other dentries are killed as soon as their last reference drops.
  */
 static
 int ofs_dops_delete_dentry(const struct dentry *dentry)
 {
 	ofs_dbg("dentry<%p>\n", dentry);
+	if (dentry->d_inode == NULL && dentry->d_fsdata == OFS_NEGD_KEPT)
+		return 0;
 	return 1;
 }
 
+/**
+ * @brief dentry operation: release the private data of a dentry
+ * @param dentry: the dentry being killed
+ * @note
+ * * A child of a folder drops its entry of the ordered index here, if the
+ *   entry isn't dropped by unlink or rmdir.
+ */
+static
+void ofs_dops_release(struct dentry *dentry)
+{
+	ofs_negd_forget(dentry);
+	ofs_dindex_release(dentry);
+}
+
+/**
+ * @brief Count a negative lookup, and keep the negative dentry in the dcache
+ *        if the bound of option "negdcache" allows.
+ * @param dentry: the new negative dentry made by lookup
+ * @note
+ * * Call this function before hashing the dentry, so the dentry operations
+ *   can be replaced by ofs_negd_dops without locking.
+ * * The number of kept dentries never exceeds
+ *   <b><em>negdcache / sizeof(struct dentry)</em></b>. Lowering the bound
+ *   by remounting doesn't drop the dentries that are already kept.
+ * * Nothing is counted without option "negdcache".
+ */
+void ofs_negd_keep(struct dentry *dentry)
+{
+	struct ofs_root *root = (struct ofs_root *)dentry->d_sb->s_fs_info;
+	unsigned long max;
+
+	max = ACCESS_ONCE(root->mo.negdcache) / sizeof(struct dentry);
+	if (max == 0)
+		return;
+	percpu_counter_inc(&root->negd_misses);
+	if ((unsigned long)atomic_long_inc_return(&root->nr_negd) > max) {
+		atomic_long_dec(&root->nr_negd);
+		return;
+	}
+	dentry->d_fsdata = OFS_NEGD_KEPT;
+	/* d_set_d_op() only sets the operations of a new dentry. */
+	dentry->d_op = NULL;
+	dentry->d_flags &= ~DCACHE_OP_DELETE;
+	d_set_d_op(dentry, &ofs_negd_dops);
+}
+
+/**
+ * @brief Stop keeping a negative dentry.
+ * @param dentry: the dentry
+ * @note
+ * * Called when the dentry is killed, or when it is going to become
+ *   positive (see @ref ofs_dindex_add()).
+ * * It does nothing if the dentry isn't kept.
+ * * The dentry keeps ofs_negd_dops, because a RCU-walk may be calling
+ *   them, but DCACHE_OP_REVALIDATE is cleared, so the positive dentry
+ *   isn't revalidated any more.
+ */
+void ofs_negd_forget(struct dentry *dentry)
+{
+	struct ofs_root *root;
+
+	if (dentry->d_fsdata != OFS_NEGD_KEPT)
+		return;
+	root = (struct ofs_root *)dentry->d_sb->s_fs_info;
+	dentry->d_fsdata = NULL;
+	spin_lock(&dentry->d_lock);
+	dentry->d_flags &= ~DCACHE_OP_REVALIDATE;
+	spin_unlock(&dentry->d_lock);
+	atomic_long_dec(&root->nr_negd);
+}
+
+/******** ******** limits ******** ********/
+/**
+ * @brief Charge pages of file data to option "size".
+ * @param root: ofs root
+ * @param pages: number of pages
+ * @retval 0: OK.
+ * @retval -ENOSPC: the limit is reached.
+ * @note
+ * * The counter is per-cpu. It is only summed when the usage is near the
+ *   limit, so the write path doesn't touch a shared cache line.
+ */
+int ofs_acct_blocks(struct ofs_root *root, long pages)
+{
+	unsigned long max = ACCESS_ONCE(root->mo.max_blocks);
+
+	if (max && percpu_counter_compare(&root->used_blocks,
+					  (s64)max - pages) > 0)
+		return -ENOSPC;
+	percpu_counter_add(&root->used_blocks, pages);
+	return 0;
+}
+
+/**
+ * @brief Uncharge pages of file data.
+ * @param root: ofs root
+ * @param pages: number of pages
+ */
+void ofs_unacct_blocks(struct ofs_root *root, long pages)
+{
+	percpu_counter_sub(&root->used_blocks, pages);
+}
+
+/**
+ * @brief Mark a page as charged.
+ * @param page: the page
+ * @param root: ofs root that is charged
+ * @note
+ * * The root is kept in page->private, because page->mapping is cleared
+ *   before the page leaves the page cache. PG_private holds a reference of
+ *   the page, the same as buffer heads do.
+ */
+void ofs_page_acct(struct page *page, struct ofs_root *root)
+{
+	page_cache_get(page);
+	set_page_private(page, (unsigned long)root);
+	SetPagePrivate(page);
+}
+
+/**
+ * @brief Uncharge a page marked by @ref ofs_page_acct().
+ * @param page: the page
+ */
+void ofs_page_unacct(struct page *page)
+{
+	struct ofs_root *root = (struct ofs_root *)page_private(page);
+
+	ClearPagePrivate(page);
+	set_page_private(page, 0);
+	page_cache_release(page);
+	ofs_unacct_blocks(root, 1);
+}
+
+/**
+ * @brief Transform the value of option "size" to the number of pages.
+ * @param str: such as "1g", "512m", or "50%" of the RAM
+ * @param pages: return the number of pages. 0 means unlimited.
+ * @retval 0: OK.
+ * @retval -EINVAL: invalid value.
+ */
+int ofs_parse_size(const char *str, unsigned long *pages)
+{
+	unsigned long long size;
+	char *rest;
+
+	size = memparse(str, &rest);
+	if (*rest == '%') {
+		size <<= PAGE_CACHE_SHIFT;
+		size *= totalram_pages;
+		do_div(size, 100);
+		rest++;
+	}
+	if (*rest == '\n')
+		rest++;
+	if (*rest)
+		return -EINVAL;
+	size = DIV_ROUND_UP_ULL(size, PAGE_CACHE_SIZE);
+	*pages = (unsigned long)min_t(unsigned long long, size, ULONG_MAX);
+	return 0;
+}
+
+/**
+ * @brief Change a limit.
+ * @param used: the usage
+ * @param max: the limit
+ * @param val: new value of the limit. 0 means unlimited.
+ * @retval 0: OK.
+ * @retval -EINVAL: the usage is over the new value.
+ * @note
+ * * Used by remount and sysfs.
+ */
+int ofs_set_limit(struct percpu_counter *used, unsigned long *max,
+		  unsigned long val)
+{
+	if (val && percpu_counter_compare(used, val) > 0)
+		return -EINVAL;
+	ACCESS_ONCE(*max) = val;
+	return 0;
+}
+
 /******** ******** memory mapping ******** ********/
+/**
+ * @brief address space operation: read a page
+ * @param file: the file
+ * @param page: the locked page in the page cache
+ * @retval 0: OK.
+ * @retval -EIO: the compressed page is corrupted.
+ * @note
+ * * A compressed page is decompressed (see option "compress").
+ * * A page read from a hole is zeroed and isn't charged to option "size",
+ *   so a read never fails for lack of space. The page is clean and holds
+ *   zeros only. It is charged when it is written (see
+ *   @ref ofs_page_mkwrite()).
+ */
 static
-int ofs_set_page_dirty_no_writeback(struct page *page)
+int ofs_aops_readpage(struct file *file, struct page *page)
+{
+	int rc;
+
+	rc = ofs_zpage_load(page->mapping->host, page);
+	if (rc) {
+		if (rc > 0) {
+			SetPageUptodate(page);
+			rc = 0;
+		}
+		unlock_page(page);
+		return rc;
+	}
+	return simple_readpage(file, page);
+}
+
+/**
+ * @brief vm operation: a read-only page of a shared mapping is about to
+ *        become writable
+ * @param vma: virtual memory
+ * @param vmf: the fault
+ * @return VM_FAULT_* flags
+ * @note
+ * * A page read from a hole isn't charged, so it is charged to option
+ *   "size" here before it is written. SIGBUS is raised if the limit is
+ *   reached.
+ */
+int ofs_page_mkwrite(struct vm_area_struct *vma, struct vm_fault *vmf)
+{
+	struct inode *inode = file_inode(vma->vm_file);
+	struct ofs_root *root = (struct ofs_root *)inode->i_sb->s_fs_info;
+	struct page *page = vmf->page;
+
+	lock_page(page);
+	if (page->mapping != inode->i_mapping) {
+		unlock_page(page);
+		return VM_FAULT_NOPAGE;
+	}
+	if (!PagePrivate(page)) {
+		if (ofs_acct_blocks(root, 1)) {
+			unlock_page(page);
+			return VM_FAULT_SIGBUS;
+		}
+		ofs_page_acct(page, root);
+	}
+	unlock_page(page);
+	return filemap_page_mkwrite(vma, vmf);
+}
+
+/**
+ * @brief address space operation: begin to write a page
+ * @param file: the file
+ * @param mapping: address space of the file
+ * @param pos: position to write
+ * @param len: length to write
+ * @param flags: AOP_FLAG_*
+ * @param pagep: return the locked page
+ * @param fsdata: private data passed to write_end
+ * @retval 0: OK
+ * @retval errno: Indicate the error code
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * See <em>simple_write_begin()</em>. The extent is populated first if it
+ *   should be huge (see option "huge"), a compressed page is decompressed
+ *   (see option "compress"), and a new page is charged to option "size".
+ */
+static
+int ofs_aops_write_begin(struct file *file, struct address_space *mapping,
+			 loff_t pos, unsigned len, unsigned flags,
+			 struct page **pagep, void **fsdata)
 {
-	if (!PageDirty(page)) /* defined in include/linux/page_flags.h */
-		return !TestSetPageDirty(page);
+	struct inode *inode = mapping->host;
+	struct ofs_root *root = (struct ofs_root *)inode->i_sb->s_fs_info;
+	struct page *page;
+	int rc;
+
+	ofs_huge_fill(inode, pos >> PAGE_CACHE_SHIFT,
+		      max_t(loff_t, i_size_read(inode), pos + len), NULL);
+	rc = simple_write_begin(file, mapping, pos, len, flags, pagep, fsdata);
+	if (rc)
+		return rc;
+	page = *pagep;
+	if (!PageUptodate(page)) {
+		rc = ofs_zpage_load(inode, page);
+		if (rc < 0) {
+			unlock_page(page);
+			page_cache_release(page);
+			return rc;
+		}
+		if (rc > 0)
+			SetPageUptodate(page);
+	}
+	if (!PagePrivate(page)) {
+		if (ofs_acct_blocks(root, 1)) {
+			unlock_page(page);
+			page_cache_release(page);
+			return -ENOSPC;
+		}
+		ofs_page_acct(page, root);
+	}
 	return 0;
 }
 
+/**
+ * @brief address space operation: invalidate a page
+ * @param page: the locked page
+ * @param offset: start of the range
+ * @param length: length of the range
+ * @note
+ * * Called when a charged page is truncated. The page is uncharged if the
+ *   whole page is invalidated.
+ */
+static
+void ofs_aops_invalidatepage(struct page *page, unsigned int offset,
+			     unsigned int length)
+{
+	if (offset == 0 && length == PAGE_CACHE_SIZE)
+		ofs_page_unacct(page);
+}
+
+/**
+ * @brief address space operation: release a clean page
+ * @param page: the locked page
+ * @param gfp: allocation flags
+ * @retval 1: the page can be freed.
+ * @retval 0: the page is dirty.
+ * @note
+ * * Only clean pages, such as zeroed holes, are released. Dirty pages are
+ *   never written back, so they stay until truncated.
+ */
+static
+int ofs_aops_releasepage(struct page *page, gfp_t gfp)
+{
+	if (PageDirty(page))
+		return 0;
+	ofs_page_unacct(page);
+	return 1;
+}
+
+/**
+ * @brief address space operation: migrate a page
+ * @param mapping: address space of the page
+ * @param newpage: the new page
+ * @param page: the old page
+ * @param mode: migration mode
+ * @retval 0: OK (MIGRATEPAGE_SUCCESS).
+ * @retval errno: Indicate the error code
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * The charge in page->private and its reference move to the new page
+ *   before <em>migrate_page()</em>, which expects no private reference
+ *   on the old page and clears PG_private of it, like
+ *   <em>buffer_migrate_page()</em> does. They move back if the migration
+ *   fails. The old page is locked, so nobody uncharges it meanwhile.
+ */
+static
+int ofs_aops_migratepage(struct address_space *mapping, struct page *newpage,
+			 struct page *page, enum migrate_mode mode)
+{
+	struct ofs_root *root;
+	int rc;
+
+	if (!PagePrivate(page))
+		return migrate_page(mapping, newpage, page, mode);
+
+	root = (struct ofs_root *)page_private(page);
+	ClearPagePrivate(page);
+	set_page_private(page, 0);
+	page_cache_release(page);
+	page_cache_get(newpage);
+	set_page_private(newpage, (unsigned long)root);
+	SetPagePrivate(newpage);
+
+	rc = migrate_page(mapping, newpage, page, mode);
+	if (rc != MIGRATEPAGE_SUCCESS) {
+		ClearPagePrivate(newpage);
+		set_page_private(newpage, 0);
+		page_cache_release(newpage);
+		page_cache_get(page);
+		set_page_private(page, (unsigned long)root);
+		SetPagePrivate(page);
+	}
+	return rc;
+}
+
+/**
+ * @brief address space operation: mark a page dirty
+ * @param page: the page
+ * @retval 1: the page becomes dirty.
+ * @retval 0: the page is dirty already.
+ * @note
+ * * ofs never writes pages back. A dirty page holds data that was written,
+ *   and a clean page holds zeros only. The dirty tag of the page cache is
+ *   set, so SEEK_DATA and SEEK_HOLE find the data by the tag without
+ *   marking the inode dirty.
+ */
+static
+int ofs_set_page_dirty_no_writeback(struct page *page)
+{
+	struct address_space *mapping;
+	unsigned long flags;
+
+	if (PageDirty(page)) /* defined in include/linux/page_flags.h */
+		return 0;
+	if (TestSetPageDirty(page))
+		return 0;
+	mapping = page_mapping(page);
+	if (mapping) {
+		spin_lock_irqsave(&mapping->tree_lock, flags);
+		if (page->mapping == mapping)
+			radix_tree_tag_set(&mapping->page_tree,
+					   page_index(page),
+					   PAGECACHE_TAG_DIRTY);
+		spin_unlock_irqrestore(&mapping->tree_lock, flags);
+	}
+	return 1;
+}
+
@@ -63,6 +63,17 @@
  */
 #define OFS_HASHTABLE_SIZE_BITS_MIN	L1_CACHE_SHIFT
 
+/**
+ * @brief Max steps of walking a red-black tree without lock. The height of
+ *        a red-black tree is never more than 2 * log2(n + 1).
+ */
+#define OFS_RBTREE_WALK_MAX		(2 * BITS_PER_LONG)
+
+/**
+ * @brief d_fsdata of a negative dentry that is kept by option "negdcache"
+ */
+#define OFS_NEGD_KEPT			((void *)1UL)
+
 /**
  * @brief Get the ofs operations.
  * @param ofsops: ofs operations
@@ -80,6 +91,13 @@
 /******** ******** ******** ******** ******** ******** ******** ********
  ******** ******** ********       types       ******** ******** ********
  ******** ******** ******** ******** ******** ******** ******** ********/
+/**
+ * @brief data of kernel mounting
+ */
+struct ofs_kmount_data {
+	char *magic;	/**< unique magic string */
+	char *options;	/**< mount options or NULL */
+};
 
 /******** ******** ******** ******** ******** ******** ******** ********
  ******** ********         function prototypes         ******** ********
@@ -89,6 +107,10 @@ extern
 struct ofs_inode *ofs_rbtree_lookup(struct ofs_rbtree *ofstree,
 				    const oid_t oid);
 
+extern
+struct ofs_inode *ofs_rbtree_lookup_rcu(struct ofs_rbtree *ofstree,
+					const oid_t oid);
+
 extern
 void ofs_rbtree_oiput(struct ofs_inode *oi);
 
@@ -104,7 +126,18 @@ struct ofs_rbtree *ofs_get_rbtree(struct ofs_inode *oi);
 extern
 struct ofs_rbtree *ofs_get_rbtree_by_oid(const oid_t oid);
 
+/******** ******** magic ******** ********/
+extern
+bool ofs_fill_magic_stat(struct ofs_inode *oi, struct ofs_magic_stat *st);
+
+extern
+int ofs_get_symlink_target(struct dentry *dentry, struct vfsmount *mnt,
+			   struct path *result);
+
 /******** ******** fs ******** ********/
+extern
+ino_t get_next_ofs_ino(void);
+
 extern
 struct inode *ofs_new_inode(struct super_block *sb, const struct inode *iparent,
 			    umode_t mode, dev_t dev, bool is_magic);
@@ -121,6 +154,40 @@ int ofs_test_super(struct super_block *sb, void *magic);
 extern
 int ofs_set_super(struct super_block *sb, void *data);
 
+extern
+void ofs_negd_keep(struct dentry *dentry);
+
+extern
+void ofs_negd_forget(struct dentry *dentry);
+
+extern
+struct inode *ofs_new_inode_unlimited(struct super_block *sb,
+				      const struct inode *iparent,
+				      umode_t mode, dev_t dev,
+				      bool is_singularity);
+
+extern
+int ofs_acct_blocks(struct ofs_root *root, long pages);
+
+extern
+void ofs_unacct_blocks(struct ofs_root *root, long pages);
+
+extern
+void ofs_page_acct(struct page *page, struct ofs_root *root);
+
+extern
+void ofs_page_unacct(struct page *page);
+
+extern
+int ofs_page_mkwrite(struct vm_area_struct *vma, struct vm_fault *vmf);
+
+extern
+int ofs_parse_size(const char *str, unsigned long *pages);
+
+extern
+int ofs_set_limit(struct percpu_counter *used, unsigned long *max,
+		  unsigned long val);
+
 /******** ******** vfs ******** ********/
 extern
 int vfs_path_lookup(struct dentry *, struct vfsmount *, const char *,
@@ -132,6 +199,46 @@ int ofs_simple_positive(struct dentry *dentry)
 	return dentry->d_inode && !d_unhashed(dentry);
 }
 
+/**
+ * @brief Get the inode type.
+ */
+static __always_inline
+unsigned char ofs_dt_type(struct inode *inode)
+{
+	return (inode->i_mode >> 12) & 15;
+}
+
+/**
+ * @brief Is a folder empty ?
+ * @param inode: inode of the folder (NULL for a negative dentry)
+ * @retval true: There isn't any positive child dentry in the folder.
+ * @retval false: The folder has children.
+ * @note
+ * * It replaces simple_empty() without walking d_subdirs.
+ * * Children only in the records of a lazy magic ofs are not counted. Check
+ *   them by ofs_lazy_empty().
+ */
+static __always_inline
+bool ofs_folder_empty(struct inode *inode)
+{
+	return inode == NULL ||
+	       ACCESS_ONCE(OFS_INODE(inode)->nr_children) == 0;
+}
+
+/**
+ * @brief get the number of children of a folder
+ * @param oi: ofs inode of the folder
+ * @return the number of children
+ * @note
+ * * Children only in the records of a lazy magic ofs are counted, so the
+ *   number doesn't change when a child is materialized or de-materialized.
+ */
+static __always_inline
+unsigned long ofs_nr_children(struct ofs_inode *oi)
+{
+	return ACCESS_ONCE(oi->nr_children) + ACCESS_ONCE(oi->nr_dormant);
+}
+
 static inline
 void dentry_rcuwalk_barrier(struct dentry *dentry)
 {
@@ -160,7 +267,10 @@ extern const struct inode_operations ofs_singularity_iops;
 extern const struct file_operations ofs_singularity_fops;
 extern const struct inode_operations ofs_regfile_iops;
 extern const struct file_operations ofs_regfile_fops;
+extern const struct inode_operations ofs_swap_iops;
+extern const struct file_operations ofs_swap_fops;
 extern const struct inode_operations ofs_symlink_iops;
+extern const struct inode_operations ofs_fast_symlink_iops;
 
 /******** ******** fs ******** ********/
 extern struct kmem_cache *ofs_inode_cache;
@@ -0,0 +1,272 @@
+/**
+ * @file
+ * @brief C source of the ofs (octagram filesystem, outlandish filesystem, or
+ *        odd filesystem) kernel module
+ * @author Octagram Sun <octagram@qq.com>
+ * @version 0.1.0
+ * @date 2015
+ * @copyright Octagram Sun <octagram@qq.com>
+ *
+ * @note
+ * C source about the huge extents of file data. 1 tab == 8 spaces.
+ * @note
+ * With option "huge", the data of regular files and singularities is
+ * allocated in huge extents: a PMD-sized and PMD-aligned block of
+ * physically contiguous pages is allocated at once, split, and inserted
+ * into the page cache as a whole when the first page of the extent is
+ * written or faulted. The page cache of linux 3.19 can't hold compound
+ * pages, so the extent is mapped by PTEs. The contiguous backing keeps
+ * the pages close in the TLB and the caches, and the fault-around of
+ * <em>filemap_map_pages()</em> finds all neighbours already in the page
+ * cache, so one fault maps a run of pages instead of one.
+ * @note
+ * The huge block is allocated without retrying hard. If the memory is
+ * fragmented, the extent falls back to order-0 pages silently.
+ */
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ******** ********    header files   ******** ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+#include "ofs.h"
+#include "fs.h"
+#include "log.h"
+#include "huge.h"
+#include "zpage.h"
+#include <linux/pagemap.h>
+#include <linux/highmem.h>
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ******** ********       macro       ******** ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ******** ********       types       ******** ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ********         function prototypes         ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+static
+int ofs_huge_vmops_fault(struct vm_area_struct *vma, struct vm_fault *vmf);
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ******** ********   .sdata & .data  ******** ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+/**
+ * @brief names of the policies of option "huge"
+ */
+static const char * const ofs_huge_names[] = {
+	[OFS_HUGE_NEVER] = "never",
+	[OFS_HUGE_ALWAYS] = "always",
+	[OFS_HUGE_WITHIN_SIZE] = "within_size",
+	[OFS_HUGE_ADVISE] = "advise",
+};
+
+/**
+ * @brief vm operations of a mapping
+ */
+static const struct vm_operations_struct ofs_vmops = {
+	.fault = filemap_fault,
+	.map_pages = filemap_map_pages,
+	.page_mkwrite = ofs_page_mkwrite,
+	.remap_pages = generic_file_remap_pages,
+};
+
+/**
+ * @brief vm operations of a mapping with huge extents
+ */
+static const struct vm_operations_struct ofs_huge_vmops = {
+	.fault = ofs_huge_vmops_fault,
+	.map_pages = filemap_map_pages,
+	.page_mkwrite = ofs_page_mkwrite,
+	.remap_pages = generic_file_remap_pages,
+};
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ********      function implementations       ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+/**
+ * @brief Transform the value of option "huge" to the policy.
+ * @param str: value of option "huge"
+ * @retval policy: <b><em>enum @ref ofs_huge</em></b>
+ * @retval -EINVAL: unknown value
+ */
+int ofs_huge_parse(const char *str)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(ofs_huge_names); i++) {
+		if (strcmp(str, ofs_huge_names[i]) == 0)
+			return i;
+	}
+	return -EINVAL;
+}
+
+/**
+ * @brief Get the name of a policy of option "huge".
+ * @param huge: <b><em>enum @ref ofs_huge</em></b>
+ * @return the name
+ */
+const char *ofs_huge_name(int huge)
+{
+	if (huge < 0 || huge >= ARRAY_SIZE(ofs_huge_names))
+		return ofs_huge_names[OFS_HUGE_NEVER];
+	return ofs_huge_names[huge];
+}
+
+/**
+ * @brief Test whether an extent should be huge.
+ * @param inode: inode of the file
+ * @param start: index of the first page of the extent
+ * @param end: the size that the file will have
+ * @param vma: the mapping if faulting, otherwise NULL
+ * @retval true: yes
+ * @retval false: no
+ */
+static __always_inline
+bool ofs_huge_allowed(struct inode *inode, pgoff_t start, loff_t end,
+		      struct vm_area_struct *vma)
+{
+	struct ofs_root *root = (struct ofs_root *)inode->i_sb->s_fs_info;
+
+	switch (ACCESS_ONCE(root->mo.huge)) {
+	case OFS_HUGE_ALWAYS:
+		return true;
+	case OFS_HUGE_WITHIN_SIZE:
+		return ((loff_t)(start + OFS_HUGE_NR) << PAGE_CACHE_SHIFT) <=
+			end;
+	case OFS_HUGE_ADVISE:
+		return vma && (vma->vm_flags & VM_HUGEPAGE);
+	default:
+		return false;
+	}
+}
+
+/**
+ * @brief Populate an empty extent with a huge block.
+ * @param inode: inode of the file
+ * @param start: index of the first page of the extent. It must be aligned
+ *               to @ref OFS_HUGE_NR.
+ * @retval true: the extent is populated.
+ * @retval false: nothing is done.
+ * @note
+ * * Nothing is done if any page of the extent is in the page cache or
+ *   compressed (see option "compress"), the limit of option "size" can't
+ *   hold the whole extent, or the huge block can't be allocated without
+ *   retrying. The caller then gets order-0 pages as usual.
+ * * The pages are zeroed and uptodate, the same as the pages returned by
+ *   <em>simple_readpage()</em>. A page added by another task in the
+ *   meantime is kept, and the spare one is freed.
+ * * The pages are marked by @ref SetOfsPageHuge(), so the scanner of
+ *   option "compress" doesn't break up the extent.
+ */
+bool ofs_huge_populate(struct inode *inode, pgoff_t start)
+{
+	struct ofs_root *root = (struct ofs_root *)inode->i_sb->s_fs_info;
+	struct address_space *mapping = inode->i_mapping;
+	struct page *page;
+	unsigned long i;
+
+	if ((loff_t)(start + OFS_HUGE_NR) << PAGE_CACHE_SHIFT >
+	    inode->i_sb->s_maxbytes)
+		return false;
+	if (find_get_pages(mapping, start, 1, &page)) {
+		i = page->index;
+		page_cache_release(page);
+		if (i < start + OFS_HUGE_NR)
+			return false;
+	}
+	if (ofs_zpage_next(inode, start) < start + OFS_HUGE_NR)
+		return false;
+
+	if (ofs_acct_blocks(root, OFS_HUGE_NR))
+		return false;
+	page = alloc_pages(mapping_gfp_mask(mapping) | __GFP_NORETRY |
+			   __GFP_NOWARN, OFS_HUGE_ORDER);
+	if (page == NULL) {
+		ofs_dbg("inode<%p>; start==%lu; fall back to order-0.\n",
+			inode, start);
+		ofs_unacct_blocks(root, OFS_HUGE_NR);
+		return false;
+	}
+	split_page(page, OFS_HUGE_ORDER);
+	for (i = 0; i < OFS_HUGE_NR; i++, page++) {
+		clear_highpage(page);
+		__SetPageUptodate(page);
+		SetOfsPageHuge(page);
+		ofs_page_acct(page, root);
+		if (add_to_page_cache_lru(page, mapping, start + i,
+					  GFP_KERNEL) == 0)
+			unlock_page(page);
+		else
+			ofs_page_unacct(page);
+		page_cache_release(page);
+	}
+	return true;
+}
+
+/**
+ * @brief Populate the whole extent around a page with a huge block, if
+ *        option "huge" allows.
+ * @param inode: inode of the file
+ * @param index: index of the page
+ * @param end: the size that the file will have
+ * @param vma: the mapping if faulting, otherwise NULL
+ * @note
+ * * See @ref ofs_huge_populate().
+ */
+void ofs_huge_fill(struct inode *inode, pgoff_t index, loff_t end,
+		   struct vm_area_struct *vma)
+{
+	pgoff_t start = index & ~(OFS_HUGE_NR - 1);
+
+	if (ofs_huge_allowed(inode, start, end, vma))
+		ofs_huge_populate(inode, start);
+}
+
+/**
+ * @brief vm operation: page fault
+ * @param vma: the mapping
+ * @param vmf: fault information
+ * @return VM_FAULT_* of <em>filemap_fault()</em>
+ * @note
+ * * See <em>filemap_fault()</em>. The extent is populated first if it
+ *   should be huge.
+ */
+static
+int ofs_huge_vmops_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
+{
+	struct inode *inode = file_inode(vma->vm_file);
+
+	ofs_huge_fill(inode, vmf->pgoff, i_size_read(inode), vma);
+	return filemap_fault(vma, vmf);
+}
+
+/**
+ * @brief mmap a regular file or a singularity
+ * @param file: the file
+ * @param vma: virtual memory
+ * @retval 0: OK
+ * @retval errno: Indicate the error code
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * The same as <em>generic_file_mmap()</em>, except that faults populate
+ *   huge extents unless option "huge" is "never", and a page is charged
+ *   to option "size" when it becomes writable.
+ */
+int ofs_huge_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct ofs_root *root = (struct ofs_root *)file_inode(file)->i_sb->
+				s_fs_info;
+	int rc;
+
+	rc = generic_file_mmap(file, vma);
+	if (rc)
+		return rc;
+	if (ACCESS_ONCE(root->mo.huge) != OFS_HUGE_NEVER)
+		vma->vm_ops = &ofs_huge_vmops;
+	else
+		vma->vm_ops = &ofs_vmops;
+	return 0;
+}
@@ -0,0 +1,68 @@
+/**
+ * @file
+ * @brief C header for the ofs (octagram filesystem, outlandish filesystem, or
+ *        odd filesystem) kernel module
+ * @author Octagram Sun <octagram@qq.com>
+ * @version 0.1.0
+ * @date 2015
+ * @copyright Octagram Sun <octagram@qq.com>
+ *
+ * @note
+ * C header about the huge extents of file data, is used in ofs internal.
+ * 1 tab == 8 spaces.
+ */
+
+#ifndef __OFS_HUGE_H__
+#define __OFS_HUGE_H__
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ******** ********    header files   ******** ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+#include <linux/types.h>
+#include <linux/fs.h>
+#include <linux/mm.h>
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ******** ********       macro       ******** ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+/**
+ * @brief order of a huge extent (a PMD size, 2 MiB on x86_64)
+ */
+#define OFS_HUGE_ORDER		(PMD_SHIFT - PAGE_CACHE_SHIFT)
+
+/**
+ * @brief number of pages in a huge extent
+ */
+#define OFS_HUGE_NR		(1UL << OFS_HUGE_ORDER)
+
+/**
+ * @brief Is a page of a huge extent ? (PG_owner_priv_1, which ofs doesn't
+ *        use otherwise)
+ */
+#define OfsPageHuge(page)	PageChecked(page)
+#define SetOfsPageHuge(page)	SetPageChecked(page)
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ********         function prototypes         ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+extern
+int ofs_huge_parse(const char *str);
+
+extern
+const char *ofs_huge_name(int huge);
+
+extern
+bool ofs_huge_populate(struct inode *inode, pgoff_t start);
+
+extern
+void ofs_huge_fill(struct inode *inode, pgoff_t index, loff_t end,
+		   struct vm_area_struct *vma);
+
+extern
+int ofs_huge_mmap(struct file *file, struct vm_area_struct *vma);
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ******** ********   .sdata & .data  ******** ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+
+#endif /* huge.h */
@@ -48,6 +48,10 @@
  ******** ******** ********   .sdata & .data  ******** ******** ********
  ******** ******** ******** ******** ******** ******** ******** ********/
 KSYM(security_inode_unlink);
+KSYM(nd_jump_link);
+KSYM(inode_sb_list_lock);
+KSYM(rw_verify_area);
+KSYM(__kernel_write);
 
 /******** ******** ******** ******** ******** ******** ******** ********
  ******** ********      function implementations       ******** ********
@@ -55,6 +59,10 @@ KSYM(security_inode_unlink);
 int ofs_load_ksym(void)
 {
 	KSYM_LOAD(security_inode_unlink);
+	KSYM_LOAD(nd_jump_link);
+	KSYM_LOAD(inode_sb_list_lock);
+	KSYM_LOAD(rw_verify_area);
+	KSYM_LOAD(__kernel_write);
 	return 0;
 }
 
@@ -18,12 +18,15 @@
  ******** ******** ********    header files   ******** ******** ********
  ******** ******** ******** ******** ******** ******** ******** ********/
 #include <linux/security.h>
+#include <linux/namei.h>
+#include <linux/writeback.h>
 
 /******** ******** ******** ******** ******** ******** ******** ********
  ******** ******** ********       macro       ******** ******** ********
  ******** ******** ******** ******** ******** ******** ******** ********/
 #define KSYM(sym)		typeof(sym) *__ksym__##sym
 #define CALL_KSYM(sym, x...)	__ksym__##sym(x)
+#define KSYM_VAR(sym)		(*__ksym__##sym)
 
 /******** ******** ******** ******** ******** ******** ******** ********
  ******** ******** ********       types       ******** ******** ********
@@ -35,9 +38,18 @@
 extern
 int ofs_load_ksym(void);
 
+/* fs/read_write.c, not exported */
+extern
+int rw_verify_area(int read_write, struct file *file, const loff_t *ppos,
+		   size_t count);
+
 /******** ******** ******** ******** ******** ******** ******** ********
  ******** ******** ********   .sdata & .data  ******** ******** ********
  ******** ******** ******** ******** ******** ******** ******** ********/
 extern KSYM(security_inode_unlink);
+extern KSYM(nd_jump_link);
+extern KSYM(inode_sb_list_lock);
+extern KSYM(rw_verify_area);
+extern KSYM(__kernel_write);
 
 #endif /* ksym.h */
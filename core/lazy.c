@@ -0,0 +1,1359 @@
+/**
+ * @file
+ * @brief C source of the ofs (octagram filesystem, outlandish filesystem, or
+ *        odd filesystem) kernel module
+ * @author Octagram Sun <octagram@qq.com>
+ * @version 0.1.0
+ * @date 2015
+ * @copyright Octagram Sun <octagram@qq.com>
+ *
+ * @note
+ * C source about lazy magic nodes. 1 tab == 8 spaces.
+ * @note
+ * A lazy magic ofs (option "lazy") keeps a compact record for every magic
+ * directory, regfile and singularity created by magic apis. The inode and
+ * the dentry of a record are built only when the node is looked up, listed
+ * by readdir or accessed by magic apis, and are released again by a shrinker
+ * under memory pressure if nobody uses them.
+ */
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ******** ********    header files   ******** ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+#include "ofs.h"
+#include "fs.h"
+#include "log.h"
+#include "rbtree.h"
+#include "lazy.h"
+#include "dindex.h"
+#include "zpage.h"
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ******** ********       macro       ******** ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ******** ********       types       ******** ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ********         function prototypes         ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+static
+unsigned long ofs_lazy_shrink_count(struct shrinker *shrinker,
+				    struct shrink_control *sc);
+
+static
+unsigned long ofs_lazy_shrink_scan(struct shrinker *shrinker,
+				   struct shrink_control *sc);
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ******** ********   .sdata & .data  ******** ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ********      function implementations       ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+/******** ******** record ******** ********/
+/**
+ * @brief allocate a record
+ * @param name: name of the node (need not end with '\0')
+ * @param len: length of name
+ * @return the record
+ * @retval NULL: no memory
+ */
+static
+struct ofs_record *ofs_record_alloc(const char *name, unsigned int len)
+{
+	struct ofs_record *rec;
+
+	rec = kzalloc(sizeof(struct ofs_record), GFP_KERNEL);
+	if (unlikely(rec == NULL))
+		return NULL;
+	rec->name = kmalloc(len + 1, GFP_KERNEL);
+	if (unlikely(rec->name == NULL)) {
+		kfree(rec);
+		return NULL;
+	}
+	memcpy(rec->name, name, len);
+	rec->name[len] = '\0';
+	rec->len = len;
+	rec->hash = full_name_hash((const unsigned char *)name, len);
+	INIT_LIST_HEAD(&rec->child);
+	INIT_LIST_HEAD(&rec->children);
+	INIT_LIST_HEAD(&rec->lru);
+	seqcount_init(&rec->seq);
+	return rec;
+}
+
+/**
+ * @brief free a record
+ * @param rec: record
+ * @note
+ * * The record is freed after a RCU grace period, because
+ *   @ref ofs_lazy_stat() may read it. The name isn't read by it.
+ */
+static __always_inline
+void ofs_record_free(struct ofs_record *rec)
+{
+	kfree(rec->name);
+	kfree_rcu(rec, rcu);
+}
+
+/**
+ * @brief Is the record a folder (a directory or a singularity) ?
+ * @param rec: record
+ */
+static __always_inline
+bool ofs_record_is_folder(const struct ofs_record *rec)
+{
+	return S_ISDIR(rec->mode) || rec->is_singularity;
+}
+
+/**
+ * @brief Check the permission of the current task on a record.
+ * @param rec: record
+ * @param mask: MAY_READ, MAY_WRITE and MAY_EXEC
+ * @retval 0: OK
+ * @retval -EACCES: permission denied
+ * @note
+ * * The same as <em>generic_permission()</em> on a folder without ACL: the
+ *   bits of the owner, the group or the others are checked, and
+ *   CAP_DAC_OVERRIDE overrides them.
+ */
+static
+int ofs_record_permission(const struct ofs_record *rec, int mask)
+{
+	unsigned int mode = rec->mode;
+
+	if (uid_eq(current_fsuid(), rec->uid))
+		mode >>= 6;
+	else if (in_group_p(rec->gid))
+		mode >>= 3;
+	if ((mask & ~mode & (MAY_READ | MAY_WRITE | MAY_EXEC)) == 0)
+		return 0;
+	if (capable(CAP_DAC_OVERRIDE))
+		return 0;
+	return -EACCES;
+}
+
+/**
+ * @brief compare the key {parent ino, hash, name} with a record
+ * @retval <0: key < record
+ * @retval 0: key == record
+ * @retval >0: key > record
+ */
+static __always_inline
+int ofs_record_compare_name(ino_t pino, unsigned int hash, const char *name,
+			    unsigned int len, const struct ofs_record *rec)
+{
+	if (pino != rec->parent->ino)
+		return pino < rec->parent->ino ? -1 : 1;
+	if (hash != rec->hash)
+		return hash < rec->hash ? -1 : 1;
+	if (len != rec->len)
+		return len < rec->len ? -1 : 1;
+	return memcmp(name, rec->name, len);
+}
+
+/**
+ * @brief look up a record by inode number
+ * @note
+ * * Call this function under locking <b><em>lazy->lock</em></b>.
+ */
+static
+struct ofs_record *ofs_record_lookup_ino(struct ofs_lazy *lazy, ino_t ino)
+{
+	struct rbtree_node *n = lazy->inos.root;
+	struct ofs_record *rec;
+
+	while (n) {
+		rec = rbtree_entry(n, struct ofs_record, inonode);
+		if (ino < rec->ino)
+			n = n->left;
+		else if (ino > rec->ino)
+			n = n->right;
+		else
+			return rec;
+	}
+	return NULL;
+}
+
+/**
+ * @brief look up a record by inode number without lock
+ * @note
+ * * Call this function under <b><em>rcu_read_lock()</em></b>. The walk is
+ *   retried if the ino index is changed, and the record may be removed
+ *   after returning.
+ */
+static
+struct ofs_record *ofs_record_lookup_ino_rcu(struct ofs_lazy *lazy,
+					     ino_t ino)
+{
+	struct rbtree_node *n;
+	struct ofs_record *rec, *found;
+	unsigned int seq, steps;
+
+	do {
+		seq = read_seqcount_begin(&lazy->seq);
+		found = NULL;
+		n = ACCESS_ONCE(lazy->inos.root);
+		for (steps = 0; n && steps < OFS_RBTREE_WALK_MAX; steps++) {
+			rec = rbtree_entry(n, struct ofs_record, inonode);
+			if (ino < rec->ino) {
+				n = ACCESS_ONCE(n->left);
+			} else if (ino > rec->ino) {
+				n = ACCESS_ONCE(n->right);
+			} else {
+				found = rec;
+				break;
+			}
+		}
+	} while (read_seqcount_retry(&lazy->seq, seq));
+	return found;
+}
+
+/**
+ * @brief look up a record by parent inode number and name
+ * @note
+ * * Call this function under locking <b><em>lazy->lock</em></b>.
+ */
+static
+struct ofs_record *ofs_record_lookup_name(struct ofs_lazy *lazy, ino_t pino,
+					  const char *name, unsigned int len)
+{
+	struct rbtree_node *n = lazy->names.root;
+	struct ofs_record *rec;
+	unsigned int hash = full_name_hash((const unsigned char *)name, len);
+	int ret;
+
+	while (n) {
+		rec = rbtree_entry(n, struct ofs_record, namenode);
+		ret = ofs_record_compare_name(pino, hash, name, len, rec);
+		if (ret < 0)
+			n = n->left;
+		else if (ret > 0)
+			n = n->right;
+		else
+			return rec;
+	}
+	return NULL;
+}
+
+/**
+ * @brief insert a record into the ino index
+ * @note
+ * * Call this function under write-locking <b><em>lazy->lock</em></b>.
+ */
+static
+void ofs_record_insert_ino(struct ofs_lazy *lazy, struct ofs_record *newrec)
+{
+	struct rbtree_node **new;
+	struct ofs_record *rec;
+	ptr_t lpc;
+
+	new = &lazy->inos.root;
+	lpc = (ptr_t)new;
+	while (*new) {
+		rec = rbtree_entry(*new, struct ofs_record, inonode);
+		if (newrec->ino < rec->ino) {
+			new = &((*new)->left);
+			lpc = (ptr_t)new;
+		} else if (newrec->ino > rec->ino) {
+			new = &((*new)->right);
+			lpc = (ptr_t)new | RBTREE_RIGHT;
+		} else {
+			BUG();	/* inode number is unique */
+		}
+	}
+	write_seqcount_begin(&lazy->seq);
+	rbtree_lpc(&newrec->inonode, lpc);
+	rbtree_insert_color(&lazy->inos, &newrec->inonode);
+	write_seqcount_end(&lazy->seq);
+}
+
+/**
+ * @brief insert a record into the name index
+ * @retval true: OK
+ * @retval false: the name exists in the parent.
+ * @note
+ * * Call this function under write-locking <b><em>lazy->lock</em></b>.
+ */
+static
+bool ofs_record_insert_name(struct ofs_lazy *lazy, struct ofs_record *newrec)
+{
+	struct rbtree_node **new;
+	struct ofs_record *rec;
+	ptr_t lpc;
+	int ret;
+
+	new = &lazy->names.root;
+	lpc = (ptr_t)new;
+	while (*new) {
+		rec = rbtree_entry(*new, struct ofs_record, namenode);
+		ret = ofs_record_compare_name(newrec->parent->ino, newrec->hash,
+					      newrec->name, newrec->len, rec);
+		if (ret < 0) {
+			new = &((*new)->left);
+			lpc = (ptr_t)new;
+		} else if (ret > 0) {
+			new = &((*new)->right);
+			lpc = (ptr_t)new | RBTREE_RIGHT;
+		} else {
+			return false;
+		}
+	}
+	rbtree_lpc(&newrec->namenode, lpc);
+	rbtree_insert_color(&lazy->names, &newrec->namenode);
+	return true;
+}
+
+/**
+ * @brief link a new record into the indexes and its parent
+ * @retval true: OK
+ * @retval false: the name exists in the parent.
+ * @note
+ * * Call this function under write-locking <b><em>lazy->lock</em></b>.
+ */
+static
+bool ofs_record_link(struct ofs_lazy *lazy, struct ofs_record *prec,
+		     struct ofs_record *newrec)
+{
+	newrec->parent = prec;
+	if (!ofs_record_insert_name(lazy, newrec))
+		return false;
+	ofs_record_insert_ino(lazy, newrec);
+	list_add(&newrec->child, &prec->children);
+	write_seqcount_begin(&prec->seq);
+	prec->nr_children++;
+	write_seqcount_end(&prec->seq);
+	if (prec->oi)
+		prec->oi->nr_dormant++;
+	if (ofs_record_is_folder(newrec))
+		prec->nr_folders++;
+	lazy->nr_records++;
+	return true;
+}
+
+/******** ******** lazy ofs ******** ********/
+/**
+ * @brief Construct the record index of a lazy magic ofs.
+ * @param root: magic ofs whose root directory is already made.
+ * @retval 0: OK
+ * @retval errno: Indicate the error code
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ */
+int ofs_lazy_construct(struct ofs_root *root)
+{
+	struct ofs_lazy *lazy;
+	struct ofs_record *rec;
+	struct inode *rooti = &root->rootoi->inode;
+	int rc;
+
+	lazy = kzalloc(sizeof(struct ofs_lazy), GFP_KERNEL);
+	if (unlikely(lazy == NULL))
+		return -ENOMEM;
+	rec = ofs_record_alloc("", 0);
+	if (unlikely(rec == NULL)) {
+		rc = -ENOMEM;
+		goto out_kfree;
+	}
+
+	lazy->root = root;
+	rwlock_init(&lazy->lock);
+	seqcount_init(&lazy->seq);
+	rbtree_init(&lazy->inos);
+	rbtree_init(&lazy->names);
+	INIT_LIST_HEAD(&lazy->lru);
+	rec->oi = root->rootoi;
+	rec->ino = rooti->i_ino;
+	rec->mode = rooti->i_mode;
+	ofs_record_insert_ino(lazy, rec); /* root isn't in the name index. */
+	lazy->rootrec = rec;
+	lazy->nr_records = 1;
+	root->rootoi->rec = rec;
+
+	lazy->shrinker.count_objects = ofs_lazy_shrink_count;
+	lazy->shrinker.scan_objects = ofs_lazy_shrink_scan;
+	lazy->shrinker.seeks = DEFAULT_SEEKS;
+	rc = register_shrinker(&lazy->shrinker);
+	if (unlikely(rc)) {
+		ofs_dbg("Failed to register_shrinker()! (errno:%d)\n", rc);
+		root->rootoi->rec = NULL;
+		ofs_record_free(rec);
+		goto out_kfree;
+	}
+	root->lazy = lazy;
+	return 0;
+
+out_kfree:
+	kfree(lazy);
+	return rc;
+}
+
+/**
+ * @brief Stop de-materializing nodes when the lazy magic ofs is killed.
+ * @param root: magic ofs
+ */
+void ofs_lazy_shutdown(struct ofs_root *root)
+{
+	unregister_shrinker(&root->lazy->shrinker);
+}
+
+/**
+ * @brief Destruct the record index of a lazy magic ofs.
+ * @param root: magic ofs whose inodes and dentries are all released.
+ */
+void ofs_lazy_destruct(struct ofs_root *root)
+{
+	struct ofs_lazy *lazy = root->lazy;
+	struct ofs_record *rec, *prec;
+
+	/* post-order traversal without recursion */
+	rec = lazy->rootrec;
+	while (rec) {
+		if (!list_empty(&rec->children)) {
+			rec = list_first_entry(&rec->children,
+					       struct ofs_record, child);
+			continue;
+		}
+		prec = rec->parent;
+		list_del(&rec->child);
+		ofs_record_free(rec);
+		rec = prec;
+	}
+	kfree(lazy);
+	root->lazy = NULL;
+}
+
+/**
+ * @brief Create a record of a magic directory, regfile or singularity.
+ * @param root: lazy magic ofs that has been registered
+ * @param folder: ofs inode descriptor of folder
+ * @param name: name
+ * @param mode: type and authority
+ * @param is_singularity: Is a singularity ?
+ * @param result: buffer to return the ofs inode descriptor of the new node
+ * @retval 0: OK
+ * @retval errno: Indicate the error code
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * Call this function under read-locking <b><em>root->rwsem</em></b>.
+ * * If the folder is materialized, the record is created under its i_mutex,
+ *   so it can't collide with a name in the dcache. Otherwise, only the
+ *   record index is touched, and the permission is checked against the
+ *   record of the folder.
+ * * No inode, dentry, fsnotify event or security hook is involved.
+ */
+int ofs_lazy_create(struct ofs_root *root, oid_t folder, const char *name,
+		    umode_t mode, bool is_singularity, oid_t *result)
+{
+	struct ofs_lazy *lazy = root->lazy;
+	struct ofs_record *newrec, *frec;
+	struct ofs_inode *oifdr;
+	struct inode *ifdr;
+	struct dentry *dfdr, *d;
+	size_t nlen = strlen(name);
+	unsigned int depth = 0;
+	umode_t fmode;
+	kgid_t fgid;
+	int rc;
+
+	if (unlikely(nlen > NAME_MAX))
+		return -ENAMETOOLONG;
+	if (unlikely(nlen == 0))
+		return -EINVAL;
+	/* the same as lookup_one_len() */
+	if (unlikely(strchr(name, '/') || !strcmp(name, ".") ||
+		     !strcmp(name, "..")))
+		return -EACCES;
+
+	newrec = ofs_record_alloc(name, nlen);
+	if (unlikely(newrec == NULL))
+		return -ENOMEM;
+	newrec->ino = get_next_ofs_ino();
+	newrec->is_singularity = is_singularity;
+	newrec->ofsops = is_singularity ? &ofs_singularity_ofsops : NULL;
+	newrec->uid = current_fsuid();
+	newrec->mtime = CURRENT_TIME;
+	newrec->atime = newrec->ctime = newrec->mtime;
+
+retry:
+	if (unlikely(folder.i_sb != root->sb)) {
+		ofs_dbg("The ofs inode {%p, %lu} is not in the magic ofs!\n",
+			folder.i_sb, folder.i_ino);
+		rc = -EPERM;
+		goto out_free;
+	}
+	write_lock(&lazy->lock);
+	frec = ofs_record_lookup_ino(lazy, folder.i_ino);
+	if (frec == NULL) {
+		/* Maybe a magic symlink. Follow it. */
+		write_unlock(&lazy->lock);
+		oifdr = ofs_rbtree_lookup(ofs_get_rbtree_by_oid(folder),
+					  folder);
+		if (unlikely(oifdr == NULL)) {
+			rc = -ENOENT;
+			goto out_free;
+		}
+		if (!S_ISLNK(oifdr->inode.i_mode)) {
+			ofs_rbtree_oiput(oifdr);
+			rc = -ENOTDIR;
+			goto out_free;
+		}
+		if (unlikely(depth >= MAX_NESTED_LINKS)) {
+			ofs_dbg("Too many symbolic links encountered!\n");
+			ofs_rbtree_oiput(oifdr);
+			rc = -ELOOP;
+			goto out_free;
+		}
+		depth++;
+		folder = oifdr->symlink;
+		ofs_rbtree_oiput(oifdr);
+		goto retry;
+	}
+	if (!ofs_record_is_folder(frec)) {
+		write_unlock(&lazy->lock);
+		rc = -ENOTDIR;
+		goto out_free;
+	}
+
+	if (frec->oi == NULL) {
+		/* The folder is not materialized. Only the records change. */
+		rc = ofs_record_permission(frec, MAY_WRITE | MAY_EXEC);
+		if (rc) {
+			write_unlock(&lazy->lock);
+			goto out_free;
+		}
+		if (frec->mode & S_ISGID) {
+			newrec->gid = frec->gid;
+			if (S_ISDIR(mode))
+				mode |= S_ISGID;
+		} else {
+			newrec->gid = current_fsgid();
+		}
+		newrec->mode = mode;
+		if (!ofs_record_link(lazy, frec, newrec)) {
+			write_unlock(&lazy->lock);
+			rc = -EEXIST;
+			goto out_free;
+		}
+		write_seqcount_begin(&frec->seq);
+		frec->mtime = frec->ctime = CURRENT_TIME;
+		write_seqcount_end(&frec->seq);
+		write_unlock(&lazy->lock);
+		*result = (oid_t){root->sb, newrec->ino};
+		return 0;
+	}
+
+	/* The folder is materialized. Serialize with the dcache. */
+	oifdr = frec->oi;
+	ifdr = &oifdr->inode;
+	if (unlikely(!igrab(ifdr))) {
+		write_unlock(&lazy->lock);
+		rc = -ENOENT;
+		goto out_free;
+	}
+	write_unlock(&lazy->lock);
+
+	dfdr = ofs_get_magic_alias(oifdr);
+	if (unlikely(dfdr == NULL)) {
+		ofs_crt("No magic dentry! Is it removing?\n");
+		rc = -EOWNERDEAD;
+		goto out_iput;
+	}
+	mutex_lock_nested(&ifdr->i_mutex, I_MUTEX_PARENT);
+	if ((dfdr->d_inode != ifdr) || IS_DEADDIR(ifdr)) {
+		ofs_dbg("The folder is death!\n");
+		rc = -EOWNERDEAD;
+		goto out_mutex_unlock;
+	}
+	rc = inode_permission(ifdr, MAY_WRITE | MAY_EXEC);
+	if (rc)
+		goto out_mutex_unlock;
+	d = lookup_one_len(name, dfdr, nlen);
+	if (unlikely(IS_ERR(d))) {
+		rc = PTR_ERR(d);
+		ofs_dbg("Failed to lookup_one_len()! (errno: %d)\n", rc);
+		goto out_mutex_unlock;
+	}
+	if (d->d_inode) {
+		dput(d);
+		rc = -EEXIST;
+		goto out_mutex_unlock;
+	}
+	d_drop(d); /* The negative dentry is out of date. */
+	dput(d);
+
+	fmode = ifdr->i_mode;
+	fgid = ifdr->i_gid;
+	if (fmode & S_ISGID) {
+		newrec->gid = fgid;
+		if (S_ISDIR(mode))
+			mode |= S_ISGID;
+	} else {
+		newrec->gid = current_fsgid();
+	}
+	newrec->mode = mode;
+	write_lock(&lazy->lock);
+	if (unlikely(frec->oi != oifdr)) {
+		/* The folder is de-materialized before i_mutex locks. */
+		write_unlock(&lazy->lock);
+		mutex_unlock(&ifdr->i_mutex);
+		dput(dfdr);
+		iput(ifdr);
+		goto retry;
+	}
+	if (unlikely(!ofs_record_link(lazy, frec, newrec))) {
+		write_unlock(&lazy->lock);
+		rc = -EEXIST;
+		goto out_mutex_unlock;
+	}
+	write_unlock(&lazy->lock);
+	if (ofs_record_is_folder(newrec))
+		inc_nlink(ifdr); /* entry of "child/.." */
+	ifdr->i_mtime = ifdr->i_ctime = CURRENT_TIME;
+	mutex_unlock(&ifdr->i_mutex);
+	dput(dfdr);
+	iput(ifdr);
+	*result = (oid_t){root->sb, newrec->ino};
+	return 0;
+
+out_mutex_unlock:
+	mutex_unlock(&ifdr->i_mutex);
+	dput(dfdr);
+out_iput:
+	iput(ifdr);
+out_free:
+	ofs_record_free(newrec);
+	return rc;
+}
+
+/**
+ * @brief Materialize the inode of a record when looking up.
+ * @param iparent: parent directory (or singularity)
+ * @param dentry: the dentry to look up
+ * @param de: return the entry of the folder index for the dentry (see
+ *            @ref ofs_dindex_alloc_entry())
+ * @return the new inode
+ * @retval NULL: no record
+ * @retval errno pointer: Indicate the error code
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * Called by inode operation lookup under locking iparent->i_mutex. So the
+ *   record can't be materialized or removed by others.
+ * * The entry is allocated only if there is a record, so a negative lookup
+ *   allocates nothing. The materialized inode can't be dropped, so the
+ *   entry is allocated before it.
+ * * Instantiate the dentry, add it by @ref ofs_dindex_add_entry() with
+ *   <b><em>*de</em></b>, and then call @ref ofs_lazy_attach().
+ */
+struct inode *ofs_lazy_materialize(struct inode *iparent, struct dentry *dentry,
+				   struct ofs_dirent **de)
+{
+	struct ofs_root *root = (struct ofs_root *)iparent->i_sb->s_fs_info;
+	struct ofs_lazy *lazy = root->lazy;
+	struct ofs_record *rec;
+	struct ofs_inode *newoi;
+	struct inode *newi;
+
+	read_lock(&lazy->lock);
+	rec = ofs_record_lookup_name(lazy, iparent->i_ino,
+				     (const char *)dentry->d_name.name,
+				     dentry->d_name.len);
+	if (rec == NULL || rec->oi) {
+		read_unlock(&lazy->lock);
+		return NULL;
+	}
+	read_unlock(&lazy->lock);
+
+	*de = ofs_dindex_alloc_entry(iparent);
+	if (IS_ERR(*de))
+		return ERR_CAST(*de);
+	newi = ofs_new_inode_unlimited(iparent->i_sb, iparent, rec->mode, 0,
+				       rec->is_singularity);
+	if (unlikely(newi == NULL)) {
+		kfree(*de);
+		return ERR_PTR(-ENOMEM);
+	}
+	newoi = OFS_INODE(newi);
+	newi->i_ino = rec->ino;
+	newi->i_mode = rec->mode;
+	newi->i_uid = rec->uid;
+	newi->i_gid = rec->gid;
+	newi->i_atime = rec->atime;
+	newi->i_mtime = rec->mtime;
+	newi->i_ctime = rec->ctime;
+	if (ofs_record_is_folder(rec))
+		set_nlink(newi, 2 + rec->nr_folders);
+	if (S_ISREG(rec->mode))
+		i_size_write(newi, rec->size);
+	newoi->ofsops = rec->ofsops;
+
+	write_lock(&lazy->lock);
+	write_seqcount_begin(&rec->seq);
+	rec->oi = newoi;
+	write_seqcount_end(&rec->seq);
+	newoi->rec = rec;
+	newoi->nr_dormant = rec->nr_children; /* none is materialized. */
+	rec->parent->oi->nr_dormant--;
+	list_move_tail(&rec->child, &rec->parent->children);
+	list_add_tail(&rec->lru, &lazy->lru);
+	lazy->nr_materialized++;
+	write_unlock(&lazy->lock);
+	ofs_dbg("materialize: rec<%p>==\"%s\"; newoi<%p>;\n",
+		rec, rec->name, newoi);
+	return newi;
+}
+
+/**
+ * @brief Make a materialized dentry magic.
+ * @param dentry: the dentry instantiated with the inode returned by
+ *                @ref ofs_lazy_materialize()
+ */
+void ofs_lazy_attach(struct dentry *dentry)
+{
+	struct inode *inode = dentry->d_inode;
+	struct ofs_inode *oi = OFS_INODE(inode);
+
+	dget(dentry); /* pinned like the dentries made by ofs_dir_iops_*() */
+	spin_lock(&inode->i_lock);
+	oi->magic = dentry;
+	oi->state |= OI_MAGIC;
+	spin_unlock(&inode->i_lock);
+	ofs_rbtree_insert(ofs_get_rbtree(oi), oi);
+}
+
+/**
+ * @brief Materialize a record and all its ancestors by ofs inode descriptor.
+ * @param root: lazy magic ofs that has been registered
+ * @param target: ofs inode descriptor
+ * @return the ofs inode (the refcount is increased like
+ *         @ref ofs_rbtree_lookup())
+ * @retval NULL: not found
+ * @note
+ * * Call this function under read-locking <b><em>root->rwsem</em></b>.
+ * * The ancestors are materialized one by one from the nearest materialized
+ *   ancestor. Each step is a lookup_one_len() under the parent i_mutex.
+ */
+struct ofs_inode *ofs_lazy_get_oi(struct ofs_root *root, oid_t target)
+{
+	struct ofs_lazy *lazy = root->lazy;
+	struct ofs_record *rec;
+	struct ofs_inode *oitgt = NULL, *oip;
+	struct inode *ip;
+	struct dentry *dp, *d;
+	unsigned int len;
+	char *name;
+
+	if (target.i_sb != root->sb)
+		return NULL;
+	name = __getname();
+	if (unlikely(name == NULL))
+		return NULL;
+
+	for (;;) {
+		oitgt = ofs_rbtree_lookup(ofs_get_rbtree_by_oid(target),
+					  target);
+		if (oitgt)
+			break;
+
+		read_lock(&lazy->lock);
+		rec = ofs_record_lookup_ino(lazy, target.i_ino);
+		if (rec == NULL || rec->parent == NULL) {
+			read_unlock(&lazy->lock);
+			break;
+		}
+		while (rec->parent->oi == NULL)
+			rec = rec->parent;
+		oip = rec->parent->oi;
+		ip = &oip->inode;
+		if (unlikely(!igrab(ip))) {
+			read_unlock(&lazy->lock);
+			break;
+		}
+		len = rec->len;
+		memcpy(name, rec->name, len + 1);
+		read_unlock(&lazy->lock);
+
+		dp = ofs_get_magic_alias(oip);
+		if (unlikely(dp == NULL)) {
+			iput(ip);
+			break;
+		}
+		mutex_lock_nested(&ip->i_mutex, I_MUTEX_PARENT);
+		d = lookup_one_len(name, dp, len);
+		if (!IS_ERR(d) && d_is_negative(d))
+			d_drop(d); /* out-of-date negative dentry */
+		mutex_unlock(&ip->i_mutex);
+		dput(dp);
+		iput(ip);
+		if (unlikely(IS_ERR(d)))
+			break;
+		dput(d);
+	}
+
+	__putname(name);
+	return oitgt;
+}
+
+/**
+ * @brief Materialize a batch of children of a magic folder.
+ * @param dentry: the magic dentry of the folder
+ * @param max: the maximal number of children to materialize
+ * @return number of the materialized children
+ * @retval 0: All children have been materialized.
+ * @retval >0: number of the materialized children
+ * @retval errno: Indicate the error code
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * Call this function under locking dentry->d_inode->i_mutex.
+ * * The new children are linked into the index after all existing
+ *   children, so a readdir in progress sees them after the indexed ones.
+ */
+int ofs_lazy_materialize_batch(struct dentry *dentry, unsigned int max)
+{
+	struct inode *inode = dentry->d_inode;
+	struct ofs_inode *oi = OFS_INODE(inode);
+	struct ofs_lazy *lazy;
+	struct ofs_record *rec, *c;
+	struct dentry *d;
+	unsigned int len, nr = 0;
+	char *name;
+	int rc = 0;
+
+	lazy = ((struct ofs_root *)inode->i_sb->s_fs_info)->lazy;
+	if (lazy == NULL || oi->magic != dentry)
+		return 0;
+	name = __getname();
+	if (unlikely(name == NULL))
+		return -ENOMEM;
+
+	while (nr < max) {
+		read_lock(&lazy->lock);
+		rec = oi->rec;
+		if (rec == NULL || list_empty(&rec->children)) {
+			read_unlock(&lazy->lock);
+			break;
+		}
+		/* unmaterialized records are at the head */
+		c = list_first_entry(&rec->children, struct ofs_record, child);
+		if (c->oi) {
+			read_unlock(&lazy->lock);
+			break;
+		}
+		len = c->len;
+		memcpy(name, c->name, len + 1);
+		read_unlock(&lazy->lock);
+
+		d = lookup_one_len(name, dentry, len);
+		if (unlikely(IS_ERR(d))) {
+			rc = PTR_ERR(d);
+			break;
+		}
+		if (d_is_negative(d))
+			d_drop(d); /* out-of-date negative dentry */
+		dput(d);
+		nr++;
+	}
+
+	__putname(name);
+	return rc ? rc : nr;
+}
+
+/**
+ * @brief Materialize all children of a magic folder.
+ * @param dentry: the magic dentry of the folder
+ * @retval 0: OK
+ * @retval errno: Indicate the error code
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * Called before removing the folder recursively, because it works on
+ *   the dcache.
+ */
+int ofs_lazy_materialize_children(struct dentry *dentry)
+{
+	struct inode *inode = dentry->d_inode;
+	int rc;
+
+	mutex_lock(&inode->i_mutex);
+	do {
+		rc = ofs_lazy_materialize_batch(dentry, OFS_LAZY_BATCH);
+	} while (rc > 0);
+	mutex_unlock(&inode->i_mutex);
+	return rc;
+}
+
+/**
+ * @brief copy at most max children without inode of a magic folder from
+ *        their records
+ * @param dir: inode of the folder
+ * @param last: ino of the last copied record, or 0 to copy from the first
+ *              one. It is set to the ino of the last copied record.
+ * @param batch: buffer of the children
+ * @param max: size of batch
+ * @return the number of children copied
+ * @note
+ * * The records are copied under the read-lock of the lazy index, and are
+ *   not materialized.
+ * * If the last copied record has been materialized, moved or removed,
+ *   nothing is copied, and the rest of the records are missed.
+ */
+unsigned int ofs_lazy_copy_dormant(struct inode *dir, ino_t *last,
+				   struct ofs_child *batch, unsigned int max)
+{
+	struct ofs_inode *oi = OFS_INODE(dir);
+	struct ofs_lazy *lazy;
+	struct ofs_record *rec, *c;
+	unsigned int n = 0;
+
+	lazy = ((struct ofs_root *)dir->i_sb->s_fs_info)->lazy;
+	if (lazy == NULL)
+		return 0;
+
+	read_lock(&lazy->lock);
+	rec = oi->rec;
+	if (rec == NULL)
+		goto out_read_unlock;
+	if (*last == 0) {
+		c = list_first_entry(&rec->children, struct ofs_record, child);
+	} else {
+		c = ofs_record_lookup_ino(lazy, *last);
+		if (c == NULL || c->parent != rec || c->oi)
+			goto out_read_unlock;
+		c = list_next_entry(c, child);
+	}
+	/* unmaterialized records are at the head */
+	while (n < max && &c->child != &rec->children && c->oi == NULL) {
+		batch[n].oid = (oid_t){dir->i_sb, c->ino};
+		batch[n].mode = c->mode;
+		batch[n].len = c->len;
+		memcpy(batch[n].name, c->name, c->len + 1);
+		*last = c->ino;
+		n++;
+		c = list_next_entry(c, child);
+	}
+
+out_read_unlock:
+	read_unlock(&lazy->lock);
+	return n;
+}
+
+/**
+ * @brief Check whether a magic folder has no record of child.
+ * @param oi: ofs inode of the folder
+ * @note
+ * * Children that are materialized are also in the dcache.
+ */
+bool ofs_lazy_empty(struct ofs_inode *oi)
+{
+	struct ofs_lazy *lazy;
+	bool empty;
+
+	if (oi->rec == NULL)
+		return true;
+	lazy = ((struct ofs_root *)oi->inode.i_sb->s_fs_info)->lazy;
+	read_lock(&lazy->lock);
+	empty = list_empty(&oi->rec->children);
+	read_unlock(&lazy->lock);
+	return empty;
+}
+
+/**
+ * @brief Remove the record of a magic ofs inode that is removing.
+ * @param oi: ofs inode
+ * @note
+ * * Called by inode operation unlink and rmdir under locking the parent
+ *   i_mutex.
+ */
+void ofs_lazy_forget(struct ofs_inode *oi)
+{
+	struct ofs_record *rec = oi->rec;
+	struct ofs_lazy *lazy;
+
+	if (rec == NULL)
+		return;
+	lazy = ((struct ofs_root *)oi->inode.i_sb->s_fs_info)->lazy;
+	write_lock(&lazy->lock);
+	BUG_ON(!list_empty(&rec->children));
+	rbtree_rm(&lazy->names, &rec->namenode);
+	write_seqcount_begin(&lazy->seq);
+	rbtree_rm(&lazy->inos, &rec->inonode);
+	write_seqcount_end(&lazy->seq);
+	list_del(&rec->child);
+	list_del(&rec->lru);
+	write_seqcount_begin(&rec->parent->seq);
+	rec->parent->nr_children--;
+	write_seqcount_end(&rec->parent->seq);
+	if (ofs_record_is_folder(rec))
+		rec->parent->nr_folders--;
+	lazy->nr_records--;
+	lazy->nr_materialized--;
+	oi->rec = NULL;
+	write_unlock(&lazy->lock);
+	ofs_record_free(rec);
+}
+
+/**
+ * @brief Get the metadata of a magic node from its record.
+ * @param lazy: record index
+ * @param ino: inode number
+ * @param st: buffer to return the result
+ * @retval 0: OK
+ * @retval -ENOENT: no such node
+ * @note
+ * * Call this function under <b><em>rcu_read_lock()</em></b>. It is called
+ *   by @ref ofs_stat_magic() when the node isn't found in the red-black
+ *   tree.
+ * * <b><em>lazy->lock</em></b> isn't taken, so polling stat doesn't write
+ *   the shared lock. The record is found under RCU, and its fields are read
+ *   again if its seqcount changes.
+ */
+int ofs_lazy_stat(struct ofs_lazy *lazy, ino_t ino, struct ofs_magic_stat *st)
+{
+	struct ofs_record *rec, *prec;
+	struct ofs_inode *oi;
+	struct super_block *sb = lazy->root->sb;
+	unsigned int seq;
+
+	rec = ofs_record_lookup_ino_rcu(lazy, ino);
+	if (rec == NULL)
+		return -ENOENT;
+	do {
+		seq = read_seqcount_begin(&rec->seq);
+		oi = ACCESS_ONCE(rec->oi);
+		if (oi)
+			break;
+		prec = ACCESS_ONCE(rec->parent);
+		st->oid = (oid_t){sb, rec->ino};
+		st->parent = prec ? (oid_t){sb, prec->ino} : OFS_NULL_OID;
+		st->mode = rec->mode;
+		st->is_singularity = rec->is_singularity;
+		st->is_materialized = false;
+		st->size = rec->size;
+		st->mtime = rec->mtime;
+		st->nr_children = rec->nr_children;
+	} while (read_seqcount_retry(&rec->seq, seq));
+
+	/* materialized, but out of the red-black tree for a moment */
+	if (oi && !ofs_fill_magic_stat(oi, st))
+		return -ENOENT;
+	return 0;
+}
+
+/**
+ * @brief copy the name of a dentry for a record
+ * @param d: dentry
+ * @return the copy
+ * @retval NULL: no memory
+ */
+static
+char *ofs_record_dup_name(struct dentry *d)
+{
+	unsigned int len = d->d_name.len;
+	char *name;
+
+	name = kmalloc(len + 1, GFP_KERNEL);
+	if (unlikely(name == NULL))
+		return NULL;
+	memcpy(name, d->d_name.name, len);
+	name[len] = '\0';
+	return name;
+}
+
+/**
+ * @brief give a record a new name in a new parent
+ * @return old name to free
+ * @note
+ * * The record must be removed from the name index before.
+ * * Call this function under write-locking <b><em>lazy->lock</em></b>.
+ */
+static
+char *ofs_record_relink(struct ofs_record *rec, struct ofs_record *newprec,
+			char *name, unsigned int len)
+{
+	char *oldname = rec->name;
+
+	rbtree_init_node(&rec->namenode);
+	rec->name = name;
+	rec->len = len;
+	rec->hash = full_name_hash((const unsigned char *)name, len);
+	write_seqcount_begin(&rec->parent->seq);
+	rec->parent->nr_children--;
+	write_seqcount_end(&rec->parent->seq);
+	write_seqcount_begin(&newprec->seq);
+	newprec->nr_children++;
+	write_seqcount_end(&newprec->seq);
+	if (ofs_record_is_folder(rec)) {
+		rec->parent->nr_folders--;
+		newprec->nr_folders++;
+	}
+	write_seqcount_begin(&rec->seq);
+	rec->parent = newprec;
+	write_seqcount_end(&rec->seq);
+	list_move_tail(&rec->child, &newprec->children); /* materialized */
+	return oldname;
+}
+
+/**
+ * @brief Move the record of a magic ofs inode that is renaming.
+ * @param oi: ofs inode
+ * @param inewparent: new parent
+ * @param newd: new dentry
+ * @retval 0: OK
+ * @retval errno: Indicate the error code
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * Called by inode operation rename2 under locking both parents.
+ */
+int ofs_lazy_move(struct ofs_inode *oi, struct inode *inewparent,
+		  struct dentry *newd)
+{
+	struct ofs_record *rec = oi->rec;
+	struct ofs_record *newprec = OFS_INODE(inewparent)->rec;
+	struct ofs_lazy *lazy;
+	char *name, *oldname;
+
+	if (rec == NULL)
+		return 0;
+	if (unlikely(newprec == NULL))
+		return -EPERM;
+	name = ofs_record_dup_name(newd);
+	if (unlikely(name == NULL))
+		return -ENOMEM;
+
+	lazy = ((struct ofs_root *)oi->inode.i_sb->s_fs_info)->lazy;
+	write_lock(&lazy->lock);
+	rbtree_rm(&lazy->names, &rec->namenode);
+	oldname = ofs_record_relink(rec, newprec, name, newd->d_name.len);
+	/* The new dentry is negative, so no record owns the new name. */
+	WARN_ON(!ofs_record_insert_name(lazy, rec));
+	write_unlock(&lazy->lock);
+	kfree(oldname);
+	return 0;
+}
+
+/**
+ * @brief Exchange the records of two ofs inodes that are renaming with
+ *        RENAME_EXCHANGE.
+ * @param oi1: ofs inode of dentry d1 if it is magic, otherwise NULL
+ * @param ip1: parent of d1
+ * @param d1: dentry 1
+ * @param oi2: ofs inode of dentry d2 if it is magic, otherwise NULL
+ * @param ip2: parent of d2
+ * @param d2: dentry 2
+ * @retval 0: OK
+ * @retval errno: Indicate the error code
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * Called by inode operation rename2 under locking both parents.
+ * * Nothing changes if it fails.
+ */
+int ofs_lazy_exchange(struct ofs_inode *oi1, struct inode *ip1,
+		      struct dentry *d1, struct ofs_inode *oi2,
+		      struct inode *ip2, struct dentry *d2)
+{
+	struct ofs_record *rec1 = oi1 ? oi1->rec : NULL;
+	struct ofs_record *rec2 = oi2 ? oi2->rec : NULL;
+	struct ofs_record *prec1 = OFS_INODE(ip1)->rec;
+	struct ofs_record *prec2 = OFS_INODE(ip2)->rec;
+	struct ofs_lazy *lazy;
+	char *name1 = NULL, *name2 = NULL, *old1 = NULL, *old2 = NULL;
+
+	if (rec1 == NULL && rec2 == NULL)
+		return 0;
+	if (unlikely((rec1 && prec2 == NULL) || (rec2 && prec1 == NULL)))
+		return -EPERM;
+	if (rec1) {
+		name1 = ofs_record_dup_name(d2);
+		if (unlikely(name1 == NULL))
+			return -ENOMEM;
+	}
+	if (rec2) {
+		name2 = ofs_record_dup_name(d1);
+		if (unlikely(name2 == NULL)) {
+			kfree(name1);
+			return -ENOMEM;
+		}
+	}
+
+	lazy = ((struct ofs_root *)ip1->i_sb->s_fs_info)->lazy;
+	write_lock(&lazy->lock);
+	if (rec1)
+		rbtree_rm(&lazy->names, &rec1->namenode);
+	if (rec2)
+		rbtree_rm(&lazy->names, &rec2->namenode);
+	if (rec1)
+		old1 = ofs_record_relink(rec1, prec2, name1, d2->d_name.len);
+	if (rec2)
+		old2 = ofs_record_relink(rec2, prec1, name2, d1->d_name.len);
+	if (rec1)
+		WARN_ON(!ofs_record_insert_name(lazy, rec1));
+	if (rec2)
+		WARN_ON(!ofs_record_insert_name(lazy, rec2));
+	write_unlock(&lazy->lock);
+	kfree(old1);
+	kfree(old2);
+	return 0;
+}
+
+/******** ******** shrinker ******** ********/
+/**
+ * @brief Release the inode and the dentry of a materialized record.
+ * @param lazy: record index
+ * @param oi: ofs inode (igrab()ed)
+ * @param ip: parent inode (igrab()ed)
+ * @retval true: de-materialized
+ * @retval false: busy
+ * @note
+ * * The node must be idle: only the pinned dentry refers to it, no child in
+ *   dcache, no page, no mount, no hard link.
+ * * The size of a regfile and the times are kept in the record. The number
+ *   of links is 1 for a regfile and is computed from nr_folders for a
+ *   folder, so it needn't be kept.
+ * * A swap-backed regfile keeps its data in its shmem file instead of its
+ *   page cache, and a regfile may keep its data in compressed pages (see
+ *   option "compress"), so neither is de-materialized.
+ * * The node is removed from the ofs inode rbtree first, so magic apis
+ *   can't find it any more, and then the dentry is dropped under d_lock.
+ */
+static
+bool ofs_lazy_dematerialize(struct ofs_lazy *lazy, struct ofs_inode *oi,
+			    struct inode *ip)
+{
+	struct inode *inode = &oi->inode;
+	struct ofs_rbtree *tree;
+	struct ofs_record *rec;
+	struct dentry *dentry;
+	bool done = false;
+
+	if (!mutex_trylock(&ip->i_mutex))
+		return false;
+	rec = oi->rec;
+	dentry = oi->magic;
+	if (rec == NULL || dentry == NULL || dentry->d_parent->d_inode != ip)
+		goto out_mutex_unlock;
+	if (!S_ISDIR(inode->i_mode) && !S_ISREG(inode->i_mode))
+		goto out_mutex_unlock;
+	if (S_ISREG(inode->i_mode) && inode->i_nlink != 1)
+		goto out_mutex_unlock;
+	if (inode->i_mapping->nrpages || oi->swap || d_mountpoint(dentry))
+		goto out_mutex_unlock;
+	if (atomic_read(&OFS_INODE(ip)->nr_opened))
+		goto out_mutex_unlock; /* keep readdir positions of the parent */
+	if (S_ISREG(inode->i_mode) && ofs_zpage_next(inode, 0) != ULONG_MAX)
+		goto out_mutex_unlock;
+
+	tree = ofs_get_rbtree(oi);
+	ofs_rbtree_remove(tree, oi);
+	spin_lock(&dentry->d_lock);
+	if (dentry->d_lockref.count != 1 ||
+	    !list_empty(&dentry->d_subdirs) ||
+	    atomic_read(&inode->i_count) != 2) {
+		spin_unlock(&dentry->d_lock);
+		rbtree_init_node(&oi->rbnode);
+		ofs_rbtree_insert(tree, oi);
+		goto out_mutex_unlock;
+	}
+	__d_drop(dentry);
+	spin_unlock(&dentry->d_lock);
+
+	spin_lock(&inode->i_lock);
+	oi->magic = NULL;
+	oi->state &= ~OI_MAGIC;
+	spin_unlock(&inode->i_lock);
+
+	write_lock(&lazy->lock);
+	write_seqcount_begin(&rec->seq);
+	rec->mode = inode->i_mode;
+	rec->uid = inode->i_uid;
+	rec->gid = inode->i_gid;
+	if (S_ISREG(inode->i_mode))
+		rec->size = i_size_read(inode);
+	rec->atime = inode->i_atime;
+	rec->mtime = inode->i_mtime;
+	rec->ctime = inode->i_ctime;
+	rec->ofsops = oi->ofsops;
+	rec->oi = NULL;
+	write_seqcount_end(&rec->seq);
+	oi->rec = NULL;
+	rec->parent->oi->nr_dormant++;
+	list_del_init(&rec->lru);
+	list_move(&rec->child, &rec->parent->children);
+	lazy->nr_materialized--;
+	write_unlock(&lazy->lock);
+	ofs_dbg("de-materialize: rec<%p>==\"%s\"; oi<%p>;\n", rec, rec->name,
+		oi);
+
+	dput(dentry); /* unpin, the dentry is killed. */
+	done = true;
+
+out_mutex_unlock:
+	mutex_unlock(&ip->i_mutex);
+	return done;
+}
+
+/**
+ * @brief shrinker callback: count the materialized records
+ */
+static
+unsigned long ofs_lazy_shrink_count(struct shrinker *shrinker,
+				    struct shrink_control *sc)
+{
+	struct ofs_lazy *lazy = container_of(shrinker, struct ofs_lazy,
+					     shrinker);
+
+	return ACCESS_ONCE(lazy->nr_materialized);
+}
+
+/**
+ * @brief shrinker callback: de-materialize the idle records in lru order
+ */
+static
+unsigned long ofs_lazy_shrink_scan(struct shrinker *shrinker,
+				   struct shrink_control *sc)
+{
+	struct ofs_lazy *lazy = container_of(shrinker, struct ofs_lazy,
+					     shrinker);
+	struct ofs_record *rec;
+	struct ofs_inode *oi, *oip;
+	unsigned long nr = sc->nr_to_scan, freed = 0;
+
+	if (!(sc->gfp_mask & __GFP_FS))
+		return SHRINK_STOP;
+
+	while (nr--) {
+		write_lock(&lazy->lock);
+		if (list_empty(&lazy->lru)) {
+			write_unlock(&lazy->lock);
+			break;
+		}
+		rec = list_first_entry(&lazy->lru, struct ofs_record, lru);
+		list_move_tail(&rec->lru, &lazy->lru);
+		oi = rec->oi;
+		oip = rec->parent->oi;
+		if (!igrab(&oi->inode)) {
+			write_unlock(&lazy->lock);
+			continue;
+		}
+		if (!igrab(&oip->inode)) {
+			write_unlock(&lazy->lock);
+			iput(&oi->inode);
+			continue;
+		}
+		write_unlock(&lazy->lock);
+
+		if (ofs_lazy_dematerialize(lazy, oi, &oip->inode))
+			freed++;
+		iput(&oip->inode);
+		iput(&oi->inode);
+	}
+	return freed;
+}
@@ -0,0 +1,175 @@
+/**
+ * @file
+ * @brief C header for the ofs (octagram filesystem, outlandish filesystem, or
+ *        odd filesystem) kernel module
+ * @author Octagram Sun <octagram@qq.com>
+ * @version 0.1.0
+ * @date 2015
+ * @copyright Octagram Sun <octagram@qq.com>
+ *
+ * @note
+ * C header about lazy magic nodes, is used in ofs internal.
+ * 1 tab == 8 spaces.
+ */
+
+#ifndef __OFS_LAZY_H__
+#define __OFS_LAZY_H__
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ******** ********    header files   ******** ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+#include <linux/types.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/seqlock.h>
+#include <linux/rcupdate.h>
+#include <linux/shrinker.h>
+#include "rbtree.h"
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ******** ********       macro       ******** ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+/**
+ * @brief number of children materialized by one readdir batch
+ */
+#define OFS_LAZY_BATCH			64
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ******** ********       types       ******** ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+struct ofs_dirent;
+struct ofs_child;
+
+/**
+ * @brief compact index record of a magic node in a lazy magic ofs
+ * @note
+ * * A record describes a magic directory, regfile or singularity without
+ *   an inode and a dentry. The inode and the dentry are materialized when
+ *   the node is looked up, read by readdir or accessed by magic apis.
+ * * All fields are protected by <b><em>struct ofs_lazy</em></b>.lock.
+ *   Writers also change the fields read by @ref ofs_lazy_stat() inside
+ *   <b><em>seq</em></b>, so that it reads them without the lock.
+ * * It is freed after a RCU grace period.
+ */
+struct ofs_record {
+	struct rbtree_node inonode;	/**< link in the ino index */
+	struct rbtree_node namenode;	/**< link in the name index */
+	struct list_head child;		/**< link in the children list of
+					 *   parent. Unmaterialized records
+					 *   are at the head of the list.
+					 */
+	struct list_head children;	/**< children records */
+	struct list_head lru;		/**< link in the lru list of
+					 *   materialized records
+					 */
+	struct ofs_record *parent;	/**< parent record */
+	struct ofs_inode *oi;		/**< materialized ofs inode or NULL */
+	const struct ofs_operations *ofsops;	/**< ofs operations */
+	ino_t ino;			/**< inode number */
+	umode_t mode;			/**< type and authority */
+	bool is_singularity;		/**< Is a singularity ? */
+	kuid_t uid;			/**< owner */
+	kgid_t gid;			/**< group */
+	loff_t size;			/**< size of a regfile or a
+					 *   singularity
+					 */
+	struct timespec atime;		/**< last access time */
+	struct timespec mtime;		/**< last modification time */
+	struct timespec ctime;		/**< last change time */
+	unsigned int nr_folders;	/**< number of child directories and
+					 *   child singularities
+					 */
+	unsigned int nr_children;	/**< number of children records */
+	unsigned int hash;		/**< hash of name */
+	unsigned int len;		/**< length of name */
+	char *name;			/**< name */
+	seqcount_t seq;			/**< changed by writers of oi, parent,
+					 *   mode, size, mtime and nr_children
+					 */
+	struct rcu_head rcu;		/**< rcu head to free the record */
+};
+
+/**
+ * @brief index of compact records of a lazy magic ofs
+ */
+struct ofs_lazy {
+	struct ofs_root *root;		/**< owner */
+	rwlock_t lock;			/**< protects the indexes, the lists and
+					 *   all records
+					 */
+	seqcount_t seq;			/**< changed by writers of the ino
+					 *   index under the lock
+					 */
+	struct rbtree inos;		/**< records sorted by ino */
+	struct rbtree names;		/**< records sorted by
+					 *   {parent ino, hash, name}
+					 */
+	struct list_head lru;		/**< materialized records */
+	struct ofs_record *rootrec;	/**< record of root directory */
+	unsigned long nr_records;	/**< number of records */
+	unsigned long nr_materialized;	/**< number of materialized records */
+	struct shrinker shrinker;	/**< shrinker to de-materialize idle
+					 *   records
+					 */
+};
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ********         function prototypes         ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+extern
+int ofs_lazy_construct(struct ofs_root *root);
+
+extern
+void ofs_lazy_shutdown(struct ofs_root *root);
+
+extern
+void ofs_lazy_destruct(struct ofs_root *root);
+
+extern
+int ofs_lazy_create(struct ofs_root *root, oid_t folder, const char *name,
+		    umode_t mode, bool is_singularity, oid_t *result);
+
+extern
+struct inode *ofs_lazy_materialize(struct inode *iparent,
+				   struct dentry *dentry,
+				   struct ofs_dirent **de);
+
+extern
+void ofs_lazy_attach(struct dentry *dentry);
+
+extern
+struct ofs_inode *ofs_lazy_get_oi(struct ofs_root *root, oid_t target);
+
+extern
+int ofs_lazy_materialize_batch(struct dentry *dentry, unsigned int max);
+
+extern
+int ofs_lazy_materialize_children(struct dentry *dentry);
+
+extern
+unsigned int ofs_lazy_copy_dormant(struct inode *dir, ino_t *last,
+				   struct ofs_child *batch, unsigned int max);
+
+extern
+bool ofs_lazy_empty(struct ofs_inode *oi);
+
+extern
+void ofs_lazy_forget(struct ofs_inode *oi);
+
+extern
+int ofs_lazy_stat(struct ofs_lazy *lazy, ino_t ino, struct ofs_magic_stat *st);
+
+extern
+int ofs_lazy_move(struct ofs_inode *oi, struct inode *inewparent,
+		  struct dentry *newd);
+
+extern
+int ofs_lazy_exchange(struct ofs_inode *oi1, struct inode *ip1,
+		      struct dentry *d1, struct ofs_inode *oi2,
+		      struct inode *ip2, struct dentry *d2);
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ******** ********   .sdata & .data  ******** ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+
+#endif /* lazy.h */
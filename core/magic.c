@@ -19,6 +19,8 @@
 #include "log.h"
 #include "ksym.h"
 #include "rbtree.h"
+#include "lazy.h"
+#include "dindex.h"
 #ifdef CONFIG_OFS_SYSFS
 #include "omsys.h"
 #endif
@@ -29,6 +31,11 @@
 /******** ******** ******** ******** ******** ******** ******** ********
  ******** ******** ********       macro       ******** ******** ********
  ******** ******** ******** ******** ******** ******** ******** ********/
+/**
+ * @brief Max number of children copied from the index of a folder at a time
+ *        by @ref ofs_for_each_child_magic()
+ */
+#define OFS_CHILDREN_BATCH	16
 
 /******** ******** ******** ******** ******** ******** ******** ********
  ******** ******** ********       types       ******** ******** ********
@@ -45,6 +52,10 @@
 struct ofs_rbtree *ofs_rbtrees = NULL;
 extern int hashtable_size_bits;
 
+/******** ******** registered magic ofs ******** ********/
+static LIST_HEAD(ofs_roots);		/* registered magic ofs */
+static DEFINE_SPINLOCK(ofs_roots_lock);	/* protects ofs_roots */
+
 /******** ******** ******** ******** ******** ******** ******** ********
  ******** ********      function implementations       ******** ********
  ******** ******** ******** ******** ******** ******** ******** ********/
@@ -82,17 +93,56 @@ struct ofs_inode *ofs_rbtree_lookup(struct ofs_rbtree *ofstree,
 		} else if (ret > 0) {
 			n = n->right;
 		} else {
+			/* igrab() under the lock, because the inode may be
+			   removed from the tree and freed after unlocking. */
+			if (!igrab(&oitgt->inode))
+				oitgt = NULL;
 			read_unlock(&ofstree->lock);
-			if (igrab(&oitgt->inode)) {
-				return oitgt;
-			}
-			return NULL;
+			return oitgt;
 		}
 	}
 	read_unlock(&ofstree->lock);
 	return NULL;
 }
 
+/**
+ * @brief ofs red-black tree function: lookup without lock
+ * @param ofstree: red-black tree
+ * @param target: ofs inode descriptor (key in red-black tree)
+ * @return ofs inode
+ * @retval NULL: nothing to found.
+ * @note
+ * * Call this function under <b><em>rcu_read_lock()</em></b>. No reference
+ *   is taken: the ofs inode is valid until <b><em>rcu_read_unlock()</em></b>
+ *   because it is freed by RCU callback, but it may be dying.
+ * * A concurrent writer may rotate the tree under the walk. A found node is
+ *   always right. A miss is retried if the tree has changed.
+ */
+struct ofs_inode *ofs_rbtree_lookup_rcu(struct ofs_rbtree *ofstree,
+					const oid_t target)
+{
+	struct rbtree_node *n;
+	struct ofs_inode *oitgt;
+	unsigned int seq, steps;
+	int ret;
+
+	do {
+		seq = read_seqcount_begin(&ofstree->seq);
+		n = ACCESS_ONCE(ofstree->tree.root);
+		for (steps = 0; n && steps < OFS_RBTREE_WALK_MAX; steps++) {
+			oitgt = rbtree_entry(n, struct ofs_inode, rbnode);
+			ret = ofs_compare_oid(target, ofs_get_oid(oitgt));
+			if (ret < 0)
+				n = ACCESS_ONCE(n->left);
+			else if (ret > 0)
+				n = ACCESS_ONCE(n->right);
+			else
+				return oitgt;
+		}
+	} while (read_seqcount_retry(&ofstree->seq, seq));
+	return NULL;
+}
+
 /**
  * @brief Decrease the reference count of a ofs_inode.
  * @param oitgt: ofs inode
@@ -147,8 +197,10 @@ bool ofs_rbtree_insert(struct ofs_rbtree *ofstree, struct ofs_inode *newoi)
 		}
 	}
 
+	write_seqcount_begin(&ofstree->seq);
 	rbtree_lpc(&newoi->rbnode, lpc);
 	rbtree_insert_color(&ofstree->tree, &newoi->rbnode);
+	write_seqcount_end(&ofstree->seq);
 	write_unlock(&ofstree->lock);
 
 	return true;
@@ -166,7 +218,9 @@ bool ofs_rbtree_insert(struct ofs_rbtree *ofstree, struct ofs_inode *newoi)
 void ofs_rbtree_remove(struct ofs_rbtree *ofstree, struct ofs_inode *oitgt)
 {
 	write_lock(&ofstree->lock);
+	write_seqcount_begin(&ofstree->seq);
 	rbtree_rm(&ofstree->tree, &oitgt->rbnode);
+	write_seqcount_end(&ofstree->seq);
 	write_unlock(&ofstree->lock);
 }
 
@@ -237,6 +291,33 @@ struct ofs_rbtree *ofs_get_rbtree_by_oid(const oid_t target)
  */
 struct ofs_root *ofs_register(char *magic)
 {
+	return ofs_register_opts(magic, NULL);
+}
+EXPORT_SYMBOL(ofs_register);
+
+/**
+ * @brief ofs magic api: Register a magic ofs with mount options.
+ * @param magic: unique magic string to identify the ofs.
+ * @param options: mount options string (such as "lazy,mode=0755"), or NULL.
+ * @return pointer (<b><em>struct ofs_root *</em></b>) that indicate the
+ *         magic ofs if successed.
+ * @retval pointer: (<b><em>struct ofs_root *</em></b>)
+ * @retval errno: Indicate the error code
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * The options are the same as the options of a user mount. With option
+ *   "lazy", magic nodes are kept as compact records, and their inodes and
+ *   dentries are materialized on demand.
+ * * If the magic ofs is already mounted, the options are ignored.
+ * @remark
+ * * The function can't be used in ISR (Interrupt Service Routine).
+ * @sa ofs_register()
+ * @sa ofs_unregister()
+ */
+struct ofs_root *ofs_register_opts(char *magic, char *options)
+{
+	struct ofs_kmount_data kd = {magic, options};
 	struct vfsmount *mnt;
 	struct ofs_root *root;
 	int rc;
@@ -252,8 +333,9 @@ struct ofs_root *ofs_register(char *magic)
 	}
 #endif
 
-	ofs_dbg("magic=\"%s\";\n", magic);
-	mnt = kern_mount_data(&ofs_fstype, magic);
+	ofs_dbg("magic=\"%s\"; options=\"%s\";\n", magic,
+		options ? options : "");
+	mnt = kern_mount_data(&ofs_fstype, &kd);
 	if (unlikely(IS_ERR(mnt))) {
 		ofs_dbg("kern_mount_data() failed! (errno:%ld)\n", (long)mnt);
 		rc = PTR_ERR(mnt);
@@ -287,6 +369,9 @@ struct ofs_root *ofs_register(char *magic)
 	root->magic_root.mnt = mnt;
 	root->magic_root.dentry = mnt->mnt_root;
 	root->is_registered = true;
+	spin_lock(&ofs_roots_lock);
+	list_add_tail(&root->node, &ofs_roots);
+	spin_unlock(&ofs_roots_lock);
 	up_write(&root->rwsem);
 	return root;
 
@@ -302,7 +387,7 @@ out_umount:
 out_return:
 	return ERR_PTR(rc);
 }
-EXPORT_SYMBOL(ofs_register);
+EXPORT_SYMBOL(ofs_register_opts);
 
 /**
  * @brief ofs magic api: Unregister a magic ofs.
@@ -334,6 +419,9 @@ int ofs_unregister(struct ofs_root *root)
 		return -EPERM;
 	}
 	root->is_registered = false;
+	spin_lock(&ofs_roots_lock);
+	list_del_init(&root->node);
+	spin_unlock(&ofs_roots_lock);
 	up_write(&root->rwsem);
 
 #ifdef CONFIG_OFS_DEBUGFS
@@ -514,6 +602,8 @@ struct ofs_inode *ofs_get_folder_hlp(struct ofs_root *root, oid_t folder,
 retry:
 	tree = ofs_get_rbtree_by_oid(folder);
 	oifdr = ofs_rbtree_lookup(tree, folder);
+	if (oifdr == NULL && root->lazy)
+		oifdr = ofs_lazy_get_oi(root, folder);
 	if (unlikely(oifdr == NULL)) {
 		ofs_dbg("Can't get folder {%p, %lu}.\n",
 			folder.i_sb, folder.i_ino);
@@ -541,19 +631,15 @@ retry:
 		pathfdr.dentry = dfdr;
 		/* TODO if the folder is a mountpoint */
 	} else if (S_ISLNK(ifdr->i_mode)) {
-		oid_t sl;
-		/* TODO symlink to other magic ofs */
-		if (unlikely(nd.depth >= MAX_NESTED_LINKS)) {
-			ofs_dbg("Too many symbolic links encountered!\n");
-			rc = -ELOOP;
+		/* A folder in another magic ofs is rejected below, because
+		   the caller locks only this one. */
+		rc = ofs_follow_link_magic(oifdr, &nd);
+		if (unlikely(rc)) {
+			ofs_dbg("Can't follow the symlink! (errno: %d)\n", rc);
 			goto out_oiput;
 		}
-		BUG_ON(!ofs_compare_oid(oifdr->symlink, OFS_NULL_OID));
-		ofs_nd_set_link(&nd, &oifdr->symlink);
-		sl = ofs_nd_get_link(&nd);
-		nd.depth++;
+		folder = ofs_nd_get_link(&nd);
 		ofs_rbtree_oiput(oifdr);
-		folder = sl;
 		goto retry;
 	} else {
 		rc = -ENOTDIR;
@@ -698,6 +784,8 @@ struct ofs_inode *ofs_get_oi_hlp(struct ofs_root *root, oid_t target,
 
 	tree = ofs_get_rbtree_by_oid(target);
 	oitgt = ofs_rbtree_lookup(tree, target);
+	if (oitgt == NULL && root->lazy)
+		oitgt = ofs_lazy_get_oi(root, target);
 	if (unlikely(oitgt == NULL)) {
 		ofs_dbg("Can't find ofs inode: {%p, %lu}.\n",
 			target.i_sb, target.i_ino);
@@ -730,6 +818,84 @@ out_exit:
 	return ERR_PTR(rc);;
 }
 
+/**
+ * @brief Find a registered magic ofs by its super block.
+ * @param sb: super block
+ * @param mnt: used to return the mount that pins the magic ofs
+ * @return the magic ofs
+ * @retval NULL: The super block isn't a registered magic ofs.
+ * @note
+ * * The super block is only compared, never accessed, so a stale pointer
+ *   in an oid is harmless.
+ * * Call mntput(*mnt) when finished.
+ */
+static
+struct ofs_root *ofs_get_root_by_sb(struct super_block *sb,
+				    struct vfsmount **mnt)
+{
+	struct ofs_root *root;
+
+	spin_lock(&ofs_roots_lock);
+	list_for_each_entry(root, &ofs_roots, node) {
+		if (root->sb == sb) {
+			*mnt = mntget(root->magic_root.mnt);
+			spin_unlock(&ofs_roots_lock);
+			return root;
+		}
+	}
+	spin_unlock(&ofs_roots_lock);
+	return NULL;
+}
+
+/**
+ * @brief helper function to get the path and ofs inode from an ofs inode
+ *        descriptor that may be in another registered magic ofs.
+ * @param root: magic ofs that has been registered
+ * @param target: ofs inode descriptor
+ * @param result: buffer to return the result
+ * @return the ofs inode, and the path
+ * @retval valid pointer to the ofs inode if OK
+ * @retval errno pointer: Indicate the error code
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * Call this function under locking <b><em>root->rwsem</em></b>.
+ * * The other magic ofs is found in the list of registered magic ofs and
+ *   pinned by its mount while looking up. Its rwsem is read-locked across
+ *   the lookup, as @ref ofs_get_oi_hlp() requires. It is only tried, so
+ *   there is no lock order between two magic ofs: only
+ *   @ref ofs_unregister() write-locks it, and then the other magic ofs is
+ *   going away.
+ * * The path is in the kernel mount of the magic ofs that owns the target.
+ *   Call @ref ofs_put_oi() later.
+ */
+static
+struct ofs_inode *ofs_get_oi_xroot_hlp(struct ofs_root *root, oid_t target,
+				       struct path *result)
+{
+	struct ofs_root *other;
+	struct ofs_inode *oitgt;
+	struct vfsmount *mnt;
+
+	if (target.i_sb == root->sb)
+		return ofs_get_oi_hlp(root, target, result);
+
+	other = ofs_get_root_by_sb(target.i_sb, &mnt);
+	if (unlikely(other == NULL)) {
+		ofs_dbg("{%p, %lu} is not in a registered magic ofs.\n",
+			target.i_sb, target.i_ino);
+		return ERR_PTR(-ENOENT);
+	}
+	oitgt = ERR_PTR(-ENOENT);
+	if (down_read_trylock(&other->rwsem)) {
+		if (likely(other->is_registered))
+			oitgt = ofs_get_oi_hlp(other, target, result);
+		up_read(&other->rwsem);
+	}
+	mntput(mnt);
+	return oitgt;
+}
+
 /**
  * @brief Get the path and ofs inode from the ofs inode descriptor.
  * @param root: magic ofs that has been registered
@@ -781,6 +947,318 @@ struct ofs_inode *ofs_get_oi(struct ofs_root *root, oid_t target,
 }
 EXPORT_SYMBOL(ofs_get_oi);
 
+/**
+ * @brief Fill the metadata of a magic ofs inode without lock.
+ * @param oi: ofs inode
+ * @param st: buffer to return the result
+ * @retval true: OK
+ * @retval false: The ofs inode isn't magic any more. (It is dying.)
+ * @note
+ * * Call this function under <b><em>rcu_read_lock()</em></b>. Dentries and
+ *   inodes of ofs are freed by RCU callback, so the pointers read here stay
+ *   valid without reference counting.
+ */
+bool ofs_fill_magic_stat(struct ofs_inode *oi, struct ofs_magic_stat *st)
+{
+	struct inode *inode = &oi->inode;
+	struct dentry *d, *dp;
+	struct inode *ip;
+
+	d = ACCESS_ONCE(oi->magic);
+	if (unlikely(d == NULL))
+		return false;
+	dp = ACCESS_ONCE(d->d_parent);
+	if (dp == d) {
+		st->parent = OFS_NULL_OID;
+	} else {
+		ip = ACCESS_ONCE(dp->d_inode);
+		if (unlikely(ip == NULL))
+			return false;
+		st->parent = (oid_t){ip->i_sb, ip->i_ino};
+	}
+	st->oid = ofs_get_oid(oi);
+	st->mode = inode->i_mode;
+	st->is_singularity = !!(ACCESS_ONCE(oi->state) & OI_SINGULARITY);
+	st->is_materialized = true;
+	st->size = i_size_read(inode);
+	st->mtime = inode->i_mtime;
+	st->nr_children = ofs_nr_children(oi);
+	return true;
+}
+
+/**
+ * @brief Get the metadata of a magic node without lock.
+ * @note
+ * * Call this function under <b><em>rcu_read_lock()</em></b>.
+ */
+static
+int ofs_stat_magic_rcu(struct ofs_root *root, oid_t target,
+		       struct ofs_magic_stat *st)
+{
+	struct ofs_inode *oitgt;
+
+	if (ofs_compare_oid(target, OFS_NULL_OID) == 0)
+		target = ofs_get_oid(root->rootoi);
+	if (unlikely(target.i_sb != root->sb))
+		return -EPERM;
+	oitgt = ofs_rbtree_lookup_rcu(ofs_get_rbtree_by_oid(target), target);
+	if (oitgt && oitgt->inode.i_sb == root->sb &&
+	    ofs_fill_magic_stat(oitgt, st))
+		return 0;
+	if (root->lazy)
+		return ofs_lazy_stat(root->lazy, target.i_ino, st);
+	return -ENOENT;
+}
+
+/**
+ * @brief ofs magic api: Get the metadata of a magic node without
+ *        reference counting.
+ * @param root: magic ofs that has been registered
+ * @param target: ofs inode descriptor. If OFS_NULL_OID, get the root
+ *                directory.
+ * @param st: buffer to return the result
+ * @retval 0: OK
+ * @retval errno: Indicate the error code
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * Unlike @ref ofs_get_oi(), the function takes neither the rwsem of the
+ *   root nor the refcount of the inode, the dentry and the mount. It reads
+ *   the node under <b><em>rcu_read_lock()</em></b> and writes no shared
+ *   cacheline, so it is cheap to poll many nodes.
+ * * The result is a snapshot and may be out of date when returned.
+ * * In a lazy magic ofs, a node without inode is read from its record
+ *   under the read-lock of the record index.
+ * @remark
+ * * The function can't be used in ISR (Interrupt Service Routine).
+ * @sa ofs_query_magic()
+ */
+int ofs_stat_magic(struct ofs_root *root, oid_t target,
+		   struct ofs_magic_stat *st)
+{
+	int rc;
+
+#ifdef CONFIG_OFS_CHKPARAM
+	if (unlikely(IS_ERR_OR_NULL(root))) {
+		ofs_err("Pointer root is invalid!\n");
+		return -EINVAL;
+	}
+	if (unlikely(IS_ERR_OR_NULL(st))) {
+		ofs_err("Pointer st is invalid!\n");
+		return -EINVAL;
+	}
+#endif
+
+	if (unlikely(!ACCESS_ONCE(root->is_registered)))
+		return -EPERM;
+	rcu_read_lock();
+	rc = ofs_stat_magic_rcu(root, target, st);
+	rcu_read_unlock();
+	return rc;
+}
+EXPORT_SYMBOL(ofs_stat_magic);
+
+/**
+ * @brief ofs magic api: Get the metadata of many magic nodes without
+ *        reference counting.
+ * @param root: magic ofs that has been registered
+ * @param targets: array of ofs inode descriptors
+ * @param st: array to return the results
+ * @param nr: number of elements of <b><em>targets</em></b> and
+ *            <b><em>st</em></b>
+ * @return number of nodes that are found
+ * @note
+ * * Same as @ref ofs_stat_magic(), but all nodes are read in one RCU
+ *   read-side critical section. The mode of a node that isn't found is 0.
+ * @remark
+ * * The function can't be used in ISR (Interrupt Service Routine).
+ * @sa ofs_stat_magic()
+ */
+unsigned int ofs_query_magic(struct ofs_root *root, const oid_t *targets,
+			     struct ofs_magic_stat *st, unsigned int nr)
+{
+	unsigned int i, found = 0;
+
+#ifdef CONFIG_OFS_CHKPARAM
+	if (unlikely(IS_ERR_OR_NULL(root))) {
+		ofs_err("Pointer root is invalid!\n");
+		return 0;
+	}
+	if (unlikely(IS_ERR_OR_NULL(targets) || IS_ERR_OR_NULL(st))) {
+		ofs_err("Pointer targets or st is invalid!\n");
+		return 0;
+	}
+#endif
+
+	if (unlikely(!ACCESS_ONCE(root->is_registered)))
+		return 0;
+	rcu_read_lock();
+	for (i = 0; i < nr; i++) {
+		if (ofs_stat_magic_rcu(root, targets[i], &st[i]) == 0)
+			found++;
+		else
+			st[i].mode = 0;
+	}
+	rcu_read_unlock();
+	return found;
+}
+EXPORT_SYMBOL(ofs_query_magic);
+
+/**
+ * @brief ofs magic api: Release a cursor of @ref ofs_for_each_child_magic().
+ * @param cursor: cursor
+ * @note
+ * * Call it if the enumeration is stopped by the callback and will not be
+ *   resumed. Nothing is done if the cursor is released.
+ * @remark
+ * * The function can't be used in ISR (Interrupt Service Routine).
+ */
+void ofs_release_cursor(struct ofs_cursor *cursor)
+{
+	if (cursor->dir) {
+		dput(cursor->dir);
+		cursor->dir = NULL;
+	}
+	kfree(cursor->batch);
+	cursor->batch = NULL;
+	cursor->pos = 0;
+	cursor->nr = cursor->next = 0;
+	cursor->dormant = false;
+	cursor->ino = 0;
+}
+EXPORT_SYMBOL(ofs_release_cursor);
+
+/**
+ * @brief ofs magic api: Enumerate the children of a magic folder.
+ * @param root: magic ofs that has been registered
+ * @param folder: ofs inode descriptor to the folder. (It is a singularity or
+ *                a magic directory.) If OFS_NULL_OID, use the default folder
+ *                (the root directory of this filesystem).
+ * @param cb: callback called for every child
+ * @param ctx: context passed to the callback
+ * @param cursor: cursor initialized by @ref OFS_CURSOR_INIT, or NULL
+ * @retval 0: All children are emitted. The cursor is released.
+ * @retval >0: The value returned by the callback that stops the
+ *             enumeration. Call the function with the same cursor to resume,
+ *             or call @ref ofs_release_cursor().
+ * @retval errno: Indicate the error code
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ *                The cursor is released.
+ * @note
+ * * Children are copied from the folder index in batches of
+ *   OFS_CHILDREN_BATCH without any lock of the folder, then the callback is
+ *   called for every child of the batch, so the callback may sleep. The
+ *   cursor keeps the folder and the index position between batches, as
+ *   readdir does.
+ * * In a lazy magic ofs, the children without inode are copied from their
+ *   records under the read-lock of the lazy index after the folder index is
+ *   exhausted. They are not materialized.
+ * * Children added, removed, materialized or de-materialized during the
+ *   enumeration may be missed.
+ * * Without <b><em>cursor</em></b>, the callback can't stop the enumeration
+ *   to resume it later. A positive value stops it and is returned.
+ * @remark
+ * * The function can't be used in ISR (Interrupt Service Routine).
+ */
+int ofs_for_each_child_magic(struct ofs_root *root, oid_t folder,
+			     ofs_child_cb_t cb, void *ctx,
+			     struct ofs_cursor *cursor)
+{
+	struct ofs_cursor tmp = OFS_CURSOR_INIT;
+	struct ofs_inode *oifdr;
+	struct path pathfdr;
+	struct dentry *dfdr;
+	int rc = 0;
+
+#ifdef CONFIG_OFS_CHKPARAM
+	if (unlikely(IS_ERR_OR_NULL(root))) {
+		ofs_err("Pointer root is invalid!\n");
+		return -EINVAL;
+	}
+	if (unlikely(cb == NULL)) {
+		ofs_err("Callback is NULL!\n");
+		return -EINVAL;
+	}
+#endif
+
+	if (cursor == NULL)
+		cursor = &tmp;
+	if (ofs_compare_oid(folder, OFS_NULL_OID) == 0)
+		folder = ofs_get_oid(root->rootoi);
+
+	/* all process under read-lock */
+	down_read(&root->rwsem);
+	if (unlikely(!root->is_registered)) {
+		ofs_err("Filesystem is not registered!\n");
+		rc = -EPERM;
+		goto out_up_read;
+	}
+
+	oifdr = ofs_get_folder_hlp(root, folder, &pathfdr);
+	if (unlikely(IS_ERR_OR_NULL(oifdr))) {
+		rc = PTR_ERR(oifdr);
+		ofs_dbg("Can't get the folder! (errno: %d)\n", rc);
+		goto out_up_read;
+	}
+	dfdr = pathfdr.dentry;
+
+	if (cursor->dir == NULL) {
+		cursor->batch = kmalloc(sizeof(struct ofs_child) *
+					OFS_CHILDREN_BATCH, GFP_KERNEL);
+		if (unlikely(cursor->batch == NULL)) {
+			rc = -ENOMEM;
+			goto out_put_folder;
+		}
+		cursor->dir = dget(dfdr);
+		cursor->pos = OFS_DINDEX_FIRST_POS;
+		cursor->nr = cursor->next = 0;
+		cursor->dormant = false;
+		cursor->ino = 0;
+	} else if (unlikely(cursor->dir != dfdr)) {
+		ofs_err("The cursor isn't in the folder!\n");
+		rc = -EINVAL;
+		goto out_put_folder;
+	}
+	/* The callback may call magic apis. */
+	up_read(&root->rwsem);
+
+	for (;;) {
+		if (cursor->next == cursor->nr && !cursor->dormant) {
+			cursor->nr = ofs_dindex_copy_children(dfdr,
+							      &cursor->pos,
+							      cursor->batch,
+							      OFS_CHILDREN_BATCH);
+			cursor->next = 0;
+			cursor->dormant = cursor->nr == 0;
+		}
+		if (cursor->next == cursor->nr && cursor->dormant) {
+			cursor->nr = ofs_lazy_copy_dormant(dfdr->d_inode,
+							   &cursor->ino,
+							   cursor->batch,
+							   OFS_CHILDREN_BATCH);
+			cursor->next = 0;
+			if (cursor->nr == 0)
+				break;
+		}
+		rc = cb(ctx, &cursor->batch[cursor->next++]);
+		if (rc)
+			break;
+	}
+	ofs_put_folder(oifdr, &pathfdr);
+	if (rc <= 0 || cursor == &tmp)
+		ofs_release_cursor(cursor);
+	return rc;
+
+out_put_folder:
+	ofs_put_folder(oifdr, &pathfdr);
+	ofs_release_cursor(cursor);
+out_up_read:
+	up_read(&root->rwsem);
+	return rc;
+}
+EXPORT_SYMBOL(ofs_for_each_child_magic);
+
 /**
  * @brief get the path and ofs inode of parent from a child oid.
  * @param root: magic ofs that has been registered
@@ -1043,6 +1521,13 @@ int ofs_mkdir_magic(struct ofs_root *root, const char *name, umode_t mode,
 		goto out_up_read;
 	}
 
+	if (root->lazy) {
+		rc = ofs_lazy_create(root, folder, name,
+				     S_IFDIR | (mode & (S_IRWXUGO | S_ISVTX)),
+				     false, result);
+		goto out_up_read;
+	}
+
 	/* find the folder */
 	oifdr = ofs_get_folder_hlp(root, folder, &pathfdr);
 	if (unlikely(IS_ERR_OR_NULL(oifdr))) {
@@ -1221,6 +1706,37 @@ size_t ofs_compute_path(struct ofs_root *root, struct dentry *src,
 	return sz;
 }
 
+/**
+ * @brief compute the string of a symlink to another magic ofs
+ * @param dst: magic dentry of the target
+ * @param buf: buffer to accept the string
+ * @param len: buffer size
+ * @return the size (exclude '\0')
+ * @retval >0: OK
+ * @retval errno: Indicate the error code
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * The string is "ofs:<magic>:<path in the magic ofs>". It is only
+ *   returned by readlink. Path walking follows the oid.
+ */
+static
+int ofs_compute_xroot_path(struct dentry *dst, char *buf, int len)
+{
+	struct ofs_root *other = dst->d_sb->s_fs_info;
+	char *p;
+	int n;
+
+	n = snprintf(buf, len, "ofs:%s:", other->magic);
+	if (unlikely(n >= len))
+		return -ENOBUFS;
+	p = dentry_path_raw(dst, buf + n, len - n);
+	if (IS_ERR(p))
+		return PTR_ERR(p);
+	memmove(buf + n, p, strlen(p) + 1);
+	return strlen(buf);
+}
+
 static
 int ofs_symlink_magic_hlp(struct ofs_root *root, struct ofs_inode *oifdr,
 			  struct path *pathfdr, oid_t target,
@@ -1251,8 +1767,8 @@ int ofs_symlink_magic_hlp(struct ofs_root *root, struct ofs_inode *oifdr,
 		goto out_return;
 	}
 
-	/* find the target */
-	oitgt = ofs_get_oi_hlp(root, target, &pathtgt);
+	/* find the target (maybe in another magic ofs) */
+	oitgt = ofs_get_oi_xroot_hlp(root, target, &pathtgt);
 	if (unlikely(IS_ERR_OR_NULL(oitgt))) {
 		rc = PTR_ERR(oitgt);
 		ofs_dbg("Can't get oid! (errno: %d)\n", rc);
@@ -1284,7 +1800,11 @@ int ofs_symlink_magic_hlp(struct ofs_root *root, struct ofs_inode *oifdr,
 	}
 
 	/* compute the path string between two dentrys */
-	rc = ofs_compute_path(root, newd, pathtgt.dentry, slbuf, PATH_MAX);
+	if (pathtgt.dentry->d_sb == root->sb)
+		rc = ofs_compute_path(root, newd, pathtgt.dentry, slbuf,
+				      PATH_MAX);
+	else
+		rc = ofs_compute_xroot_path(pathtgt.dentry, slbuf, PATH_MAX);
 	if (unlikely(rc <= 0)) {
 		ofs_dbg("Failed to compute path! (errno: %d)\n", rc);
 		goto out_put_newd;
@@ -1312,11 +1832,12 @@ int ofs_symlink_magic_hlp(struct ofs_root *root, struct ofs_inode *oifdr,
 	/* add to rbtree */
 	newi = newd->d_inode;
 	newoi = OFS_INODE(newi);
+	newoi->symlink = target; /* before being magic for follow_link */
+	smp_wmb();
 	spin_lock(&newi->i_lock);
 	newoi->magic = newd;
 	newoi->state |= OI_MAGIC;
 	spin_unlock(&newi->i_lock);
-	newoi->symlink = target;
 	rbtree = ofs_get_rbtree(newoi);
 	ofs_rbtree_insert(rbtree, newoi);
 	*result = ofs_get_oid(newoi);
@@ -1520,6 +2041,180 @@ EXPORT_SYMBOL(ofs_symlink_magic);
 /* } */
 /* EXPORT_SYMBOL(ofs_symlink_magic_pn); */
 
+static
+int ofs_link_magic_hlp(struct ofs_inode *oitgt, struct path *pathtgt,
+		       struct ofs_inode *oifdr, struct path *pathfdr,
+		       const char *name)
+{
+	struct inode *idelegated;
+	struct dentry *dfdr = pathfdr->dentry, *dtgt = pathtgt->dentry, *newd;
+	struct inode *ifdr = &oifdr->inode, *itgt = &oitgt->inode;
+	size_t nlen = strlen(name);
+	int rc;
+
+	if (unlikely(nlen > NAME_MAX))
+		return -ENAMETOOLONG;
+	if (unlikely(nlen == 0))
+		return -EINVAL;
+	if (S_ISDIR(itgt->i_mode)) {
+		ofs_dbg("Can't link a directory.\n");
+		return -EPERM;
+	}
+
+	rc = mnt_want_write(pathfdr->mnt);
+	if (unlikely(rc)) {
+		ofs_dbg("Failed to mnt_want_write()! (errno: %d)\n", rc);
+		goto out_return;
+	}
+
+retry_deleg:
+	mutex_lock_nested(&ifdr->i_mutex, I_MUTEX_PARENT);
+	if (dfdr->d_inode != ifdr) { /* d_is_negative(dfdr) */
+		ofs_dbg("The folder is death!\n");
+		rc = -EOWNERDEAD;
+		goto out_mutex_unlock;
+	}
+	if (dtgt->d_inode != itgt) { /* d_is_negative(dtgt) */
+		ofs_dbg("The target is dead!\n");
+		rc = -ENOENT;
+		goto out_mutex_unlock;
+	}
+
+	/* Find the new dentry */
+	newd = lookup_one_len(name, dfdr, nlen); /* dget() the newd. */
+	if (unlikely(IS_ERR_OR_NULL(newd))) {
+		if (newd == NULL)
+			rc = -ENOENT;
+		else
+			rc = PTR_ERR(newd);
+		ofs_dbg("Failed to lookup_one_len()! (errno: %d)\n", rc);
+		goto out_mutex_unlock;
+	}
+	if (d_is_positive(newd)) {
+		rc = -EEXIST;
+		goto out_put_newd;
+	}
+
+	rc = security_path_link(dtgt, pathfdr, newd);
+	if (rc) {
+		ofs_dbg("Failed in security_path_link() (errno:%d)\n", rc);
+		goto out_put_newd;
+	}
+
+	/* link */
+	idelegated = NULL;
+	oifdr->state |= OI_LINKING_MAGIC_CHILD;
+	barrier(); /* To prevent compiler from optimizing. */
+	/* Call vfs_*** to support fsnotify & security hooks */
+	rc = vfs_link(dtgt, ifdr, newd, &idelegated); /* dget() the newd. */
+	oifdr->state &= ~OI_LINKING_MAGIC_CHILD;
+	if (idelegated) {
+		dput(newd);
+		mutex_unlock(&ifdr->i_mutex);
+		rc = break_deleg_wait(&idelegated);
+		if (rc) {
+			ofs_dbg("Failed to break_deleg_wait(). errno:%d\n", rc);
+			goto out_mnt_drop_write;
+		}
+		goto retry_deleg;
+	}
+	if (unlikely(rc))
+		ofs_dbg("Failed to vfs_link()! (errno: %d)\n", rc);
+
+out_put_newd:
+	dput(newd); /* dget() the newd twice in total, so dput() it once. */
+out_mutex_unlock:
+	mutex_unlock(&ifdr->i_mutex);
+out_mnt_drop_write:
+	mnt_drop_write(pathfdr->mnt);
+out_return:
+	return rc;
+}
+
+/**
+ * @brief ofs magic api: Make a hard link to a magic regfile or singularity
+ *        in a magic ofs that has been registered.
+ * @param root: magic ofs that has been registered
+ * @param target: ofs inode descriptor of the magic regfile or singularity
+ * @param folder: ofs inode descriptor to the folder. (It is a singularity or
+ *                a magic directory.) If OFS_NULL_OID, use the default folder
+ *                (the root directory of this filesystem).
+ * @param name: name of the hard link
+ * @retval 0: OK
+ * @retval errno: Indicate the error code
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * The hard link is a normal dentry of the magic ofs inode. Unlike a magic
+ *   symlink, it needs neither a path string nor a page, and path walking
+ *   reaches the inode directly.
+ * * A hard link of a singularity is a regfile (DCACHE_FILE_TYPE).
+ * * The hard link can be removed by syscall unlink(). While it exists, the
+ *   magic dentry of the target can't be dropped by @ref ofs_rm_singularity().
+ * * Support security_hooks.
+ * * Support fsnotify.
+ * @remark
+ * * The function can't be used in ISR (Interrupt Service Routine).
+ */
+int ofs_link_magic(struct ofs_root *root, oid_t target, oid_t folder,
+		   const char *name)
+{
+	struct ofs_inode *oitgt, *oifdr;
+	struct path pathtgt, pathfdr;
+	int rc = 0;
+
+#ifdef CONFIG_OFS_CHKPARAM
+	if (unlikely(IS_ERR_OR_NULL(name))) {
+		ofs_err("Pointer name is invalid!\n");
+		return -EINVAL;
+	}
+	if (unlikely(IS_ERR_OR_NULL(root))) {
+		ofs_err("Pointer root is invalid!\n");
+		return -EINVAL;
+	}
+	if (ofs_compare_oid(target, OFS_NULL_OID) == 0) {
+		ofs_err("Can't link root directory.");
+		return -EPERM;
+	}
+#endif
+
+	if (ofs_compare_oid(folder, OFS_NULL_OID) == 0)
+		folder = ofs_get_oid(root->rootoi);
+
+	/* all process under read-lock */
+	down_read(&root->rwsem);
+	if (unlikely(!root->is_registered)) {
+		ofs_err("Filesystem is not registered!\n");
+		rc = -EPERM;
+		goto out_up_read;
+	}
+
+	oitgt = ofs_get_oi_hlp(root, target, &pathtgt);
+	if (unlikely(IS_ERR_OR_NULL(oitgt))) {
+		rc = PTR_ERR(oitgt);
+		ofs_dbg("Can't get the target! (errno: %d)\n", rc);
+		goto out_up_read;
+	}
+
+	/* find the folder */
+	oifdr = ofs_get_folder_hlp(root, folder, &pathfdr);
+	if (unlikely(IS_ERR_OR_NULL(oifdr))) {
+		rc = PTR_ERR(oifdr);
+		ofs_dbg("Can't get the folder! (errno: %d)\n", rc);
+		goto out_put_oi;
+	}
+
+	rc = ofs_link_magic_hlp(oitgt, &pathtgt, oifdr, &pathfdr, name);
+	ofs_put_folder(oifdr, &pathfdr);
+
+out_put_oi:
+	ofs_put_oi(oitgt, &pathtgt);
+out_up_read:
+	up_read(&root->rwsem);
+	return rc;
+}
+EXPORT_SYMBOL(ofs_link_magic);
+
 static
 int ofs_create_magic_hlp(struct ofs_inode *oifdr, struct path *pathfdr,
 			 const char *name, umode_t mode, bool is_singularity,
@@ -1658,6 +2353,13 @@ int ofs_create_magic(struct ofs_root *root, const char *name, umode_t mode,
 		goto out_up_read;
 	}
 
+	if (root->lazy) {
+		rc = ofs_lazy_create(root, folder, name,
+				     S_IFREG | (mode & S_IALLUGO),
+				     is_singularity, result);
+		goto out_up_read;
+	}
+
 	/* find the folder */
 	oifdr = ofs_get_folder_hlp(root, folder, &pathfdr);
 	if (unlikely(IS_ERR_OR_NULL(oifdr))) {
@@ -2148,7 +2850,7 @@ retry_deleg:
 		ofs_err("The singularity has other hard link.\n");
 		goto out_mutex_unlock_target;
 	}
-	if (!simple_empty(dtgt)) {
+	if (!ofs_folder_empty(itgt) || !ofs_lazy_empty(oitgt)) {
 		rc = -ENOTEMPTY;
 		ofs_err("The singularity has child.\n");
 		goto out_mutex_unlock_target;
@@ -2289,7 +2991,16 @@ int ofs_rm_recursively_hlp(struct ofs_inode *oitgt, struct path *pathtgt,
 			return ofs_unlink_normal_hlp(oip, pathp, dtgt);
 	}
 
-	rc = 0;
+again:
+	/* Children only in the records of a lazy magic ofs are not in
+	   the dcache. */
+	rc = ofs_lazy_materialize_children(dtgt);
+	if (rc)
+		return rc;
+	/* Don't walk d_subdirs of an empty folder. It may be full of
+	   negative dentries. */
+	if (ofs_folder_empty(itgt))
+		goto out_rm;
 	spin_lock(&dtgt->d_lock);
 	next = dtgt->d_subdirs.next;
 	/* Don't use list_for_each_entry, because it need change `next' at
@@ -2317,7 +3028,11 @@ int ofs_rm_recursively_hlp(struct ofs_inode *oitgt, struct path *pathtgt,
 		}
 	}
 	spin_unlock(&dtgt->d_lock);
+	/* A child may be de-materialized during walking. */
+	if (!rc && !ofs_lazy_empty(oitgt))
+		goto again;
 
+out_rm:
 	if (!rc) {
 		if (oitgt->magic) {
 			if (S_ISDIR(itgt->i_mode))
@@ -2426,7 +3141,7 @@ int ofs_rename_magic_hlp(struct ofs_inode *oitgt, struct path *pathtgt,
 		return -EINVAL;
 	if (flags & ~(RENAME_NOREPLACE | RENAME_EXCHANGE))
 		return -EINVAL;
-	if (flags & (RENAME_NOREPLACE | RENAME_EXCHANGE))
+	if ((flags & RENAME_NOREPLACE) && (flags & RENAME_EXCHANGE))
 		return -EINVAL;
 
 	rc = mnt_want_write(pathp->mnt);
@@ -2479,6 +3194,11 @@ retry_deleg:
 			goto out_put_newd;
 		}
 	}
+	if (newd == dtgt) {
+		/* Rename to itself. */
+		rc = (flags & RENAME_NOREPLACE) ? -EEXIST : 0;
+		goto out_put_newd;
+	}
 	if ((dtgt == trap) || (newd == trap)) {
 		ofs_dbg("Source and target should not be ancestor "
 			"of each other.\n");
@@ -2493,14 +3213,16 @@ retry_deleg:
 	}
 
 	idelegated = NULL;
+	/* Both parents are locked by lock_rename(). With RENAME_EXCHANGE,
+	   the child of the new folder is moved into the parent too. */
 	oip->state |= OI_RENAMING_MAGIC_CHILD;
+	if (flags & RENAME_EXCHANGE)
+		oinewfdr->state |= OI_RENAMING_MAGIC_CHILD;
 	barrier(); /* To prevent compiler from optimizing. */
 	rc = vfs_rename(ip, dtgt, inewfdr, newd, &idelegated, flags);
-	if (rc) {
-		ofs_dbg("Failed to vfs_rename()! (errno:%d)\n", rc);
-		goto out_put_newd;
-	}
+	barrier(); /* To prevent compiler from optimizing. */
 	oip->state &= ~OI_RENAMING_MAGIC_CHILD;
+	oinewfdr->state &= ~OI_RENAMING_MAGIC_CHILD;
 	if (idelegated) {
 		dput(newd);
 		unlock_rename(dnewfdr, dp);
@@ -2512,6 +3234,8 @@ retry_deleg:
 		}
 		goto retry_deleg;
 	}
+	if (rc)
+		ofs_dbg("Failed to vfs_rename()! (errno:%d)\n", rc);
 
 out_put_newd:
 	dput(newd);
@@ -2523,6 +3247,33 @@ out_return:
 	return rc;
 }
 
+/**
+ * @brief ofs magic api: Rename (move) a magic ofs inode in a magic ofs that
+ *        has been registered.
+ * @param root: magic ofs that has been registered
+ * @param target: ofs inode descriptor of the node to rename
+ * @param newfdr: ofs inode descriptor to the new folder. (It is a singularity
+ *                or a magic directory.) If OFS_NULL_OID, use the default
+ *                folder (the root directory of this filesystem).
+ * @param newname: new name
+ * @param flags: 0, RENAME_NOREPLACE or RENAME_EXCHANGE
+ * @retval 0: OK
+ * @retval errno: Indicate the error code
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * RENAME_NOREPLACE: fail with -EEXIST if the new name exists.
+ * * RENAME_EXCHANGE: atomically swap the target and the node named
+ *   <b><em>newname</em></b> in <b><em>newfdr</em></b>. The node must exist.
+ *   It may be a magic ofs inode too, and it is moved into the parent of
+ *   the target.
+ * * Without flags, the node named <b><em>newname</em></b> is replaced if it
+ *   is not a magic ofs inode.
+ * * Support security_hooks.
+ * * Support fsnotify.
+ * @remark
+ * * The function can't be used in ISR (Interrupt Service Routine).
+ */
 int ofs_rename_magic(struct ofs_root *root, oid_t target, oid_t newfdr,
 		     const char *newname, unsigned int flags)
 {
@@ -2590,6 +3341,7 @@ out_up_read:
 	up_read(&root->rwsem);
 	return rc;
 }
+EXPORT_SYMBOL(ofs_rename_magic);
 
 /**
  * @brief ofs magic api: Change the operations of a magic ofs inode.
@@ -2626,15 +3378,132 @@ int ofs_set_operations(struct ofs_inode *oitgt,
 EXPORT_SYMBOL(ofs_set_operations);
 
 /******** ofs namespace ********/
+/**
+ * @brief ofs magic api: Follow a magic symlink when walking in kernel.
+ * @param oi: ofs inode of the magic symlink
+ * @param nd: namespace data. Set nd->depth to 0 before the first follow.
+ * @retval 0: OK. Get the target by @ref ofs_nd_get_link().
+ * @retval errno: Indicate the error code
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * The target is the oid stored in the symlink. No path string is parsed.
+ * * -ELOOP is returned if more than MAX_NESTED_LINKS symlinks are followed.
+ * * Hold <b><em>oi</em></b> until the target is got.
+ * @sa ofs_put_link_magic()
+ */
 int ofs_follow_link_magic(struct ofs_inode *oi, struct ofs_nameidata *nd)
 {
-	/* TODO */
-	return -ENOSYS;
+#ifdef CONFIG_OFS_CHKPARAM
+	if (unlikely(IS_ERR_OR_NULL(oi) || IS_ERR_OR_NULL(nd))) {
+		ofs_err("Pointer oi or nd is invalid!\n");
+		return -EINVAL;
+	}
+#endif
+
+	if (unlikely(!S_ISLNK(oi->inode.i_mode) || !oi->magic))
+		return -EINVAL;
+	if (unlikely(ofs_compare_oid(oi->symlink, OFS_NULL_OID) == 0))
+		return -ENOENT;
+	if (unlikely(nd->depth >= MAX_NESTED_LINKS)) {
+		ofs_dbg("Too many symbolic links encountered!\n");
+		return -ELOOP;
+	}
+	ofs_nd_set_link(nd, &oi->symlink);
+	nd->depth++;
+	return 0;
 }
 EXPORT_SYMBOL(ofs_follow_link_magic);
 
+/**
+ * @brief ofs magic api: Step back over a magic symlink followed by
+ *        @ref ofs_follow_link_magic().
+ * @param oi: ofs inode of the magic symlink
+ * @param nd: namespace data
+ */
 void ofs_put_link_magic(struct ofs_inode *oi, struct ofs_nameidata *nd)
 {
-	/* TODO */
+	if (nd->depth) {
+		nd->depth--;
+		nd->saved_links[nd->depth] = NULL;
+	}
 }
 EXPORT_SYMBOL(ofs_put_link_magic);
+
+/**
+ * @brief Get the path of the target of a magic symlink by its oid.
+ * @param dentry: magic dentry of the symlink
+ * @param mnt: mount where the symlink is walked
+ * @param result: buffer to return the path
+ * @retval 0: OK
+ * @retval -EAGAIN: The oid can't be used. Follow the path string instead.
+ * @retval errno: Indicate the error code
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * Called by inode operation follow_link of symlink. The target is looked
+ *   up in the index, instead of parsing the relative path string.
+ * * If the target is a magic symlink too, it is followed in the same way.
+ *   -ELOOP is returned after MAX_NESTED_LINKS symlinks.
+ * * The result is in <b><em>mnt</em></b>, so the walk never leaves the
+ *   mount. If the target is in another magic ofs, or out of the subtree
+ *   of <b><em>mnt</em></b> (a bind mount), -EAGAIN is returned: the kernel
+ *   mount of a magic ofs must not be exposed to the walk, and the
+ *   permission of the ancestors of the target must be checked by walking
+ *   the path string. Only the walks of magic apis cross magic ofs.
+ */
+int ofs_get_symlink_target(struct dentry *dentry, struct vfsmount *mnt,
+			   struct path *result)
+{
+	struct ofs_root *root = dentry->d_sb->s_fs_info;
+	struct ofs_inode *oi = OFS_INODE(dentry->d_inode);
+	struct ofs_inode *oitgt;
+	struct ofs_nameidata nd;
+	oid_t target;
+	int rc;
+
+	if (unlikely(mnt == NULL || mnt->mnt_sb != dentry->d_sb))
+		return -EAGAIN;
+	nd.depth = 0;
+	rc = ofs_follow_link_magic(oi, &nd);
+	if (unlikely(rc))
+		return -EAGAIN;
+	target = ofs_nd_get_link(&nd);
+
+	down_read(&root->rwsem);
+	if (unlikely(!root->is_registered)) {
+		rc = -EAGAIN;
+		goto out_up_read;
+	}
+	for (;;) {
+		if (target.i_sb != root->sb) {
+			rc = -EAGAIN; /* never jump into another magic ofs */
+			goto out_up_read;
+		}
+		oitgt = ofs_get_oi_hlp(root, target, result);
+		if (unlikely(IS_ERR_OR_NULL(oitgt))) {
+			rc = PTR_ERR(oitgt);
+			goto out_up_read;
+		}
+		if (!S_ISLNK(oitgt->inode.i_mode))
+			break;
+		/* The path holds oitgt until the next target is got. */
+		rc = ofs_follow_link_magic(oitgt, &nd);
+		if (likely(!rc))
+			target = ofs_nd_get_link(&nd);
+		ofs_put_oi(oitgt, result);
+		if (unlikely(rc))
+			goto out_up_read;
+	}
+	if (!is_subdir(result->dentry, mnt->mnt_root)) {
+		ofs_put_oi(oitgt, result);
+		rc = -EAGAIN;
+		goto out_up_read;
+	}
+	mntput(result->mnt);
+	result->mnt = mntget(mnt);
+
+out_up_read:
+	up_read(&root->rwsem);
+	return rc;
+}
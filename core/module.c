@@ -121,6 +121,7 @@ int ofs_init(void)
 	for (rc = 0; rc < size; rc++) {
 		rbtree_init(&ofs_rbtrees[rc].tree);
 		rwlock_init(&ofs_rbtrees[rc].lock);
+		seqcount_init(&ofs_rbtrees[rc].seq);
 	}
 
 	rc = register_filesystem(&ofs_fstype);
@@ -32,6 +32,10 @@
 #include <linux/limits.h>
 #include <linux/spinlock.h>
 #include <linux/rwsem.h>
+#include <linux/seqlock.h>
+#include <linux/atomic.h>
+#include <linux/percpu_counter.h>
+#include <linux/radix-tree.h>
 #include "rbtree.h"
 
 /******** ******** ******** ******** ******** ******** ******** ********
@@ -61,6 +65,7 @@
 
 #define OI_SINGULARITY			(1U << 8)
 #define OI_MAGIC			(1U << 9)
+#define OI_ACCOUNTED			(1U << 10)
 /**
  * @brief Get the pointer of struct ofs_inode where the inode locates at.
  * @param i: Pointer of inode
@@ -69,9 +74,30 @@
 
 #define FILE_TO_OFS_INODE(f)	OFS_INODE((f)->f_path.dentry->d_inode)
 
+/**
+ * @brief Test whether reads and writes of a file must not sleep: the file
+ *        is opened with O_NONBLOCK in an ofs mounted with option "nowait".
+ * @param f: Pointer of file
+ */
+#define OFS_FILE_NOWAIT(f)						\
+	(((f)->f_flags & O_NONBLOCK) &&					\
+	 ACCESS_ONCE(((struct ofs_root *)				\
+		      file_inode(f)->i_sb->s_fs_info)->mo.nowait))
+
 /******** ******** ******** ******** ******** ******** ******** ********
  ******** ******** ********       types       ******** ******** ********
  ******** ******** ******** ******** ******** ******** ******** ********/
+/**
+ * @brief policy of option "huge"
+ */
+enum ofs_huge {
+	OFS_HUGE_NEVER,		/**< never use huge extents */
+	OFS_HUGE_ALWAYS,	/**< always use huge extents */
+	OFS_HUGE_WITHIN_SIZE,	/**< only if the extent is within i_size */
+	OFS_HUGE_ADVISE,	/**< only in mappings of madvise(MADV_HUGEPAGE)
+				 */
+};
+
 /**
  * @brief Mount options
  */
@@ -88,10 +114,48 @@ struct ofs_mount_opts {
 	bool is_magic;	/**< If the ofs is magic, marks true,
 			  *  otherwise marks false
 			  */
+	bool is_lazy;	/**< If the magic nodes are materialized
+			  *  lazily, marks true, otherwise marks
+			  *  false
+			  */
+	unsigned long negdcache;	/**< Bytes of negative dentries
+					  *  that may be kept in the dcache
+					  *  after their last reference
+					  *  drops. 0 means none.
+					  */
+	int huge;	/**< policy of huge extents of file data
+			  *  (<b><em>enum @ref ofs_huge</em></b>)
+			  */
+	unsigned long max_blocks;	/**< max number of pages of file
+					  *  data. 0 means unlimited.
+					  */
+	unsigned long max_inodes;	/**< max number of inodes. 0 means
+					  *  unlimited.
+					  */
+	bool is_swap;	/**< If the data of regular files is
+			  *  swap-backed, marks true, otherwise
+			  *  marks false
+			  */
+	unsigned int compress;	/**< Seconds that a page of a regular
+				  *  file must stay unaccessed before it
+				  *  is compressed. 0 means never.
+				  */
+	bool dedup;	/**< If identical cold pages share one
+			  *  compressed page, marks true, otherwise
+			  *  marks false
+			  */
+	bool nowait;	/**< If reads and writes of files opened with
+			  *  O_NONBLOCK never sleep, marks true,
+			  *  otherwise marks false
+			  */
 };
 
 struct rbtree;
 struct rbtree_node;
+struct ofs_record;
+struct ofs_lazy;
+struct ofs_dindex;
+struct ofs_zstore;
 
 /**
  * @brief red-black tree
@@ -99,6 +163,9 @@ struct rbtree_node;
 struct ofs_rbtree {
 	struct rbtree tree;	/**< rbtree */
 	rwlock_t lock;		/**< read-write spinlock */
+	seqcount_t seq;		/**< changed by writers under the lock, lets
+				 *   readers walk the tree under RCU
+				 */
 };
 
 /**
@@ -132,13 +199,124 @@ struct ofs_inode {
 		void *priv;		/**< private data */
 		oid_t symlink;		/**< target of magic symlink */
 	};
+	struct ofs_record *rec;		/**< record in a lazy magic ofs */
+	char *link;			/**< target string of a fast symlink
+					 *   (freed after a RCU grace period)
+					 */
+	struct ofs_dindex *dindex;	/**< ordered index of children of a
+					 *   directory or a singularity (NULL
+					 *   until the first child is linked)
+					 */
+	unsigned long nr_children;	/**< number of positive child dentries
+					 *   Protected by dindex->lock.
+					 */
+	unsigned long nr_dormant;	/**< number of child records without
+					 *   inode in a lazy magic ofs.
+					 *   Protected by lazy->lock.
+					 */
+	atomic_t nr_opened;		/**< number of opened files of a
+					 *   folder. Its children are not
+					 *   de-materialized while it is
+					 *   opened, so readdir positions stay
+					 *   valid.
+					 */
+	struct file *swap;		/**< internal shmem file that holds the
+					 *   data of a regfile if the ofs is
+					 *   mounted with option "swap"
+					 */
+	unsigned long swap_pages;	/**< pages of the shmem file charged
+					 *   to option "size"
+					 *   Protected by inode.i_mutex.
+					 */
+	struct radix_tree_root zpages;	/**< compressed pages that left the
+					 *   page cache (see option
+					 *   "compress")
+					 */
+	spinlock_t zlock;		/**< protects zpages */
 };
 
 struct ofs_file {
-	struct dentry *cursor;
 	void *priv;
 };
 
+/**
+ * @brief metadata of a magic node returned by @ref ofs_stat_magic()
+ * @note
+ * * It is a snapshot read without locks. Fields may come from different
+ *   moments if the node is changing.
+ */
+struct ofs_magic_stat {
+	oid_t oid;			/**< ofs inode descriptor */
+	oid_t parent;			/**< ofs inode descriptor of parent
+					 *   (OFS_NULL_OID for the root)
+					 */
+	umode_t mode;			/**< type and authority
+					 *   (0 if the node isn't found)
+					 */
+	bool is_singularity;		/**< Is a singularity ? */
+	bool is_materialized;		/**< Has an inode in memory ? (It is
+					 *   false only in a lazy magic ofs.)
+					 */
+	loff_t size;			/**< size of a regfile or singularity */
+	struct timespec mtime;		/**< last modification time */
+	unsigned long nr_children;	/**< number of children of a directory
+					 *   or a singularity
+					 */
+};
+
+/**
+ * @brief a child copied by @ref ofs_for_each_child_magic()
+ */
+struct ofs_child {
+	oid_t oid;			/**< ofs inode descriptor */
+	umode_t mode;			/**< type and authority */
+	unsigned int len;		/**< length of name */
+	char name[NAME_MAX + 1];	/**< name (end with '\0') */
+};
+
+/**
+ * @brief callback of @ref ofs_for_each_child_magic()
+ * @param ctx: context from the caller
+ * @param child: the child. It is valid only during the callback.
+ * @retval 0: go on
+ * @retval >0: stop, and resume later with the cursor
+ * @retval <0: abort with an error code
+ */
+typedef int (*ofs_child_cb_t)(void *ctx, const struct ofs_child *child);
+
+/**
+ * @brief cursor of @ref ofs_for_each_child_magic()
+ * @note
+ * * Initialize it with @ref OFS_CURSOR_INIT. All fields are private.
+ */
+struct ofs_cursor {
+	struct dentry *dir;		/**< the folder with a reference */
+	struct ofs_child *batch;	/**< children copied by last batch */
+	loff_t pos;			/**< position of the next batch in the
+					 *   folder index
+					 */
+	unsigned int nr;		/**< number of children in batch */
+	unsigned int next;		/**< next child to emit in batch */
+	bool dormant;			/**< The folder index is exhausted, and
+					 *   the children without inode are
+					 *   copied from their records.
+					 */
+	ino_t ino;			/**< ino of the last copied record */
+};
+
+/**
+ * @brief initializer of struct ofs_cursor
+ */
+#define OFS_CURSOR_INIT		((struct ofs_cursor){ \
+					.dir = NULL, \
+					.batch = NULL, \
+					.pos = 0, \
+					.nr = 0, \
+					.next = 0, \
+					.dormant = false, \
+					.ino = 0, \
+				})
+
 /**
  * @brief ofs namespace data when walking path in kernel.
  */
@@ -179,6 +357,27 @@ struct ofs_root {
 					  *  root path of the filesystem
 					  *  in kernel.
 					  */
+	struct ofs_lazy *lazy;		/**< record index if the magic ofs
+					  *  is mounted with option "lazy"
+					  */
+	struct list_head node;		/**< link in the list of registered
+					  *  magic ofs
+					  */
+	atomic_long_t nr_negd;		/**< number of negative dentries
+					  *  kept by option "negdcache"
+					  */
+	struct percpu_counter negd_hits;	/**< lookups answered by a
+						  *  kept negative dentry
+						  */
+	struct percpu_counter negd_misses;	/**< lookups that found
+						  *  nothing in the folder
+						  */
+	struct percpu_counter used_blocks;	/**< pages of file data */
+	struct percpu_counter used_inodes;	/**< inodes */
+	struct ofs_zstore *zs;		/**< compressed store of option
+					  *  "compress" (NULL until the option
+					  *  is set for the first time)
+					  */
 #ifdef CONFIG_OFS_SYSFS
 	struct omobject *omobj;		/**< magic mount object in sysfs */
 #endif
@@ -215,6 +414,9 @@ struct ofs_operations {
 extern
 struct ofs_root *ofs_register(char *magic);
 
+extern
+struct ofs_root *ofs_register_opts(char *magic, char *options);
+
 extern
 int ofs_unregister(struct ofs_root *root);
 
@@ -338,6 +540,22 @@ void ofs_put_oi(struct ofs_inode *oitgt, struct path *pathtgt)
 	path_put(pathtgt);
 }
 
+extern
+int ofs_stat_magic(struct ofs_root *root, oid_t target,
+		   struct ofs_magic_stat *st);
+
+extern
+unsigned int ofs_query_magic(struct ofs_root *root, const oid_t *targets,
+			     struct ofs_magic_stat *st, unsigned int nr);
+
+extern
+int ofs_for_each_child_magic(struct ofs_root *root, oid_t folder,
+			     ofs_child_cb_t cb, void *ctx,
+			     struct ofs_cursor *cursor);
+
+extern
+void ofs_release_cursor(struct ofs_cursor *cursor);
+
 extern
 int ofs_mkdir_magic(struct ofs_root *root, const char *name, umode_t mode,
 		    oid_t folder, oid_t *result);
@@ -350,6 +568,10 @@ extern
 int ofs_create_magic(struct ofs_root *root, const char *name, umode_t mode,
 		     bool is_singularity, oid_t folder, oid_t *result);
 
+extern
+int ofs_link_magic(struct ofs_root *root, oid_t target, oid_t folder,
+		   const char *name);
+
 extern
 int ofs_rmdir_magic(struct ofs_root *root, oid_t target);
 
@@ -381,19 +603,21 @@ int ofs_unlink_normal(struct ofs_root *root, struct inode *ip,
 
 /******** ofs namespace ********/
 extern
-int ofs_follow_link(struct ofs_inode *oi, struct ofs_nameidata *nd);
+int ofs_follow_link_magic(struct ofs_inode *oi, struct ofs_nameidata *nd);
 extern
-void ofs_put_link(struct ofs_inode *oi, struct ofs_nameidata *nd);
+void ofs_put_link_magic(struct ofs_inode *oi, struct ofs_nameidata *nd);
 
 /**
- * @brief get target from namespace data
+ * @brief get target of the last followed symlink from namespace data
  * @param nd: namespace data
  * @return target ofs_id
+ * @note
+ * * It is valid while the ofs inode of the symlink is held.
  */
 static __always_inline
 oid_t ofs_nd_get_link(struct ofs_nameidata *nd)
 {
-	return *(nd->saved_links[nd->depth]);
+	return *(nd->saved_links[nd->depth - 1]);
 }
 
 /**
@@ -25,6 +25,11 @@
 	 *    comment the line
 	 */
 
+#define CONFIG_OFS_FAST_SYMLINK_MAX	256
+	/**< A symlink whose target is shorter than it is stored in a slab
+	 *   string instead of a page. Set to 0 to store all in pages.
+	 */
+
 #define CONFIG_OFS_SYSFS		1 /**< /sysfs/fs/ofs entry */
 
 #define CONFIG_OFS_DEBUGFS		1 /**< debug interface in debugfs */
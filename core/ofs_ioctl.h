@@ -0,0 +1,204 @@
+/**
+ * @file
+ * @brief C header of the ofs (octagram filesystem, outlandish filesystem, or
+ *        odd filesystem) kernel module
+ * @author Octagram Sun <octagram@qq.com>
+ * @version 0.1.0
+ * @date 2015
+ * @copyright Octagram Sun <octagram@qq.com>
+ *
+ * @note
+ * C header of ioctl commands. It is shared by the kernel module and the
+ * userspace programs. 1 tab == 8 spaces.
+ */
+
+#ifndef __OFS_IOCTL_H__
+#define __OFS_IOCTL_H__
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ******** ********    header files   ******** ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ******** ********       macro       ******** ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+/**
+ * @brief ioctl type of ofs
+ */
+#define OFS_IOC_MAGIC			0xEF
+
+/**
+ * @brief Read children and their attributes of a directory or a singularity.
+ * @note
+ * * See <b><em>struct @ref ofs_readdirplus</em></b>.
+ */
+#define OFS_IOC_READDIRPLUS		_IOWR(OFS_IOC_MAGIC, 1, \
+					      struct ofs_readdirplus)
+
+/**
+ * @brief Unlink many children of a directory or a singularity.
+ * @note
+ * * See <b><em>struct @ref ofs_unlinkbatch</em></b>.
+ */
+#define OFS_IOC_UNLINKBATCH		_IOWR(OFS_IOC_MAGIC, 2, \
+					      struct ofs_unlinkbatch)
+
+/**
+ * @brief Copy a range of a regfile into another file in the kernel.
+ * @note
+ * * See <b><em>struct @ref ofs_copy_range</em></b>.
+ */
+#define OFS_IOC_COPYRANGE		_IOWR(OFS_IOC_MAGIC, 3, \
+					      struct ofs_copy_range)
+
+/**
+ * @brief ioctl type of the clone commands
+ * @note
+ * * The clone commands use the numbers of FICLONE and FICLONERANGE (the same
+ *   as BTRFS_IOC_CLONE and BTRFS_IOC_CLONE_RANGE), so
+ *   <b>cp --reflink</b> works on ofs.
+ */
+#define OFS_IOC_CLONE_MAGIC		0x94
+
+/**
+ * @brief Clone a whole regfile into another one of the same ofs. The
+ *        argument is the file descriptor of the source.
+ */
+#define OFS_IOC_CLONE			_IOW(OFS_IOC_CLONE_MAGIC, 9, int)
+
+/**
+ * @brief Clone a range of a regfile into another one of the same ofs.
+ * @note
+ * * See <b><em>struct @ref ofs_clone_range</em></b>.
+ */
+#define OFS_IOC_CLONERANGE		_IOW(OFS_IOC_CLONE_MAGIC, 13, \
+					      struct ofs_clone_range)
+
+/**
+ * @brief the start position of @ref OFS_IOC_READDIRPLUS
+ */
+#define OFS_READDIRPLUS_START		0
+
+/**
+ * @brief flag of @ref OFS_IOC_UNLINKBATCH: names is a prefix
+ */
+#define OFS_UNLINK_PREFIX		(1U << 0)
+
+/**
+ * @brief max length of names of @ref OFS_IOC_UNLINKBATCH
+ */
+#define OFS_UNLINKBATCH_MAX		(1U << 20)
+
+/**
+ * @brief Get the next record.
+ * @param rec: (struct ofs_dirent_plus *) the record
+ */
+#define OFS_DIRENT_PLUS_NEXT(rec) \
+	((struct ofs_dirent_plus *)((char *)(rec) + (rec)->reclen))
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ******** ********       types       ******** ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+/**
+ * @brief a child returned by @ref OFS_IOC_READDIRPLUS
+ * @note
+ * * Records are packed one by one in the buffer. Every record is aligned to
+ *   8 bytes, and the name ends with '\0'.
+ */
+struct ofs_dirent_plus {
+	__u64 ino;			/**< inode number */
+	__s64 size;			/**< size */
+	__s64 mtime_sec;		/**< last modification time (second) */
+	__u32 mtime_nsec;		/**< last modification time
+					 *   (nanosecond)
+					 */
+	__u32 mode;			/**< type and authority */
+	__u32 nlink;			/**< number of hard links */
+	__u16 reclen;			/**< length of this record */
+	__u8 type;			/**< DT_* type */
+	__u8 namelen;			/**< length of name without '\0' */
+	char name[];			/**< name */
+};
+
+/**
+ * @brief argument of @ref OFS_IOC_READDIRPLUS
+ * @note
+ * * Set <b><em>pos</em></b> to @ref OFS_READDIRPLUS_START to read from the
+ *   first child, and pass the returned <b><em>pos</em></b> to the next
+ *   call to go on. The end is reached when <b><em>nr</em></b> is 0.
+ * * The position is the same as the one of readdir, so it stays valid when
+ *   other children are created or removed.
+ */
+struct ofs_readdirplus {
+	__u64 buf;			/**< address of the user buffer */
+	__u32 len;			/**< length of the user buffer */
+	__u32 nr;			/**< [out] number of records */
+	__s64 pos;			/**< [in/out] cursor */
+};
+
+/**
+ * @brief argument of @ref OFS_IOC_UNLINKBATCH
+ * @note
+ * * Without @ref OFS_UNLINK_PREFIX, <b><em>names</em></b> is a list of names
+ *   separated by '\0'. A missing name is skipped. A directory or a magic
+ *   node stops the call with the error of unlink().
+ * * With @ref OFS_UNLINK_PREFIX, <b><em>names</em></b> is one prefix (may be
+ *   empty), and all children matching it are unlinked. Directories and
+ *   magic nodes are skipped.
+ * * If an error occurs, <b><em>nr</em></b> still tells how many children
+ *   have been unlinked.
+ */
+struct ofs_unlinkbatch {
+	__u64 names;			/**< address of the names */
+	__u32 len;			/**< length of the names
+					 *   (<= @ref OFS_UNLINKBATCH_MAX)
+					 */
+	__u32 flags;			/**< OFS_UNLINK_* */
+	__u64 nr;			/**< [out] number of unlinked children */
+};
+
+/**
+ * @brief argument of @ref OFS_IOC_CLONERANGE
+ * @note
+ * * The ioctl is called on the destination. The offsets must be aligned to
+ *   the page size. The length must be aligned too, unless the range ends
+ *   at the end of the source and reaches the end of the destination. A
+ *   length of 0 means to the end of the source.
+ */
+struct ofs_clone_range {
+	__s64 src_fd;			/**< file descriptor of the source */
+	__u64 src_offset;		/**< start of the range in the source */
+	__u64 src_length;		/**< length of the range */
+	__u64 dest_offset;		/**< start of the range in the
+					 *   destination
+					 */
+};
+
+/**
+ * @brief argument of @ref OFS_IOC_COPYRANGE
+ * @note
+ * * The ioctl is called on the source, a regfile of ofs. The destination
+ *   may be any writable regular file, such as a file of another ofs or of
+ *   tmpfs. The range stops at the end of the source.
+ * * If the destination is a regfile of the same ofs and the range is
+ *   aligned like @ref OFS_IOC_CLONERANGE requires, the range is cloned.
+ *   Otherwise the pages of the source are written into the destination
+ *   by the kernel, without user buffers.
+ * * If an error occurs, <b><em>copied</em></b> still tells how many bytes
+ *   have been copied.
+ */
+struct ofs_copy_range {
+	__s64 dest_fd;			/**< file descriptor of the
+					 *   destination
+					 */
+	__u64 src_offset;		/**< start of the range in the source */
+	__u64 dest_offset;		/**< start of the range in the
+					 *   destination
+					 */
+	__u64 len;			/**< length of the range */
+	__u64 copied;			/**< [out] number of bytes copied */
+};
+
+#endif /* ofs_ioctl.h */
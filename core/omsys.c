@@ -16,6 +16,8 @@
  ******** ******** ******** ******** ******** ******** ******** ********/
 
 #include "ofs.h"
+#include "fs.h"
+#include "zpage.h"
 #include <linux/slab.h>
 #include <linux/kobject.h>
 #include <linux/sysfs.h>
@@ -59,6 +61,49 @@ struct ofs_root *omsys_get(struct ofs_root *root);
 static __always_inline
 void omsys_put(struct ofs_root *root);
 
+/******** ******** /sys/fs/ofs/xxx/negd_* ******** ********/
+static
+ssize_t negd_nr_show(struct ofs_root *root, char *buf);
+
+static
+ssize_t negd_hits_show(struct ofs_root *root, char *buf);
+
+static
+ssize_t negd_misses_show(struct ofs_root *root, char *buf);
+
+/******** ******** /sys/fs/ofs/xxx/size & nr_inodes ******** ********/
+static
+ssize_t size_show(struct ofs_root *root, char *buf);
+
+static
+ssize_t size_store(struct ofs_root *root, const char *buf, size_t count);
+
+static
+ssize_t nr_inodes_show(struct ofs_root *root, char *buf);
+
+static
+ssize_t nr_inodes_store(struct ofs_root *root, const char *buf,
+			size_t count);
+
+/******** ******** /sys/fs/ofs/xxx/zpage_* ******** ********/
+static
+ssize_t zpage_nr_show(struct ofs_root *root, char *buf);
+
+static
+ssize_t zpage_bytes_show(struct ofs_root *root, char *buf);
+
+static
+ssize_t zpage_loads_show(struct ofs_root *root, char *buf);
+
+static
+ssize_t zpage_load_ns_show(struct ofs_root *root, char *buf);
+
+static
+ssize_t zpage_dedup_bytes_show(struct ofs_root *root, char *buf);
+
+static
+ssize_t zpage_clone_bytes_show(struct ofs_root *root, char *buf);
+
 /******** ******** /sys/fs/ofs/state ******** ********/
 static
 ssize_t ofs_attr_state_show(struct kobject *kobj, struct kobj_attribute *attr,
@@ -81,9 +126,45 @@ static const struct sysfs_ops omsys_sysfs_ops = {
 	.store = omsys_attr_store,
 };
 
+/******** ******** /sys/fs/ofs/xxx/negd_* ******** ********/
+static OMSYS_ATTR_RO(negd_nr);
+static OMSYS_ATTR_RO(negd_hits);
+static OMSYS_ATTR_RO(negd_misses);
+
+/******** ******** /sys/fs/ofs/xxx/size & nr_inodes ******** ********/
+static OMSYS_ATTR_RW(size);
+static OMSYS_ATTR_RW(nr_inodes);
+
+/******** ******** /sys/fs/ofs/xxx/zpage_* ******** ********/
+static OMSYS_ATTR_RO(zpage_nr);
+static OMSYS_ATTR_RO(zpage_bytes);
+static OMSYS_ATTR_RO(zpage_loads);
+static OMSYS_ATTR_RO(zpage_load_ns);
+static OMSYS_ATTR_RO(zpage_dedup_bytes);
+static OMSYS_ATTR_RO(zpage_clone_bytes);
+
+/**
+ * @brief default attributes of /sys/fs/ofs/xxx
+ */
+static struct attribute *omsys_default_attrs[] = {
+	&omsys_attr_negd_nr.attr,
+	&omsys_attr_negd_hits.attr,
+	&omsys_attr_negd_misses.attr,
+	&omsys_attr_size.attr,
+	&omsys_attr_nr_inodes.attr,
+	&omsys_attr_zpage_nr.attr,
+	&omsys_attr_zpage_bytes.attr,
+	&omsys_attr_zpage_loads.attr,
+	&omsys_attr_zpage_load_ns.attr,
+	&omsys_attr_zpage_dedup_bytes.attr,
+	&omsys_attr_zpage_clone_bytes.attr,
+	NULL,
+};
+
 static struct kobj_type omsys_ktype = {
 	.sysfs_ops = &omsys_sysfs_ops,
 	.release = omsys_release,
+	.default_attrs = omsys_default_attrs,
 };
 
 /******** ******** /sys/fs/ofs entry ******** ********/
@@ -288,6 +369,219 @@ void omsys_unregister(struct ofs_root *root)
 	}
 }
 
+/******** ******** /sys/fs/ofs/xxx/negd_* ******** ********/
+/**
+ * @brief show the number of negative dentries kept by option "negdcache"
+ * @param root: ofs root
+ * @param buf: output buffer
+ * @return the length of output
+ */
+static
+ssize_t negd_nr_show(struct ofs_root *root, char *buf)
+{
+	return sprintf(buf, "%ld\n", atomic_long_read(&root->nr_negd));
+}
+
+/**
+ * @brief show the number of lookups answered by a kept negative dentry
+ * @param root: ofs root
+ * @param buf: output buffer
+ * @return the length of output
+ * @note
+ * * The hit rate is negd_hits / (negd_hits + negd_misses).
+ */
+static
+ssize_t negd_hits_show(struct ofs_root *root, char *buf)
+{
+	return sprintf(buf, "%lld\n", percpu_counter_sum(&root->negd_hits));
+}
+
+/**
+ * @brief show the number of lookups that found nothing in the folder
+ * @param root: ofs root
+ * @param buf: output buffer
+ * @return the length of output
+ */
+static
+ssize_t negd_misses_show(struct ofs_root *root, char *buf)
+{
+	return sprintf(buf, "%lld\n", percpu_counter_sum(&root->negd_misses));
+}
+
+/******** ******** /sys/fs/ofs/xxx/size & nr_inodes ******** ********/
+/**
+ * @brief show the limit and the usage of file data
+ * @param root: ofs root
+ * @param buf: output buffer
+ * @return the length of output
+ * @note
+ * * Output "limit used" in bytes. The limit 0 means unlimited.
+ */
+static
+ssize_t size_show(struct ofs_root *root, char *buf)
+{
+	return sprintf(buf, "%llu %llu\n",
+		       (unsigned long long)ACCESS_ONCE(root->mo.max_blocks) <<
+		       PAGE_CACHE_SHIFT,
+		       (unsigned long long)percpu_counter_sum_positive(
+			       &root->used_blocks) << PAGE_CACHE_SHIFT);
+}
+
+/**
+ * @brief change the limit of file data, the same as option "size"
+ * @param root: ofs root
+ * @param buf: input buffer, such as "1g", "512m" or "50%"
+ * @param count: length of input
+ * @return count if successed, otherwise the error code
+ */
+static
+ssize_t size_store(struct ofs_root *root, const char *buf, size_t count)
+{
+	unsigned long pages;
+	int rc;
+
+	rc = ofs_parse_size(buf, &pages);
+	if (rc)
+		return rc;
+	rc = ofs_set_limit(&root->used_blocks, &root->mo.max_blocks, pages);
+	return rc ? rc : count;
+}
+
+/**
+ * @brief show the limit and the usage of inodes
+ * @param root: ofs root
+ * @param buf: output buffer
+ * @return the length of output
+ * @note
+ * * Output "limit used". The limit 0 means unlimited.
+ */
+static
+ssize_t nr_inodes_show(struct ofs_root *root, char *buf)
+{
+	return sprintf(buf, "%lu %lld\n", ACCESS_ONCE(root->mo.max_inodes),
+		       percpu_counter_sum_positive(&root->used_inodes));
+}
+
+/**
+ * @brief change the limit of inodes, the same as option "nr_inodes"
+ * @param root: ofs root
+ * @param buf: input buffer
+ * @param count: length of input
+ * @return count if successed, otherwise the error code
+ */
+static
+ssize_t nr_inodes_store(struct ofs_root *root, const char *buf,
+			size_t count)
+{
+	unsigned long long val;
+	char *rest;
+	int rc;
+
+	val = memparse(buf, &rest);
+	if (*rest == '\n')
+		rest++;
+	if (*rest || val > ULONG_MAX)
+		return -EINVAL;
+	rc = ofs_set_limit(&root->used_inodes, &root->mo.max_inodes,
+			   (unsigned long)val);
+	return rc ? rc : count;
+}
+
+/******** ******** /sys/fs/ofs/xxx/zpage_* ******** ********/
+/**
+ * @brief show the number of pages compressed by option "compress"
+ * @param root: ofs root
+ * @param buf: output buffer
+ * @return the length of output
+ * @note
+ * * The compression ratio is zpage_nr * PAGE_SIZE / zpage_bytes.
+ */
+static
+ssize_t zpage_nr_show(struct ofs_root *root, char *buf)
+{
+	struct ofs_zstore *zs = ACCESS_ONCE(root->zs);
+
+	return sprintf(buf, "%ld\n", zs ? atomic_long_read(&zs->nr) : 0);
+}
+
+/**
+ * @brief show the memory used by the compressed pages, in bytes
+ * @param root: ofs root
+ * @param buf: output buffer
+ * @return the length of output
+ */
+static
+ssize_t zpage_bytes_show(struct ofs_root *root, char *buf)
+{
+	struct ofs_zstore *zs = ACCESS_ONCE(root->zs);
+
+	return sprintf(buf, "%ld\n", zs ? atomic_long_read(&zs->bytes) : 0);
+}
+
+/**
+ * @brief show the number of pages decompressed by reads, writes and faults
+ * @param root: ofs root
+ * @param buf: output buffer
+ * @return the length of output
+ */
+static
+ssize_t zpage_loads_show(struct ofs_root *root, char *buf)
+{
+	struct ofs_zstore *zs = ACCESS_ONCE(root->zs);
+
+	return sprintf(buf, "%lld\n",
+		       zs ? percpu_counter_sum(&zs->loads) : 0LL);
+}
+
+/**
+ * @brief show the nanoseconds spent decompressing pages
+ * @param root: ofs root
+ * @param buf: output buffer
+ * @return the length of output
+ * @note
+ * * The latency added to a fault or read is zpage_load_ns / zpage_loads.
+ */
+static
+ssize_t zpage_load_ns_show(struct ofs_root *root, char *buf)
+{
+	struct ofs_zstore *zs = ACCESS_ONCE(root->zs);
+
+	return sprintf(buf, "%lld\n",
+		       zs ? percpu_counter_sum(&zs->load_ns) : 0LL);
+}
+
+/**
+ * @brief show the bytes of pages that share the compressed page of another
+ *        page by option "dedup"
+ * @param root: ofs root
+ * @param buf: output buffer
+ * @return the length of output
+ */
+static
+ssize_t zpage_dedup_bytes_show(struct ofs_root *root, char *buf)
+{
+	struct ofs_zstore *zs = ACCESS_ONCE(root->zs);
+
+	return sprintf(buf, "%ld\n",
+		       zs ? atomic_long_read(&zs->shared) * PAGE_SIZE : 0);
+}
+
+/**
+ * @brief show the bytes of pages that share the compressed page of another
+ *        page by a clone
+ * @param root: ofs root
+ * @param buf: output buffer
+ * @return the length of output
+ */
+static
+ssize_t zpage_clone_bytes_show(struct ofs_root *root, char *buf)
+{
+	struct ofs_zstore *zs = ACCESS_ONCE(root->zs);
+
+	return sprintf(buf, "%ld\n",
+		       zs ? atomic_long_read(&zs->cloned) * PAGE_SIZE : 0);
+}
+
 /******** ******** /sys/fs/ofs/state ******** ********/
 static
 ssize_t ofs_attr_state_show(struct kobject *kobj,
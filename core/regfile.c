@@ -18,6 +18,17 @@
 #include "fs.h"
 #include "log.h"
 #include "regfile.h"
+#include "huge.h"
+#include "zpage.h"
+#include "ksym.h"
+#include "ofs_ioctl.h"
+#include <linux/falloc.h>
+#include <linux/highmem.h>
+#include <linux/pagevec.h>
+#include <linux/file.h>
+#include <linux/mount.h>
+#include <linux/fsnotify.h>
+#include <asm/uaccess.h>
 
 /******** ******** ******** ******** ******** ******** ******** ********
  ******** ******** ********       macro       ******** ******** ********
@@ -30,6 +41,48 @@
 /******** ******** ******** ******** ******** ******** ******** ********
  ******** ********         function prototypes         ******** ********
  ******** ******** ******** ******** ******** ******** ******** ********/
+static
+size_t ofs_regfile_cached(struct address_space *mapping, loff_t pos,
+			  size_t count);
+
+static
+int ofs_regfile_prealloc_page(struct inode *inode, pgoff_t index);
+
+static
+pgoff_t ofs_regfile_seek_hlp(struct address_space *mapping, pgoff_t index,
+			     pgoff_t end, int whence);
+
+static
+loff_t ofs_regfile_seek_data_hole(struct file *file, loff_t offset,
+				  int whence);
+
+static
+int ofs_regfile_copy_page(struct page *src, struct inode *inode,
+			  pgoff_t index);
+
+static
+int ofs_regfile_clone_pages(struct inode *src, pgoff_t index, pgoff_t end,
+			    struct inode *dst, pgoff_t dindex);
+
+static
+long ofs_regfile_clone(struct file *dst_file, struct file *src_file,
+		       u64 off, u64 len, u64 destoff);
+
+static
+long ofs_regfile_ioc_clone(struct file *file, int srcfd, u64 off, u64 len,
+			   u64 destoff);
+
+static
+struct page *ofs_regfile_get_data_page(struct inode *inode, pgoff_t index);
+
+static
+long ofs_regfile_copy_range(struct file *src_file, u64 off,
+			    struct file *dst_file, u64 destoff, u64 len,
+			    u64 *copied);
+
+static
+long ofs_regfile_ioc_copyrange(struct file *file,
+			       struct ofs_copy_range __user *arg);
 
 /******** ******** ******** ******** ******** ******** ******** ********
  ******** ******** ********   .sdata & .data  ******** ******** ********
@@ -55,6 +108,8 @@ const struct file_operations ofs_regfile_fops = {
 	.fsync = ofs_regfile_fops_fsync,
 	.splice_read = ofs_regfile_fops_splice_read,
 	.splice_write = ofs_regfile_fops_splice_write,
+	.fallocate = ofs_regfile_fops_fallocate,
+	.unlocked_ioctl = ofs_regfile_fops_unlocked_ioctl,
 };
 
 /******** ******** ******** ******** ******** ******** ******** ********
@@ -71,11 +126,28 @@ const struct file_operations ofs_regfile_fops = {
  * @retval errno: Indicate the error code
  *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
  *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * When the file shrinks, the compressed pages beyond the new size are
+ *   freed, and a compressed partial page at the new end is decompressed
+ *   first, so its tail is zeroed (see option "compress").
  */
 int ofs_regfile_iops_setattr(struct dentry *dentry, struct iattr *iattr)
 {
+	struct inode *inode = dentry->d_inode;
+	int rc;
+
 //	ofs_dbg("dentry<%p>; iattr<%p>;\n", dentry, iattr);
-	return simple_setattr(dentry, iattr);
+	if ((iattr->ia_valid & ATTR_SIZE) &&
+	    iattr->ia_size < i_size_read(inode)) {
+		rc = ofs_zpage_fault_in(inode, iattr->ia_size);
+		if (rc)
+			return rc;
+	}
+	rc = simple_setattr(dentry, iattr);
+	if (rc == 0 && (iattr->ia_valid & ATTR_SIZE))
+		ofs_zpage_truncate(inode, (iattr->ia_size + PAGE_CACHE_SIZE -
+					   1) >> PAGE_CACHE_SHIFT, ULONG_MAX);
+	return rc;
 }
 
 /**
@@ -101,17 +173,24 @@ int ofs_regfile_iops_getattr(struct vfsmount *mnt, struct dentry *dentry,
  * @brief ofs file operation for regfile: llseek
  * @param file: file struct of the opened regfile
  * @param offset: position
- * @param whence: SEEK_SET, SEEK_CUR or SEEK_END (See man lseek for detail.)
+ * @param whence: SEEK_SET, SEEK_CUR, SEEK_END, SEEK_DATA or SEEK_HOLE
+ *                (See man lseek for detail.)
  * @return the position
  * @retval >0: the position
  * @retval errno: Indicate the error code
  *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
  *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * Only the pages that were written, mmapped writable or preallocated by
+ *   fallocate() are data. Pages that are missing or only read hold zeros,
+ *   and are holes.
  */
 loff_t ofs_regfile_fops_llseek(struct file *file, loff_t offset, int whence)
 {
 	ofs_dbg("file<%p>; dentry<%p>==\"%pd\"; offset==%lld; whence==%d;\n",
 		file, file->f_path.dentry, file->f_path.dentry, offset, whence);
+	if (whence == SEEK_DATA || whence == SEEK_HOLE)
+		return ofs_regfile_seek_data_hole(file, offset, whence);
 	return generic_file_llseek(file, offset, whence);
 }
 
@@ -168,6 +247,10 @@ ssize_t ofs_regfile_fops_write(struct file *file, const char __user *buf,
  * @retval errno: Indicate the error code
  *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
  *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * If the file is opened with O_NONBLOCK and option
+ *   "nowait" is set, see
+ *   @ref ofs_regfile_read_iter_nowait().
  */
 ssize_t ofs_regfile_fops_read_iter(struct kiocb *iocb, struct iov_iter *iter)
 {
@@ -176,6 +259,8 @@ ssize_t ofs_regfile_fops_read_iter(struct kiocb *iocb, struct iov_iter *iter)
 	ofs_dbg("oi<%p>; iocb<%p>; dentry<%p>==\"%pd\"; iter<%p>\n",
 		oi, iocb, iocb->ki_filp->f_path.dentry,
 		iocb->ki_filp->f_path.dentry, iter);
+	if (OFS_FILE_NOWAIT(iocb->ki_filp))
+		return ofs_regfile_read_iter_nowait(iocb, iter);
 	return generic_file_read_iter(iocb, iter);
 }
 
@@ -184,6 +269,10 @@ ssize_t ofs_regfile_fops_read_iter(struct kiocb *iocb, struct iov_iter *iter)
  * @retval errno: Indicate the error code
  *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
  *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * If the file is opened with O_NONBLOCK and option
+ *   "nowait" is set, see
+ *   @ref ofs_regfile_write_iter_nowait().
  */
 ssize_t ofs_regfile_fops_write_iter(struct kiocb *iocb, struct iov_iter *iter)
 {
@@ -192,9 +281,144 @@ ssize_t ofs_regfile_fops_write_iter(struct kiocb *iocb, struct iov_iter *iter)
 	ofs_dbg("oi<%p>; iocb<%p>; dentry<%p>=\"%pd\"; iter<%p>\n",
 		oi, iocb, iocb->ki_filp->f_path.dentry,
 		iocb->ki_filp->f_path.dentry, iter);
+	if (OFS_FILE_NOWAIT(iocb->ki_filp))
+		return ofs_regfile_write_iter_nowait(iocb, iter);
 	return generic_file_write_iter(iocb, iter);
 }
 
+/**
+ * @brief Count the bytes from a position that are held by the page cache.
+ * @param mapping: address space of the file
+ * @param pos: position to start
+ * @param count: number of bytes wanted
+ * @return number of bytes, not more than <b><em>count</em></b>, that are
+ *         covered by contiguous uptodate pages from <b><em>pos</em></b>.
+ */
+static
+size_t ofs_regfile_cached(struct address_space *mapping, loff_t pos,
+			  size_t count)
+{
+	struct page *pages[PAGEVEC_SIZE];
+	pgoff_t index, last;
+	unsigned int want, nr, i;
+	loff_t bytes;
+
+	if (count == 0)
+		return 0;
+	index = pos >> PAGE_CACHE_SHIFT;
+	last = (pos + count - 1) >> PAGE_CACHE_SHIFT;
+	while (index <= last) {
+		want = min_t(pgoff_t, last - index + 1, PAGEVEC_SIZE);
+		nr = find_get_pages_contig(mapping, index, want, pages);
+		for (i = 0; i < nr && PageUptodate(pages[i]); i++)
+			;
+		index += i;
+		while (nr)
+			page_cache_release(pages[--nr]);
+		if (i < want)
+			break;
+	}
+	bytes = ((loff_t)index << PAGE_CACHE_SHIFT) - pos;
+	if (bytes <= 0)
+		return 0;
+	return min_t(loff_t, bytes, count);
+}
+
+/**
+ * @brief read without sleeping on page allocation
+ * @param iocb: the I/O control block
+ * @param iter: the destination
+ * @return real data size that read from the file
+ * @retval >=0: size
+ * @retval -EAGAIN: the first page to read is not in the page cache.
+ * @retval errno: Indicate the error code
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * Only the run of uptodate pages in the page cache from the position is
+ *   read, so the read may be short. A hole page would be allocated by
+ *   <em>simple_readpage()</em>, thus the read stops before it.
+ * * It is used by the regfiles and singularities opened with O_NONBLOCK in
+ *   an ofs mounted with option "nowait". Linux 3.19 has no IOCB_NOWAIT.
+ *   O_NONBLOCK alone has no effect on regular files, as POSIX says, so
+ *   the option is needed to ask for a read that never sleeps.
+ */
+ssize_t ofs_regfile_read_iter_nowait(struct kiocb *iocb, struct iov_iter *iter)
+{
+	struct inode *inode = file_inode(iocb->ki_filp);
+	size_t count = iov_iter_count(iter);
+	size_t avail, rest;
+	loff_t isize;
+	ssize_t rc;
+
+	isize = i_size_read(inode);
+	if (count == 0 || iocb->ki_pos >= isize)
+		return generic_file_read_iter(iocb, iter);
+	avail = ofs_regfile_cached(inode->i_mapping, iocb->ki_pos,
+				   min_t(loff_t, count, isize - iocb->ki_pos));
+	if (avail == 0)
+		return -EAGAIN;
+
+	rest = count - avail;
+	iov_iter_truncate(iter, avail);
+	rc = generic_file_read_iter(iocb, iter);
+	iov_iter_reexpand(iter, iov_iter_count(iter) + rest);
+	return rc;
+}
+
+/**
+ * @brief write without sleeping on page allocation or the inode lock
+ * @param iocb: the I/O control block
+ * @param iter: the source
+ * @return real data size that wrote into the file
+ * @retval >=0: size
+ * @retval -EAGAIN: i_mutex is held by others, or the first page to write
+ *                  is not in the page cache.
+ * @retval errno: Indicate the error code
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * The same as <em>generic_file_write_iter()</em>, except that i_mutex is
+ *   only tried, and only the run of uptodate pages in the page cache from
+ *   the position is written, so the write may be short. The pages are
+ *   already charged, thus the limit of option "size" is not touched.
+ * * See @ref ofs_regfile_read_iter_nowait().
+ */
+ssize_t ofs_regfile_write_iter_nowait(struct kiocb *iocb, struct iov_iter *iter)
+{
+	struct file *file = iocb->ki_filp;
+	struct inode *inode = file_inode(file);
+	size_t count = iov_iter_count(iter);
+	size_t avail, rest;
+	loff_t pos;
+	ssize_t rc, err;
+
+	if (count == 0)
+		return generic_file_write_iter(iocb, iter);
+	if (!mutex_trylock(&inode->i_mutex))
+		return -EAGAIN;
+	pos = (file->f_flags & O_APPEND) ? i_size_read(inode) : iocb->ki_pos;
+	avail = ofs_regfile_cached(inode->i_mapping, pos, count);
+	if (avail == 0) {
+		rc = -EAGAIN;
+		goto out_unlock;
+	}
+
+	rest = count - avail;
+	iov_iter_truncate(iter, avail);
+	rc = __generic_file_write_iter(iocb, iter);
+	iov_iter_reexpand(iter, iov_iter_count(iter) + rest);
+
+out_unlock:
+	mutex_unlock(&inode->i_mutex);
+	if (rc > 0) {
+		err = generic_write_sync(file, iocb->ki_pos - rc, rc);
+		if (err < 0)
+			rc = err;
+	}
+	return rc;
+}
+
 /**
  * @brief ofs file operation for regfile: mmap
  * @param file: file struct of the opened regfile
@@ -209,7 +433,7 @@ int ofs_regfile_fops_mmap(struct file *file, struct vm_area_struct *vma)
 
 	ofs_dbg("oi<%p>; file<%p>; dentry<%p>==\"%pd\"; vma<%p>;\n",
 		oi, file, file->f_path.dentry, file->f_path.dentry, vma);
-	return generic_file_mmap(file, vma);
+	return ofs_huge_mmap(file, vma);
 }
 
 /**
@@ -273,3 +497,666 @@ ssize_t ofs_regfile_fops_splice_write(struct pipe_inode_info *pipe,
 	return iter_file_splice_write(pipe, out, pos, len, flags);
 }
 
+/**
+ * @brief Preallocate a page of a regular file.
+ * @param inode: inode of the regfile
+ * @param index: index of the page
+ * @retval 0: OK
+ * @retval -ENOMEM: no memory
+ * @retval -ENOSPC: the limit of option "size" is reached.
+ * @retval -EIO: the compressed page is corrupted.
+ * @note
+ * * A new page is zeroed, or decompressed if it was compressed (see option
+ *   "compress"). The page is marked dirty, so it is kept until
+ *   it is truncated or punched, the same as a written page.
+ */
+static
+int ofs_regfile_prealloc_page(struct inode *inode, pgoff_t index)
+{
+	struct ofs_root *root = (struct ofs_root *)inode->i_sb->s_fs_info;
+	struct page *page;
+	int rc;
+
+	page = grab_cache_page(inode->i_mapping, index);
+	if (page == NULL)
+		return -ENOMEM;
+	if (!PageUptodate(page)) {
+		rc = ofs_zpage_load(inode, page);
+		if (rc < 0)
+			goto out_unlock;
+		if (rc > 0)
+			SetPageUptodate(page);
+	}
+	if (!PagePrivate(page)) {
+		if (ofs_acct_blocks(root, 1)) {
+			rc = -ENOSPC;
+			goto out_unlock;
+		}
+		ofs_page_acct(page, root);
+	}
+	if (!PageUptodate(page)) {
+		zero_user(page, 0, PAGE_CACHE_SIZE);
+		SetPageUptodate(page);
+	}
+	set_page_dirty(page);
+	rc = 0;
+
+out_unlock:
+	unlock_page(page);
+	page_cache_release(page);
+	return rc;
+}
+
+/**
+ * @brief ofs file operation for regfile: fallocate
+ * @param file: file struct of the opened regfile
+ * @param mode: 0 or FALLOC_FL_* flags
+ * @param offset: start of the range
+ * @param len: length of the range
+ * @retval 0: OK
+ * @retval errno: Indicate the error code
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * Mode 0 preallocates the range, and extends the file size unless
+ *   FALLOC_FL_KEEP_SIZE is set. Every aligned huge extent that the range
+ *   covers is populated with one huge block (see @ref ofs_huge_populate()),
+ *   and the rest gets order-0 pages.
+ * * FALLOC_FL_PUNCH_HOLE frees the pages in the range, including the
+ *   compressed ones. Partial pages at the edges are zeroed.
+ * * FALLOC_FL_ZERO_RANGE punches the range, then preallocates it.
+ * * If an error occurs, the pages preallocated already are kept, and the
+ *   file size isn't changed.
+ */
+long ofs_regfile_fops_fallocate(struct file *file, int mode, loff_t offset,
+				loff_t len)
+{
+	struct inode *inode = file_inode(file);
+	loff_t end = offset + len;
+	pgoff_t index, last;
+	long rc = 0;
+
+	ofs_dbg("file<%p>; dentry<%p>==\"%pd\"; mode==0x%x; offset==%lld; "
+		"len==%lld;\n", file, file->f_path.dentry, file->f_path.dentry,
+		mode, offset, len);
+	if (mode & ~(FALLOC_FL_KEEP_SIZE | FALLOC_FL_PUNCH_HOLE |
+		     FALLOC_FL_ZERO_RANGE))
+		return -EOPNOTSUPP;
+
+	mutex_lock(&inode->i_mutex);
+	if (!(mode & FALLOC_FL_KEEP_SIZE)) {
+		rc = inode_newsize_ok(inode, end);
+		if (rc)
+			goto out_unlock;
+	}
+	if (mode & (FALLOC_FL_PUNCH_HOLE | FALLOC_FL_ZERO_RANGE)) {
+		rc = ofs_zpage_fault_in(inode, offset);
+		if (rc == 0)
+			rc = ofs_zpage_fault_in(inode, end);
+		if (rc)
+			goto out_unlock;
+		truncate_pagecache_range(inode, offset, end - 1);
+		ofs_zpage_truncate(inode,
+				   (offset + PAGE_CACHE_SIZE - 1) >> PAGE_CACHE_SHIFT,
+				   end >> PAGE_CACHE_SHIFT);
+		if (mode & FALLOC_FL_PUNCH_HOLE)
+			goto out_time;
+	}
+
+	index = offset >> PAGE_CACHE_SHIFT;
+	last = (end - 1) >> PAGE_CACHE_SHIFT;
+	while (index <= last) {
+		if (fatal_signal_pending(current)) {
+			rc = -EINTR;
+			goto out_unlock;
+		}
+		if ((index & (OFS_HUGE_NR - 1)) == 0 &&
+		    last - index >= OFS_HUGE_NR - 1)
+			ofs_huge_populate(inode, index);
+		rc = ofs_regfile_prealloc_page(inode, index);
+		if (rc)
+			goto out_unlock;
+		index++;
+		cond_resched();
+	}
+	if (!(mode & FALLOC_FL_KEEP_SIZE) && end > i_size_read(inode))
+		i_size_write(inode, end);
+
+out_time:
+	inode->i_ctime = CURRENT_TIME;
+	if (mode & (FALLOC_FL_PUNCH_HOLE | FALLOC_FL_ZERO_RANGE))
+		inode->i_mtime = inode->i_ctime;
+out_unlock:
+	mutex_unlock(&inode->i_mutex);
+	return rc;
+}
+
+/**
+ * @brief ofs file operation for regfile: ioctl
+ * @param file: file struct of the opened regfile
+ * @param cmd: ioctl command
+ * @param args: ioctl arguments
+ * @retval errno: Indicate the error code
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * See <b><i>ofs_ioctl.h</i></b> for the commands.
+ */
+long ofs_regfile_fops_unlocked_ioctl(struct file *file, unsigned int cmd,
+				     unsigned long args)
+{
+	struct ofs_clone_range range;
+
+	ofs_dbg("file<%p>; dentry<%p>==\"%pd\"; cmd==%u; args==%lu;\n",
+		file, file->f_path.dentry, file->f_path.dentry, cmd, args);
+	switch (cmd) {
+	case OFS_IOC_CLONE:
+		return ofs_regfile_ioc_clone(file, (int)args, 0, 0, 0);
+	case OFS_IOC_CLONERANGE:
+		if (copy_from_user(&range, (void __user *)args,
+				   sizeof(struct ofs_clone_range)))
+			return -EFAULT;
+		return ofs_regfile_ioc_clone(file, (int)range.src_fd,
+					     range.src_offset,
+					     range.src_length,
+					     range.dest_offset);
+	case OFS_IOC_COPYRANGE:
+		return ofs_regfile_ioc_copyrange(file,
+				(struct ofs_copy_range __user *)args);
+	default:
+		return -ENOTTY;
+	}
+}
+
+/**
+ * @brief Find the first data page or hole page.
+ * @param mapping: address space of the regfile
+ * @param index: index of the page to start
+ * @param end: index of the page after the end of the file
+ * @param whence: SEEK_DATA or SEEK_HOLE
+ * @return index of the page found. It is not less than
+ *         <b><em>end</em></b> if nothing is found.
+ * @note
+ * * Data pages are tagged PAGECACHE_TAG_DIRTY (see
+ *   <em>ofs_set_page_dirty_no_writeback()</em>), so runs of holes are
+ *   skipped by the radix tree without visiting them.
+ */
+static
+pgoff_t ofs_regfile_seek_hlp(struct address_space *mapping, pgoff_t index,
+			     pgoff_t end, int whence)
+{
+	struct page *pages[PAGEVEC_SIZE];
+	pgoff_t next;
+	unsigned int nr, i;
+	bool done = false;
+
+	while (index < end && !done) {
+		next = index;
+		nr = find_get_pages_tag(mapping, &next, PAGECACHE_TAG_DIRTY,
+					PAGEVEC_SIZE, pages);
+		if (nr == 0) {
+			if (whence == SEEK_DATA)
+				index = end;
+			break;
+		}
+		for (i = 0; i < nr && !done; i++) {
+			if (pages[i]->index != index) {
+				/* a hole before this page */
+				if (whence == SEEK_DATA)
+					index = pages[i]->index;
+				done = true;
+			} else if (whence == SEEK_DATA) {
+				done = true;
+			} else {
+				index++;
+			}
+		}
+		for (i = 0; i < nr; i++)
+			page_cache_release(pages[i]);
+		cond_resched();
+	}
+	return index;
+}
+
+/**
+ * @brief llseek with SEEK_DATA or SEEK_HOLE
+ * @param file: file struct of the opened regfile
+ * @param offset: position to start
+ * @param whence: SEEK_DATA or SEEK_HOLE
+ * @return the position
+ * @retval >=0: the position
+ * @retval -ENXIO: offset is beyond the end of the file, or there is no more
+ *                 data after offset.
+ * @note
+ * * The end of the file is an implicit hole.
+ * * Compressed pages are data (see option "compress").
+ */
+static
+loff_t ofs_regfile_seek_data_hole(struct file *file, loff_t offset,
+				  int whence)
+{
+	struct inode *inode = file_inode(file);
+	pgoff_t start, end, index;
+	loff_t newoff, isize;
+
+	mutex_lock(&inode->i_mutex);
+	isize = i_size_read(inode);
+	if (offset < 0 || offset >= isize) {
+		offset = -ENXIO;
+		goto out_unlock;
+	}
+	start = offset >> PAGE_CACHE_SHIFT;
+	end = (isize + PAGE_CACHE_SIZE - 1) >> PAGE_CACHE_SHIFT;
+	index = ofs_regfile_seek_hlp(inode->i_mapping, start, end, whence);
+	if (whence == SEEK_DATA) {
+		index = min(index, ofs_zpage_next(inode, start));
+	} else {
+		/* A compressed page is data too. */
+		while (index < end && ofs_zpage_next(inode, index) == index)
+			index = ofs_regfile_seek_hlp(inode->i_mapping, index + 1,
+						     end, SEEK_HOLE);
+	}
+	newoff = (loff_t)index << PAGE_CACHE_SHIFT;
+	if (newoff > offset) {
+		if (newoff < isize)
+			offset = newoff;
+		else if (whence == SEEK_DATA)
+			offset = -ENXIO;
+		else
+			offset = isize;
+	}
+	if (offset >= 0)
+		offset = vfs_setpos(file, offset, inode->i_sb->s_maxbytes);
+
+out_unlock:
+	mutex_unlock(&inode->i_mutex);
+	return offset;
+}
+
+/**
+ * @brief Copy a data page into a regfile.
+ * @param src: the data page
+ * @param inode: inode of the regfile
+ * @param index: index of the page in the regfile
+ * @retval 0: OK
+ * @retval -ENOMEM: no memory
+ * @retval -ENOSPC: the limit of option "size" is reached.
+ */
+static
+int ofs_regfile_copy_page(struct page *src, struct inode *inode,
+			  pgoff_t index)
+{
+	struct ofs_root *root = (struct ofs_root *)inode->i_sb->s_fs_info;
+	struct page *page;
+	int rc = 0;
+
+	page = grab_cache_page(inode->i_mapping, index);
+	if (page == NULL)
+		return -ENOMEM;
+	if (!PagePrivate(page)) {
+		if (ofs_acct_blocks(root, 1)) {
+			rc = -ENOSPC;
+			goto out_unlock;
+		}
+		ofs_page_acct(page, root);
+	}
+	copy_highpage(page, src);
+	flush_dcache_page(page);
+	SetPageUptodate(page);
+	set_page_dirty(page);
+
+out_unlock:
+	unlock_page(page);
+	page_cache_release(page);
+	return rc;
+}
+
+/**
+ * @brief Clone the data pages of a range of a regfile into another one.
+ * @param src: inode of the source
+ * @param index: index of the first page in the source
+ * @param end: index of the page after the range in the source
+ * @param dst: inode of the destination
+ * @param dindex: index of the first page in the destination
+ * @retval 0: OK
+ * @retval errno: Indicate the error code
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * Holes are skipped like SEEK_DATA does. A compressed page is shared
+ *   (see @ref ofs_zpage_clone()), and a data page in the page cache is
+ *   copied, because a page can't be in two page caches.
+ * * The page of the source isn't locked while it is copied, so the copy
+ *   races with writers through mmap like read() does.
+ */
+static
+int ofs_regfile_clone_pages(struct inode *src, pgoff_t index, pgoff_t end,
+			    struct inode *dst, pgoff_t dindex)
+{
+	struct page *page;
+	pgoff_t next;
+	bool data;
+	int rc;
+
+	while (index < end) {
+		if (fatal_signal_pending(current))
+			return -EINTR;
+		next = ofs_regfile_seek_hlp(src->i_mapping, index, end,
+					    SEEK_DATA);
+		next = min(next, ofs_zpage_next(src, index));
+		if (next >= end)
+			break;
+		dindex += next - index;
+		index = next;
+
+		rc = ofs_zpage_clone(src, index, dst, dindex);
+		if (rc == 0) {
+			page = find_get_page(src->i_mapping, index);
+			if (page) {
+				/* wait for a page being decompressed */
+				lock_page(page);
+				data = PageUptodate(page) && PageDirty(page);
+				unlock_page(page);
+				if (data)
+					rc = ofs_regfile_copy_page(page, dst,
+								   dindex);
+				page_cache_release(page);
+			}
+		}
+		if (rc < 0)
+			return rc;
+		index++;
+		dindex++;
+		cond_resched();
+	}
+	return 0;
+}
+
+/**
+ * @brief Clone a range of a regfile into another regfile of the same ofs.
+ * @param dst_file: file struct of the destination
+ * @param src_file: file struct of the source
+ * @param off: start of the range in the source
+ * @param len: length of the range. 0 means to the end of the source.
+ * @param destoff: start of the range in the destination
+ * @retval 0: OK
+ * @retval -EBADF: The source isn't readable, or the destination isn't
+ *                 writable or is opened with O_APPEND.
+ * @retval -EXDEV: The files aren't in the same ofs.
+ * @retval -EINVAL: The source isn't a regfile of ofs, the range is
+ *                  unaligned or beyond the end of the source, or the
+ *                  ranges overlap in the same file.
+ * @retval errno: Indicate the error code
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * The range of the destination is punched first, then the data of the
+ *   source is cloned into it, and the destination is extended if the
+ *   range goes beyond its end.
+ * * If an error occurs, the range of the destination is partly cloned,
+ *   and its size isn't changed.
+ * * The destination is notified by <em>fsnotify_modify()</em> like a write.
+ */
+static
+long ofs_regfile_clone(struct file *dst_file, struct file *src_file,
+		       u64 off, u64 len, u64 destoff)
+{
+	struct inode *dst = file_inode(dst_file);
+	struct inode *src = file_inode(src_file);
+	u64 isize, end, dend;
+	long rc;
+
+	if (!(src_file->f_mode & FMODE_READ) ||
+	    !(dst_file->f_mode & FMODE_WRITE) ||
+	    (dst_file->f_flags & O_APPEND))
+		return -EBADF;
+	if (src_file->f_op != &ofs_regfile_fops)
+		return -EINVAL;
+	if (src->i_sb != dst->i_sb)
+		return -EXDEV;
+	if (IS_IMMUTABLE(dst) || IS_APPEND(dst))
+		return -EPERM;
+	if ((off | destoff) & ~PAGE_CACHE_MASK)
+		return -EINVAL;
+
+	rc = mnt_want_write_file(dst_file);
+	if (rc)
+		return rc;
+	lock_two_nondirectories(src, dst);
+	isize = i_size_read(src);
+	rc = -EINVAL;
+	if (off > isize)
+		goto out_unlock;
+	if (len == 0)
+		len = isize - off;
+	end = off + len;
+	dend = destoff + len;
+	if (end > isize || dend < destoff)
+		goto out_unlock;
+	if ((len & ~PAGE_CACHE_MASK) &&
+	    (end != isize || dend < i_size_read(dst)))
+		goto out_unlock;
+	if (src == dst && off < dend && destoff < end)
+		goto out_unlock;
+	rc = inode_newsize_ok(dst, dend);
+	if (rc)
+		goto out_unlock;
+	rc = file_remove_suid(dst_file);
+	if (rc || len == 0)
+		goto out_unlock;
+
+	truncate_pagecache_range(dst, destoff, PAGE_CACHE_ALIGN(dend) - 1);
+	ofs_zpage_truncate(dst, destoff >> PAGE_CACHE_SHIFT,
+			   PAGE_CACHE_ALIGN(dend) >> PAGE_CACHE_SHIFT);
+	rc = ofs_regfile_clone_pages(src, off >> PAGE_CACHE_SHIFT,
+				     PAGE_CACHE_ALIGN(end) >> PAGE_CACHE_SHIFT,
+				     dst, destoff >> PAGE_CACHE_SHIFT);
+	if (rc == 0 && dend > i_size_read(dst))
+		i_size_write(dst, dend);
+	dst->i_mtime = dst->i_ctime = CURRENT_TIME;
+
+out_unlock:
+	unlock_two_nondirectories(src, dst);
+	mnt_drop_write_file(dst_file);
+	if (rc == 0 && len)
+		fsnotify_modify(dst_file);
+	return rc;
+}
+
+/**
+ * @brief ioctl OFS_IOC_CLONE and OFS_IOC_CLONERANGE
+ * @param file: file struct of the destination
+ * @param srcfd: file descriptor of the source
+ * @param off: start of the range in the source
+ * @param len: length of the range. 0 means to the end of the source.
+ * @param destoff: start of the range in the destination
+ * @retval 0: OK
+ * @retval errno: Indicate the error code
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ */
+static
+long ofs_regfile_ioc_clone(struct file *file, int srcfd, u64 off, u64 len,
+			   u64 destoff)
+{
+	struct fd src = fdget(srcfd);
+	long rc;
+
+	if (src.file == NULL)
+		return -EBADF;
+	rc = ofs_regfile_clone(file, src.file, off, len, destoff);
+	fdput(src);
+	return rc;
+}
+
+/**
+ * @brief Get a data page of a regfile.
+ * @param inode: inode of the regfile
+ * @param index: index of the page
+ * @return the uptodate page with a reference
+ * @retval NULL: The page is a hole.
+ * @retval errno: Indicate the error code
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * A compressed page is decompressed. A hole isn't allocated, unlike a
+ *   read() of it does.
+ * * The compressed page is looked up before the page cache, because
+ *   @ref ofs_zpage_load() adds the page before it removes the compressed
+ *   page, so the data is found either way.
+ */
+static
+struct page *ofs_regfile_get_data_page(struct inode *inode, pgoff_t index)
+{
+	struct page *page;
+
+	if (ofs_zpage_next(inode, index) == index)
+		return read_mapping_page(inode->i_mapping, index, NULL);
+	page = find_get_page(inode->i_mapping, index);
+	if (page == NULL)
+		return NULL;
+	wait_on_page_locked(page);
+	if (PageUptodate(page) && PageDirty(page))
+		return page;
+	/* zeros only */
+	page_cache_release(page);
+	return NULL;
+}
+
+/**
+ * @brief Copy a range of a regfile into another file.
+ * @param src_file: file struct of the source, a regfile of ofs
+ * @param off: start of the range in the source
+ * @param dst_file: file struct of the destination
+ * @param destoff: start of the range in the destination
+ * @param len: length of the range
+ * @param copied: return the number of bytes copied
+ * @retval 0: OK
+ * @retval -EBADF: The source isn't readable, or the destination isn't
+ *                 writable or is opened with O_APPEND.
+ * @retval -EINVAL: The destination isn't a regular file, or the ranges
+ *                  overlap in the same file.
+ * @retval errno: Indicate the error code
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * A regfile of the same ofs gets the range cloned if it is aligned (see
+ *   @ref ofs_regfile_clone()).
+ * * Otherwise every page of the source is written into the destination by
+ *   <em>__kernel_write()</em>, straight from the page cache, and a hole is
+ *   written from the zero page. The destination takes its own locks, so
+ *   no lock of the source is held, and the copy races with writers of the
+ *   source like read() does.
+ * * Like write(), every write is checked by <em>rw_verify_area()</em> and
+ *   notified by <em>fsnotify_modify()</em> (in <em>__kernel_write()</em>),
+ *   and the whole copy holds the freeze protection of the destination.
+ */
+static
+long ofs_regfile_copy_range(struct file *src_file, u64 off,
+			    struct file *dst_file, u64 destoff, u64 len,
+			    u64 *copied)
+{
+	struct inode *src = file_inode(src_file);
+	struct inode *dst = file_inode(dst_file);
+	struct page *page;
+	u64 isize, pos;
+	loff_t dpos;
+	size_t offset, bytes;
+	ssize_t n;
+	void *kaddr;
+	long rc = 0;
+
+	*copied = 0;
+	if (!(src_file->f_mode & FMODE_READ) ||
+	    !(dst_file->f_mode & FMODE_WRITE) ||
+	    (dst_file->f_flags & O_APPEND))
+		return -EBADF;
+	if (!S_ISREG(dst->i_mode))
+		return -EINVAL;
+	isize = i_size_read(src);
+	if (off >= isize || len == 0)
+		return 0;
+	len = min(len, isize - off);
+	if (destoff + len < destoff)
+		return -EINVAL;
+	if (src == dst && off < destoff + len && destoff < off + len)
+		return -EINVAL;
+
+	if (dst_file->f_op == &ofs_regfile_fops && dst->i_sb == src->i_sb &&
+	    !((off | destoff) & ~PAGE_CACHE_MASK) &&
+	    (!(len & ~PAGE_CACHE_MASK) ||
+	     (off + len == isize && destoff + len >= i_size_read(dst)))) {
+		rc = ofs_regfile_clone(dst_file, src_file, off, len, destoff);
+		if (rc == 0)
+			*copied = len;
+		return rc;
+	}
+
+	file_start_write(dst_file);
+	for (pos = off; pos < off + len; pos += n) {
+		if (fatal_signal_pending(current)) {
+			rc = -EINTR;
+			break;
+		}
+		offset = pos & ~PAGE_CACHE_MASK;
+		bytes = min_t(u64, PAGE_CACHE_SIZE - offset, off + len - pos);
+		dpos = destoff + (pos - off);
+		n = CALL_KSYM(rw_verify_area, WRITE, dst_file, &dpos, bytes);
+		if (n < 0) {
+			rc = n;
+			break;
+		}
+		page = ofs_regfile_get_data_page(src, pos >> PAGE_CACHE_SHIFT);
+		if (IS_ERR(page)) {
+			rc = PTR_ERR(page);
+			break;
+		}
+		kaddr = kmap(page ? page : ZERO_PAGE(0));
+		n = CALL_KSYM(__kernel_write, dst_file, (char *)kaddr + offset,
+			      bytes, &dpos);
+		kunmap(page ? page : ZERO_PAGE(0));
+		if (page)
+			page_cache_release(page);
+		if (n <= 0) {
+			rc = n;
+			break;
+		}
+		*copied += n;
+		if (n < bytes)
+			break;
+		cond_resched();
+	}
+	file_end_write(dst_file);
+	return rc;
+}
+
+/**
+ * @brief ioctl OFS_IOC_COPYRANGE
+ * @param file: file struct of the source
+ * @param arg: the argument from user space
+ * @retval 0: OK
+ * @retval errno: Indicate the error code
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ */
+static
+long ofs_regfile_ioc_copyrange(struct file *file,
+			       struct ofs_copy_range __user *arg)
+{
+	struct ofs_copy_range cr;
+	struct fd dst;
+	u64 copied;
+	long rc;
+
+	if (copy_from_user(&cr, arg, sizeof(struct ofs_copy_range)))
+		return -EFAULT;
+	dst = fdget((int)cr.dest_fd);
+	if (dst.file == NULL)
+		return -EBADF;
+	rc = ofs_regfile_copy_range(file, cr.src_offset, dst.file,
+				    cr.dest_offset, cr.len, &copied);
+	fdput(dst);
+	if (put_user(copied, &arg->copied))
+		return -EFAULT;
+	return rc;
+}
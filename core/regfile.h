@@ -56,6 +56,14 @@ ssize_t ofs_regfile_fops_read_iter(struct kiocb *iocb, struct iov_iter *iter);
 extern
 ssize_t ofs_regfile_fops_write_iter(struct kiocb *iocb, struct iov_iter *iter);
 
+extern
+ssize_t ofs_regfile_read_iter_nowait(struct kiocb *iocb,
+				     struct iov_iter *iter);
+
+extern
+ssize_t ofs_regfile_write_iter_nowait(struct kiocb *iocb,
+				      struct iov_iter *iter);
+
 extern
 int ofs_regfile_fops_mmap(struct file *file, struct vm_area_struct *vma);
 
@@ -79,4 +87,12 @@ ssize_t ofs_regfile_fops_splice_write(struct pipe_inode_info *pipe,
 				      struct file *out, loff_t *pos,
 				      size_t len, unsigned int flags);
 
+extern
+long ofs_regfile_fops_fallocate(struct file *file, int mode, loff_t offset,
+				loff_t len);
+
+extern
+long ofs_regfile_fops_unlocked_ioctl(struct file *file, unsigned int cmd,
+				     unsigned long args);
+
 #endif /* regfile.h */
@@ -20,6 +20,10 @@
 #include "dir.h"
 #include "regfile.h"
 #include "singularity.h"
+#include "lazy.h"
+#include "dindex.h"
+#include "huge.h"
+#include "ofs_ioctl.h"
 
 /******** ******** ******** ******** ******** ******** ******** ********
  ******** ******** ********       macro       ******** ******** ********
@@ -109,6 +113,10 @@ ssize_t ofs_singularity_ofsops_read(struct file *file, char __user *buf,
  * @retval errno: Indicate the error code
  *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
  *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * If the singularity is opened with O_NONBLOCK and option
+ *   "nowait" is set, see
+ *   <em>ofs_regfile_read_iter_nowait()</em>.
  */
 ssize_t ofs_singularity_ofsops_read_iter(struct kiocb *iocb,
 					 struct iov_iter *iter)
@@ -116,6 +124,8 @@ ssize_t ofs_singularity_ofsops_read_iter(struct kiocb *iocb,
 	ofs_dbg("iocb<%p>; dentry<%p>==\"%pd\"; iter<%p>\n",
 		iocb, iocb->ki_filp->f_path.dentry,
 		iocb->ki_filp->f_path.dentry, iter);
+	if (OFS_FILE_NOWAIT(iocb->ki_filp))
+		return ofs_regfile_read_iter_nowait(iocb, iter);
 	return generic_file_read_iter(iocb, iter);
 }
 
@@ -146,6 +156,10 @@ ssize_t ofs_singularity_ofsops_write(struct file *file, const char __user *buf,
  * @retval errno: Indicate the error code
  *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
  *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * If the singularity is opened with O_NONBLOCK and option
+ *   "nowait" is set, see
+ *   <em>ofs_regfile_write_iter_nowait()</em>.
  */
 ssize_t ofs_singularity_ofsops_write_iter(struct kiocb *iocb,
 					  struct iov_iter *iter)
@@ -153,6 +167,8 @@ ssize_t ofs_singularity_ofsops_write_iter(struct kiocb *iocb,
 	ofs_dbg("iocb<%p>; dentry<%p>=\"%pd\"; iter<%p>\n",
 		iocb, iocb->ki_filp->f_path.dentry,
 		iocb->ki_filp->f_path.dentry, iter);
+	if (OFS_FILE_NOWAIT(iocb->ki_filp))
+		return ofs_regfile_write_iter_nowait(iocb, iter);
 	return generic_file_write_iter(iocb, iter);
 }
 
@@ -168,7 +184,7 @@ int ofs_singularity_ofsops_mmap(struct file *file, struct vm_area_struct *vma)
 {
 	ofs_dbg("file<%p>; dentry<%p>==\"%pd\"; vma<%p>;\n",
 		file, file->f_path.dentry, file->f_path.dentry, vma);
-	return generic_file_mmap(file, vma);
+	return ofs_huge_mmap(file, vma);
 }
 
 /******** inode_operations ********/
@@ -184,25 +200,17 @@ int ofs_singularity_ofsops_mmap(struct file *file, struct vm_area_struct *vma)
  */
 int ofs_singularity_fops_open(struct inode *inode, struct file *file)
 {
-	static struct qstr cursor_name = QSTR_INIT(".", 1);
 	struct ofs_inode *oi = OFS_INODE(inode);
 	struct ofs_file *of;
 	int rc;
 
 	ofs_dbg("oi<%p>; file<%p>; dentry<%p>==\"%pd\";\n",
 		oi, file, file->f_path.dentry, file->f_path.dentry);
-	
 	of = kmem_cache_alloc(ofs_file_cache, GFP_KERNEL);
 	if (IS_ERR_OR_NULL(of)) {
 		rc = -ENOMEM;
 		goto out_return;
 	}
-	of->cursor = d_alloc(file->f_path.dentry, &cursor_name);
-	if (IS_ERR_OR_NULL(of->cursor)) {
-		rc = -ENOMEM;
-		goto out_cache_free;
-	}
-	ofs_dbg("entry: magic dentry, cursor<%p>\n", of->cursor);
 	file->private_data = of;
 
 	if (oi->ofsops) {
@@ -214,13 +222,11 @@ int ofs_singularity_fops_open(struct inode *inode, struct file *file)
 			}
 		}
 	}
+	atomic_inc(&oi->nr_opened);
 	return 0;
 
 out_ofsops_put:
 	ofsops_put(oi->ofsops);
-	dput(of->cursor);
-	of->cursor = NULL;
-out_cache_free:
 	kmem_cache_free(ofs_file_cache, of);
 out_return:
 	return rc;
@@ -246,25 +252,14 @@ int ofs_singularity_fops_release(struct inode *inode, struct file *file)
 			oi->ofsops->release(oi, file);
 		ofsops_put(oi->ofsops);
 	}
+	atomic_dec(&oi->nr_opened);
 
 	of = (struct ofs_file *)file->private_data;
-	ofs_dbg("entry: magic dentry, cursor<%p>\n", of->cursor);
-	dput(of->cursor);
-	of->cursor = NULL;
 	kmem_cache_free(ofs_file_cache, of);
 
 	return 0;
 }
 
-/**
- * @brief Get the inode type.
- */
-static __always_inline
-unsigned char ofs_dt_type(struct inode *inode)
-{
-	return (inode->i_mode >> 12) & 15;
-}
-
 /**
  * @brief ofs file operation for singularity: llseek
  * @param file: file struct of the opened singularity
@@ -277,15 +272,14 @@ unsigned char ofs_dt_type(struct inode *inode)
  *                 /usr/include/asm-generic/errno-base.h</a></b>).
  * @note
  * * When llseek callback is used with readdir (iterate). The position is the
- *   sequence number of child dentry in the directory. It is the relevant of
- *   the order that child dentries linked in the list d_subdirs.
+ *   position of the child in the ordered index of the singularity. The child
+ *   is found by the next readdir in O(log n).
  */
 loff_t ofs_singularity_fops_llseek(struct file *file, loff_t offset, int whence)
 {
 	struct dentry *dentry = file->f_path.dentry;
 	struct ofs_inode *oi = OFS_INODE(dentry->d_inode);
-	struct ofs_file *of = file->private_data;
-	
+
 	ofs_dbg("oi<%p>; file<%p>; dentry<%p>==\"%pd\"; "
 		"offset==%lld; whence==%d;\n",
 		oi, file, file->f_path.dentry, file->f_path.dentry,
@@ -297,45 +291,8 @@ loff_t ofs_singularity_fops_llseek(struct file *file, loff_t offset, int whence)
 		return -ENOSYS;
 	}
 
-	ofs_dbg("entry: magic dentry<%p>\n", of->cursor);
-	mutex_lock(&oi->inode.i_mutex);
-	switch (whence) {
-		case 1:
-			offset += file->f_pos;
-		case 0:
-			if (offset >= 0)
-				break;
-		default:
-			mutex_unlock(&oi->inode.i_mutex);
-			return -EINVAL;
-	}
-	if (offset != file->f_pos) {
-		file->f_pos = offset;
-		if (file->f_pos >= 2) {
-			struct list_head *p;
-			struct dentry *cursor = of->cursor;
-			loff_t n = file->f_pos - 2;
-
-			spin_lock(&dentry->d_lock);
-			/* d_lock not required for cursor */
-			list_del(&cursor->d_child);
-			p = dentry->d_subdirs.next;
-			while (n && p != &dentry->d_subdirs) {
-				struct dentry *next;
-				next = list_entry(p, struct dentry, d_child);
-				spin_lock_nested(&next->d_lock,
-						 DENTRY_D_LOCK_NESTED);
-				if (ofs_simple_positive(next))
-					n--;
-				spin_unlock(&next->d_lock);
-				p = p->next;
-			}
-			list_add_tail(&cursor->d_child, p);
-			spin_unlock(&dentry->d_lock);
-		}
-	}
-	mutex_unlock(&oi->inode.i_mutex);
-	return offset;
+	ofs_dbg("entry: magic dentry\n");
+	return ofs_dindex_llseek(file, offset, whence);
 }
 
 /**
@@ -345,14 +302,13 @@ loff_t ofs_singularity_fops_llseek(struct file *file, loff_t offset, int whence)
  * @retval errno: Indicate the error code
  *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
  *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * See @ref ofs_dir_fops_iterate() about locking.
  */
 int ofs_singularity_fops_iterate(struct file *file, struct dir_context *ctx)
 {
 	struct dentry *dentry = file->f_path.dentry;
 	struct ofs_inode *oi = OFS_INODE(dentry->d_inode);
-	struct ofs_file *of = file->private_data;
-	struct dentry *cursor = of->cursor;
-	struct list_head *p, *q = &cursor->d_child;
 
 	ofs_dbg("oi<%p>; file<%p>; dentry<%p>==\"%pd\"; ctx<%p>;\n",
 		oi, file, file->f_path.dentry, file->f_path.dentry, ctx);
@@ -361,35 +317,7 @@ int ofs_singularity_fops_iterate(struct file *file, struct dir_context *ctx)
 		return -ENOSYS;
 
 	ofs_dbg("entry: magic dentry\n");
-	if (!dir_emit_dots(file, ctx))
-		return 0;
-	spin_lock(&dentry->d_lock);
-	if (ctx->pos == 2)
-		list_move(q, &dentry->d_subdirs);
-
-	for (p = q->next; p != &dentry->d_subdirs; p = p->next) {
-		struct dentry *next = list_entry(p, struct dentry, d_child);
-		spin_lock_nested(&next->d_lock, DENTRY_D_LOCK_NESTED);
-		if (!ofs_simple_positive(next)) {
-			spin_unlock(&next->d_lock);
-			continue;
-		}
-
-		spin_unlock(&next->d_lock);
-		spin_unlock(&dentry->d_lock);
-		if (!dir_emit(ctx, next->d_name.name, next->d_name.len,
-			      next->d_inode->i_ino, ofs_dt_type(next->d_inode)))
-			return 0;
-		spin_lock(&dentry->d_lock);
-		spin_lock_nested(&next->d_lock, DENTRY_D_LOCK_NESTED);
-		/* next is still alive */
-		list_move(q, p);
-		spin_unlock(&next->d_lock);
-		p = q;
-		ctx->pos++;
-	}
-	spin_unlock(&dentry->d_lock);
-	return 0;
+	return ofs_dindex_iterate(file, ctx);
 }
 
 /**
@@ -432,6 +360,10 @@ int ofs_singularity_fops_mmap(struct file *file, struct vm_area_struct *vma)
  * @retval errno: Indicate the error code
  *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
  *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * @ref OFS_IOC_READDIRPLUS and @ref OFS_IOC_UNLINKBATCH are handled by ofs
+ *   if the singularity is opened by its magic dentry. Other commands go to
+ *   the ofs operations.
  */
 long ofs_singularity_fops_unlocked_ioctl(struct file *file, unsigned int cmd,
 					 unsigned long args)
@@ -440,6 +372,18 @@ long ofs_singularity_fops_unlocked_ioctl(struct file *file, unsigned int cmd,
 
 	ofs_dbg("oi<%p>; file<%p>; dentry<%p>==\"%pd\"; cmd==%u; args==%lu;\n",
 		oi, file, file->f_path.dentry, file->f_path.dentry, cmd, args);
+	if (oi->magic == file->f_path.dentry) {
+		switch (cmd) {
+		case OFS_IOC_READDIRPLUS:
+			return ofs_dindex_readdirplus(file,
+					(struct ofs_readdirplus __user *)args);
+		case OFS_IOC_UNLINKBATCH:
+			return ofs_dir_unlinkbatch(file,
+					(struct ofs_unlinkbatch __user *)args);
+		default:
+			break;
+		}
+	}
 	if (oi->ofsops && oi->ofsops->ioctl)
 		return oi->ofsops->ioctl(file, cmd, args);
 	return -ENOSYS;
@@ -0,0 +1,450 @@
+/**
+ * @file
+ * @brief C source of the ofs (octagram filesystem, outlandish filesystem, or
+ *        odd filesystem) kernel module
+ * @author Octagram Sun <octagram@qq.com>
+ * @version 0.1.0
+ * @date 2015
+ * @copyright Octagram Sun <octagram@qq.com>
+ *
+ * @note
+ * C source about the swap-backed regular files. 1 tab == 8 spaces.
+ * @note
+ * The page cache of ofs is unevictable and has no writeback, because linux
+ * 3.19 doesn't export the swap cache to modules. With option "swap", the
+ * data of each regular file is kept in an internal shmem file instead,
+ * which is created by <em>shmem_file_setup()</em> together with the inode.
+ * The shmem pages are on the anonymous LRU, so the cold ones are written
+ * to swap under memory pressure, and swapped in by the next read, write
+ * or fault.
+ * @note
+ * The ofs inode keeps its own attributes, and mirrors the size of the
+ * shmem file. mmap maps the shmem file directly, the same as ashmem does.
+ * Singularities are not affected.
+ */
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ******** ********    header files   ******** ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+#include "ofs.h"
+#include "fs.h"
+#include "log.h"
+#include "regfile.h"
+#include "swap.h"
+#include <linux/aio.h>
+#include <linux/file.h>
+#include <linux/falloc.h>
+#include <linux/shmem_fs.h>
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ******** ********       macro       ******** ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ******** ********       types       ******** ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ********         function prototypes         ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ******** ********   .sdata & .data  ******** ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+/* inode_operations */
+const struct inode_operations ofs_swap_iops = {
+	.setattr = ofs_swap_iops_setattr,
+	.getattr = ofs_swap_iops_getattr,
+};
+
+/* file_operations */
+const struct file_operations ofs_swap_fops = {
+	.owner = THIS_MODULE,
+	.llseek = ofs_swap_fops_llseek,
+	.read = ofs_regfile_fops_read,
+	.write = ofs_regfile_fops_write,
+	.read_iter = ofs_swap_fops_read_iter,
+	.write_iter = ofs_swap_fops_write_iter,
+	.mmap = ofs_swap_fops_mmap,
+	.open = ofs_regfile_fops_open,
+	.release = ofs_regfile_fops_release,
+	.fsync = ofs_regfile_fops_fsync,
+	.splice_read = ofs_swap_fops_splice_read,
+	.splice_write = ofs_regfile_fops_splice_write,
+	.fallocate = ofs_swap_fops_fallocate,
+};
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ********      function implementations       ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+/**
+ * @brief Create the shmem file of a regfile.
+ * @param inode: inode of the regfile
+ * @retval 0: OK
+ * @retval errno: Indicate the error code
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * The memory is committed page by page (VM_NORESERVE), the same as the
+ *   files of tmpfs.
+ */
+int ofs_swap_attach(struct inode *inode)
+{
+	struct file *shm;
+
+	shm = shmem_file_setup("ofs", 0, VM_NORESERVE);
+	if (IS_ERR(shm)) {
+		ofs_err("inode<%p>; Can't setup shmem file (%ld).\n",
+			inode, PTR_ERR(shm));
+		return PTR_ERR(shm);
+	}
+	OFS_INODE(inode)->swap = shm;
+	return 0;
+}
+
+/**
+ * @brief Release the shmem file of a regfile.
+ * @param inode: inode of the regfile
+ * @note
+ * * It is called by <em>ofs_sops_destroy_inode()</em>. The pages and the
+ *   swap entries are freed when the shmem file is released.
+ */
+void ofs_swap_detach(struct inode *inode)
+{
+	struct ofs_inode *oi = OFS_INODE(inode);
+	struct ofs_root *root = (struct ofs_root *)inode->i_sb->s_fs_info;
+
+	ofs_unacct_blocks(root, oi->swap_pages);
+	oi->swap_pages = 0;
+	fput(oi->swap);
+	oi->swap = NULL;
+}
+
+/**
+ * @brief Reserve pages of option "size" before the shmem file grows.
+ * @param inode: inode of the regfile
+ * @param pos: position to write
+ * @param len: length to write
+ * @retval 0: OK.
+ * @retval -ENOSPC: the limit is reached.
+ * @note
+ * * inode->i_mutex must be held. The reservation is corrected by
+ *   @ref ofs_swap_sync() afterwards.
+ * * Nothing is reserved if option "size" is unlimited.
+ */
+static
+int ofs_swap_reserve(struct inode *inode, loff_t pos, loff_t len)
+{
+	struct ofs_inode *oi = OFS_INODE(inode);
+	struct ofs_root *root = (struct ofs_root *)inode->i_sb->s_fs_info;
+	long pages;
+
+	if (!ACCESS_ONCE(root->mo.max_blocks) || len <= 0)
+		return 0;
+	pages = ((pos + len + PAGE_CACHE_SIZE - 1) >> PAGE_CACHE_SHIFT) -
+		(pos >> PAGE_CACHE_SHIFT);
+	if (ofs_acct_blocks(root, pages))
+		return -ENOSPC;
+	oi->swap_pages += pages;
+	return 0;
+}
+
+/**
+ * @brief Mirror the size of the shmem file, and charge its pages to option
+ *        "size".
+ * @param inode: inode of the regfile
+ * @note
+ * * inode->i_mutex must be held.
+ * * The pages are counted by the blocks of the shmem inode, including the
+ *   pages in swap. Pages allocated by faults of shared mappings are charged
+ *   at the next write, truncate or fallocate.
+ */
+static
+void ofs_swap_sync(struct inode *inode)
+{
+	struct ofs_inode *oi = OFS_INODE(inode);
+	struct ofs_root *root = (struct ofs_root *)inode->i_sb->s_fs_info;
+	struct inode *si = file_inode(oi->swap);
+	unsigned long pages;
+
+	i_size_write(inode, i_size_read(si));
+	pages = (unsigned long)(si->i_blocks >> (PAGE_CACHE_SHIFT - 9));
+	percpu_counter_add(&root->used_blocks,
+			   (s64)pages - (s64)oi->swap_pages);
+	oi->swap_pages = pages;
+}
+
+/******** ******** inode_operations ******** ********/
+/**
+ * @brief ofs inode operation for swap-backed regfile: set attributes
+ * @param dentry: target
+ * @param iattr: the new attributes
+ * @return error code
+ * @retval 0: OK
+ * @retval errno: Indicate the error code
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * The same as <em>simple_setattr()</em>, except that the size is changed
+ *   on the shmem file.
+ */
+int ofs_swap_iops_setattr(struct dentry *dentry, struct iattr *iattr)
+{
+	struct inode *inode = dentry->d_inode;
+	struct file *shm = OFS_INODE(inode)->swap;
+	struct inode *si = file_inode(shm);
+	struct iattr sattr;
+	int rc;
+
+	rc = inode_change_ok(inode, iattr);
+	if (rc)
+		return rc;
+
+	if (iattr->ia_valid & ATTR_SIZE) {
+		memset(&sattr, 0, sizeof(sattr));
+		sattr.ia_valid = ATTR_SIZE;
+		sattr.ia_size = iattr->ia_size;
+		mutex_lock(&si->i_mutex);
+		rc = si->i_op->setattr(shm->f_path.dentry, &sattr);
+		mutex_unlock(&si->i_mutex);
+		if (rc)
+			return rc;
+		ofs_swap_sync(inode);
+	}
+	setattr_copy(inode, iattr);
+	mark_inode_dirty(inode);
+	return 0;
+}
+
+/**
+ * @brief ofs inode operation for swap-backed regfile: get attributes
+ * @param mnt: VFS mount instance
+ * @param dentry: target
+ * @param stat: the buffur to receive the attributes
+ * @retval 0: OK
+ * @note
+ * * The blocks are those of the shmem file, in memory or in swap.
+ */
+int ofs_swap_iops_getattr(struct vfsmount *mnt, struct dentry *dentry,
+			  struct kstat *stat)
+{
+	struct inode *inode = dentry->d_inode;
+
+	generic_fillattr(inode, stat);
+	stat->blocks = file_inode(OFS_INODE(inode)->swap)->i_blocks;
+	return 0;
+}
+
+/******** ******** file_operations ******** ********/
+/**
+ * @brief ofs file operation for swap-backed regfile: llseek
+ * @param file: file struct of the opened regfile
+ * @param offset: position
+ * @param whence: SEEK_SET, SEEK_CUR, SEEK_END, SEEK_DATA or SEEK_HOLE
+ *                (See man lseek for detail.)
+ * @return the position
+ * @retval >0: the position
+ * @retval errno: Indicate the error code
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * SEEK_DATA and SEEK_HOLE are answered by the shmem file.
+ */
+loff_t ofs_swap_fops_llseek(struct file *file, loff_t offset, int whence)
+{
+	struct inode *inode = file_inode(file);
+	struct file *shm = OFS_INODE(inode)->swap;
+	loff_t rc;
+
+	ofs_dbg("file<%p>; dentry<%p>==\"%pd\"; offset==%lld; whence==%d;\n",
+		file, file->f_path.dentry, file->f_path.dentry, offset, whence);
+	if (whence != SEEK_DATA && whence != SEEK_HOLE)
+		return generic_file_llseek(file, offset, whence);
+	rc = shm->f_op->llseek(shm, offset, whence);
+	if (rc < 0)
+		return rc;
+	return vfs_setpos(file, rc, inode->i_sb->s_maxbytes);
+}
+
+/**
+ * @brief ofs file operation for swap-backed regfile: sync read
+ * @param iocb: the I/O control block
+ * @param iter: the destination
+ * @return real data size that read from the regfile
+ * @retval >=0: size
+ * @retval errno: Indicate the error code
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * The data is read from the shmem file. Pages in swap are read back.
+ */
+ssize_t ofs_swap_fops_read_iter(struct kiocb *iocb, struct iov_iter *iter)
+{
+	struct file *file = iocb->ki_filp;
+	struct file *shm = FILE_TO_OFS_INODE(file)->swap;
+	struct kiocb kiocb;
+	ssize_t rc;
+
+	ofs_dbg("iocb<%p>; dentry<%p>==\"%pd\"; iter<%p>\n",
+		iocb, file->f_path.dentry, file->f_path.dentry, iter);
+	init_sync_kiocb(&kiocb, shm);
+	kiocb.ki_pos = iocb->ki_pos;
+	rc = shm->f_op->read_iter(&kiocb, iter);
+	iocb->ki_pos = kiocb.ki_pos;
+	file_accessed(file);
+	return rc;
+}
+
+/**
+ * @brief ofs file operation for swap-backed regfile: sync write
+ * @param iocb: the I/O control block
+ * @param iter: the source
+ * @return real data size that wrote into the regfile
+ * @retval >=0: size
+ * @retval -ENOSPC: the limit of option "size" is reached.
+ * @retval errno: Indicate the error code
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * The data is written into the shmem file under inode->i_mutex of the
+ *   regfile, which is taken before the one of the shmem file.
+ */
+ssize_t ofs_swap_fops_write_iter(struct kiocb *iocb, struct iov_iter *iter)
+{
+	struct file *file = iocb->ki_filp;
+	struct inode *inode = file_inode(file);
+	struct file *shm = OFS_INODE(inode)->swap;
+	struct kiocb kiocb;
+	ssize_t rc, err;
+
+	ofs_dbg("iocb<%p>; dentry<%p>=\"%pd\"; iter<%p>\n",
+		iocb, file->f_path.dentry, file->f_path.dentry, iter);
+	mutex_lock(&inode->i_mutex);
+	if (file->f_flags & O_APPEND)
+		iocb->ki_pos = i_size_read(inode);
+	rc = ofs_swap_reserve(inode, iocb->ki_pos, iov_iter_count(iter));
+	if (rc)
+		goto out_unlock;
+	rc = file_remove_suid(file);
+	if (rc)
+		goto out_sync;
+	rc = file_update_time(file);
+	if (rc)
+		goto out_sync;
+
+	init_sync_kiocb(&kiocb, shm);
+	kiocb.ki_pos = iocb->ki_pos;
+	rc = shm->f_op->write_iter(&kiocb, iter);
+	iocb->ki_pos = kiocb.ki_pos;
+
+out_sync:
+	ofs_swap_sync(inode);
+out_unlock:
+	mutex_unlock(&inode->i_mutex);
+	if (rc > 0) {
+		err = generic_write_sync(file, iocb->ki_pos - rc, rc);
+		if (err < 0)
+			rc = err;
+	}
+	return rc;
+}
+
+/**
+ * @brief ofs file operation for swap-backed regfile: mmap
+ * @param file: file struct of the opened regfile
+ * @param vma: virtual memory
+ * @retval 0: OK
+ * @retval errno: Indicate the error code
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * The vma maps the shmem file instead of the regfile, so the faults and
+ *   the reclaim are handled by shmem.
+ */
+int ofs_swap_fops_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct file *shm = FILE_TO_OFS_INODE(file)->swap;
+	int rc;
+
+	ofs_dbg("file<%p>; dentry<%p>==\"%pd\"; vma<%p>;\n",
+		file, file->f_path.dentry, file->f_path.dentry, vma);
+	rc = shm->f_op->mmap(shm, vma);
+	if (rc)
+		return rc;
+	fput(vma->vm_file);
+	vma->vm_file = get_file(shm);
+	file_accessed(file);
+	return 0;
+}
+
+/**
+ * @brief ofs file operation for swap-backed regfile: splice read
+ * @param in: file struct of the opened regfile
+ * @param pos: position to read
+ * @param pipe: the destination
+ * @param len: length to read
+ * @param flags: SPLICE_F_*
+ * @return real data size that spliced into the pipe
+ * @retval >=0: size
+ * @retval errno: Indicate the error code
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ */
+ssize_t ofs_swap_fops_splice_read(struct file *in, loff_t *pos,
+				  struct pipe_inode_info *pipe,
+				  size_t len, unsigned int flags)
+{
+	struct file *shm = FILE_TO_OFS_INODE(in)->swap;
+	ssize_t rc;
+
+	rc = shm->f_op->splice_read(shm, pos, pipe, len, flags);
+	file_accessed(in);
+	return rc;
+}
+
+/**
+ * @brief ofs file operation for swap-backed regfile: fallocate
+ * @param file: file struct of the opened regfile
+ * @param mode: 0, FALLOC_FL_KEEP_SIZE or
+ *              FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE
+ * @param offset: start of the range
+ * @param len: length of the range
+ * @retval 0: OK
+ * @retval -ENOSPC: the limit of option "size" is reached.
+ * @retval -EOPNOTSUPP: other modes
+ * @retval errno: Indicate the error code
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * The range is allocated or punched in the shmem file.
+ */
+long ofs_swap_fops_fallocate(struct file *file, int mode, loff_t offset,
+			     loff_t len)
+{
+	struct inode *inode = file_inode(file);
+	struct file *shm = OFS_INODE(inode)->swap;
+	long rc;
+
+	ofs_dbg("file<%p>; dentry<%p>==\"%pd\"; mode==0x%x; "
+		"offset==%lld; len==%lld;\n",
+		file, file->f_path.dentry, file->f_path.dentry, mode,
+		offset, len);
+	if (shm->f_op->fallocate == NULL)
+		return -EOPNOTSUPP;
+	mutex_lock(&inode->i_mutex);
+	if (!(mode & FALLOC_FL_PUNCH_HOLE)) {
+		rc = ofs_swap_reserve(inode, offset, len);
+		if (rc)
+			goto out_unlock;
+	}
+	rc = shm->f_op->fallocate(shm, mode, offset, len);
+	ofs_swap_sync(inode);
+	if (rc == 0) {
+		inode->i_ctime = CURRENT_TIME;
+		if (mode & FALLOC_FL_PUNCH_HOLE)
+			inode->i_mtime = inode->i_ctime;
+	}
+out_unlock:
+	mutex_unlock(&inode->i_mutex);
+	return rc;
+}
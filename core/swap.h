@@ -0,0 +1,72 @@
+/**
+ * @file
+ * @brief C header for the ofs (octagram filesystem, outlandish filesystem, or
+ *        odd filesystem) kernel module
+ * @author Octagram Sun <octagram@qq.com>
+ * @version 0.1.0
+ * @date 2015
+ * @copyright Octagram Sun <octagram@qq.com>
+ *
+ * @note
+ * C header about the swap-backed regular files, is used in ofs internal.
+ * 1 tab == 8 spaces.
+ */
+
+#ifndef __OFS_SWAP_H__
+#define __OFS_SWAP_H__
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ******** ********    header files   ******** ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+#include <linux/types.h>
+#include <linux/fs.h>
+#include <linux/mm.h>
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ******** ********       macro       ******** ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ********         function prototypes         ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+extern
+int ofs_swap_attach(struct inode *inode);
+
+extern
+void ofs_swap_detach(struct inode *inode);
+
+/* inode_operations */
+extern
+int ofs_swap_iops_setattr(struct dentry *dentry, struct iattr *iattr);
+
+extern
+int ofs_swap_iops_getattr(struct vfsmount *mnt, struct dentry *dentry,
+			  struct kstat *stat);
+
+/* file_operations */
+extern
+loff_t ofs_swap_fops_llseek(struct file *file, loff_t offset, int whence);
+
+extern
+ssize_t ofs_swap_fops_read_iter(struct kiocb *iocb, struct iov_iter *iter);
+
+extern
+ssize_t ofs_swap_fops_write_iter(struct kiocb *iocb, struct iov_iter *iter);
+
+extern
+int ofs_swap_fops_mmap(struct file *file, struct vm_area_struct *vma);
+
+extern
+ssize_t ofs_swap_fops_splice_read(struct file *in, loff_t *pos,
+				  struct pipe_inode_info *pipe,
+				  size_t len, unsigned int flags);
+
+extern
+long ofs_swap_fops_fallocate(struct file *file, int mode, loff_t offset,
+			     loff_t len);
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ******** ********   .sdata & .data  ******** ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+
+#endif /* swap.h */
@@ -17,6 +17,7 @@
 #include "ofs.h"
 #include "fs.h"
 #include "log.h"
+#include "ksym.h"
 #include "symlink.h"
 
 /******** ******** ******** ******** ******** ******** ******** ********
@@ -33,6 +34,9 @@
 static
 char *ofs_get_page_link(struct inode *inode, struct page **ppage);
 
+static
+int ofs_jump_magic_link(struct dentry *dentry, struct nameidata *nd);
+
 /******** ******** ******** ******** ******** ******** ******** ********
  ******** ******** ********   .sdata & .data  ******** ******** ********
  ******** ******** ******** ******** ******** ******** ******** ********/
@@ -44,6 +48,12 @@ const struct inode_operations ofs_symlink_iops = {
 	.put_link = ofs_symlink_iops_put_link,
 };
 
+/* inode_operations of fast symlink */
+const struct inode_operations ofs_fast_symlink_iops = {
+	.readlink = ofs_fast_symlink_iops_readlink,
+	.follow_link = ofs_fast_symlink_iops_follow_link,
+};
+
 /******** ******** ******** ******** ******** ******** ******** ********
  ******** ********      function implementations       ******** ********
  ******** ******** ******** ******** ******** ******** ******** ********/
@@ -72,6 +82,31 @@ static char *ofs_get_page_link(struct inode *inode, struct page **ppage)
 	return kaddr;
 }
 
+/**
+ * @brief jump to the target of a magic symlink by the oid
+ * @param dentry: dentry of the symlink
+ * @param nd: nameidata to process the path in kernel
+ * @retval 0: jumped
+ * @retval -EAGAIN: Not a magic symlink, or the oid can't be used. Follow
+ *                  the path string instead.
+ * @retval errno: Indicate the error code
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ */
+static
+int ofs_jump_magic_link(struct dentry *dentry, struct nameidata *nd)
+{
+	struct path path;
+	int rc;
+
+	if (OFS_INODE(dentry->d_inode)->magic != dentry)
+		return -EAGAIN;
+	rc = ofs_get_symlink_target(dentry, nd->path.mnt, &path);
+	if (!rc)
+		CALL_KSYM(nd_jump_link, nd, &path); /* consume path */
+	return rc;
+}
+
 /******** inode_operations ********/
 /**
  * @brief ofs inode operation for symlink: readlink
@@ -84,14 +119,15 @@ static char *ofs_get_page_link(struct inode *inode, struct page **ppage)
  *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
  *                 /usr/include/asm-generic/errno-base.h</a></b>).
  * @note
- * * TODO
+ * * The string is read from the page, because follow_link of a magic
+ *   symlink jumps to the target without a string.
  * @remark
  * * The function can't be used in ISR (Interrupt Service Routine).
  */
 int ofs_symlink_iops_readlink(struct dentry *dentry, char __user * buf,
 			      int buflen)
 {
-	return generic_readlink(dentry, buf, buflen);
+	return page_readlink(dentry, buf, buflen);
 }
 
 /**
@@ -105,7 +141,9 @@ int ofs_symlink_iops_readlink(struct dentry *dentry, char __user * buf,
  *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
  *                 /usr/include/asm-generic/errno-base.h</a></b>).
  * @note
- * * TODO
+ * * A magic symlink jumps to the magic dentry of its target by the oid,
+ *   like the symlinks in procfs. It costs one index lookup whatever the
+ *   depth of the target is. If it can't, the path string is followed.
  * @remark
  * * The function can't be used in ISR (Interrupt Service Routine).
  * @sa ofs_symlink_iops_put_link()
@@ -114,6 +152,11 @@ void *ofs_symlink_iops_follow_link(struct dentry *dentry, struct nameidata *nd)
 {
 	struct page *page = NULL;
 	char *symlink;
+	int rc;
+
+	rc = ofs_jump_magic_link(dentry, nd);
+	if (rc != -EAGAIN)
+		return ERR_PTR(rc); /* NULL if jumped */
 	symlink = ofs_get_page_link(dentry->d_inode, &page);
 	if (IS_ERR_OR_NULL(symlink))
 		return symlink;
@@ -144,3 +187,55 @@ void ofs_symlink_iops_put_link(struct dentry *dentry, struct nameidata *nd,
 		page_cache_release(page);
 	}
 }
+
+/******** inode_operations of fast symlink ********/
+/**
+ * @brief ofs inode operation for fast symlink: readlink
+ * @param dentry: dentry of target symlink
+ * @param buffer: user buffer to receive the symlink string
+ * @param buflen: buffer size
+ * @return length of the string copied
+ * @retval errno: Indicate the error code
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * The target string is in a slab string, not in a page.
+ */
+int ofs_fast_symlink_iops_readlink(struct dentry *dentry, char __user *buf,
+				   int buflen)
+{
+	struct inode *inode = dentry->d_inode;
+	int len = inode->i_size;
+
+	if (len > buflen)
+		len = buflen;
+	if (copy_to_user(buf, OFS_INODE(inode)->link, len))
+		return -EFAULT;
+	return len;
+}
+
+/**
+ * @brief ofs inode operation for fast symlink: follow_link
+ * @param dentry: dentry of target symlink
+ * @param nd: nameidata to process the path in kernel
+ * @retval NULL: OK. There is nothing to put.
+ * @retval errno: Indicate the error code
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * Neither read_mapping_page() nor kmap() is needed. The string lives as
+ *   long as the inode.
+ * * Kernel 3.19 always leaves RCU-walk to follow a symlink, so the string
+ *   is read in ref-walk.
+ */
+void *ofs_fast_symlink_iops_follow_link(struct dentry *dentry,
+					struct nameidata *nd)
+{
+	int rc;
+
+	rc = ofs_jump_magic_link(dentry, nd);
+	if (rc != -EAGAIN)
+		return ERR_PTR(rc); /* NULL if jumped */
+	nd_set_link(nd, OFS_INODE(dentry->d_inode)->link);
+	return NULL;
+}
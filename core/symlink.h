@@ -42,6 +42,15 @@ extern
 void ofs_symlink_iops_put_link(struct dentry *dentry, struct nameidata *nd,
 			       void *cookie);
 
+/******** inode_operations of fast symlink ********/
+extern
+int ofs_fast_symlink_iops_readlink(struct dentry *dentry, char __user *buf,
+				   int buflen);
+
+extern
+void *ofs_fast_symlink_iops_follow_link(struct dentry *dentry,
+					struct nameidata *nd);
+
 /******** ******** ******** ******** ******** ******** ******** ********
  ******** ******** ********   .sdata & .data  ******** ******** ********
  ******** ******** ******** ******** ******** ******** ******** ********/
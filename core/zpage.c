@@ -0,0 +1,747 @@
+/**
+ * @file
+ * @brief C source of the ofs (octagram filesystem, outlandish filesystem, or
+ *        odd filesystem) kernel module
+ * @author Octagram Sun <octagram@qq.com>
+ * @version 0.1.0
+ * @date 2015
+ * @copyright Octagram Sun <octagram@qq.com>
+ *
+ * @note
+ * C source about the compressed store of cold pages. 1 tab == 8 spaces.
+ * @note
+ * With option "compress", a scanner walks the regular files of the ofs
+ * every interval. A page that is not accessed during a whole interval is
+ * compressed by the crypto compression API, kept in the radix tree
+ * <b><em>zpages</em></b> of the ofs inode, and removed from the page cache.
+ * When the page is read, written or faulted again, <em>readpage</em> or
+ * <em>write_begin</em> of @ref ofs_aops decompresses it back into the page
+ * cache.
+ * @note
+ * A page is cold if PG_referenced, which is set by every read and write of
+ * the page cache, stays clear from one scan to the next. Mapped pages are
+ * never compressed. Clean pages hold zeros only (see
+ * <em>ofs_set_page_dirty_no_writeback()</em>), so they are dropped instead
+ * of compressed.
+ * @note
+ * A compressed page keeps the charge of its page in option "size", so it
+ * can always be decompressed.
+ * @note
+ * With option "dedup", the compressed pages are also hashed by content in
+ * the store. A cold page identical to a page compressed already, in any
+ * regfile of the ofs, takes a reference to it instead of a copy, so many
+ * identical pages cost one compressed page. A page that can't be
+ * compressed is stored as is, then it may still be shared. Each regfile
+ * gets a private copy in its page cache again when the page is accessed,
+ * so a write never touches the shared copy.
+ * @note
+ * A cloned regfile (see @ref OFS_IOC_CLONE) shares the compressed pages of
+ * its source in the same way, with or without option "dedup".
+ */
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ******** ********    header files   ******** ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+#include "ofs.h"
+#include "fs.h"
+#include "log.h"
+#include "ksym.h"
+#include "zpage.h"
+#include "huge.h"
+#include <linux/pagemap.h>
+#include <linux/pagevec.h>
+#include <linux/highmem.h>
+#include <linux/slab.h>
+#include <linux/ktime.h>
+#include <linux/jhash.h>
+#include <linux/hash.h>
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ******** ********       macro       ******** ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ******** ********       types       ******** ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ********         function prototypes         ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+static
+void ofs_zstore_worker(struct work_struct *work);
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ******** ********   .sdata & .data  ******** ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+/**
+ * @brief compression algorithms, in order of preference
+ */
+static const char * const ofs_zstore_algs[] = {
+	"lz4",
+	"lzo",
+};
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ********      function implementations       ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+/******** ******** store ******** ********/
+/**
+ * @brief Free a compressed store.
+ * @param zs: the store, maybe partly constructed
+ */
+static
+void ofs_zstore_free(struct ofs_zstore *zs)
+{
+	struct crypto_comp *tfm;
+	int cpu;
+
+	if (zs->tfms) {
+		for_each_possible_cpu(cpu) {
+			tfm = *per_cpu_ptr(zs->tfms, cpu);
+			if (!IS_ERR_OR_NULL(tfm))
+				crypto_free_comp(tfm);
+		}
+		free_percpu(zs->tfms);
+	}
+	percpu_counter_destroy(&zs->load_ns);
+	percpu_counter_destroy(&zs->loads);
+	kfree(zs->htable);
+	kfree(zs->buf);
+	kfree(zs);
+}
+
+/**
+ * @brief Create a compressed store.
+ * @param root: ofs root
+ * @return the store
+ * @retval -ENOMEM: no memory
+ * @retval -ENOENT: neither lz4 nor lzo is available in the crypto API.
+ * @note
+ * * Every possible cpu gets its own compressor, the same as zswap does, so
+ *   faults on different cpus decompress in parallel.
+ */
+static
+struct ofs_zstore *ofs_zstore_new(struct ofs_root *root)
+{
+	struct ofs_zstore *zs;
+	struct crypto_comp *tfm;
+	int cpu, i, rc;
+
+	zs = kzalloc(sizeof(struct ofs_zstore), GFP_KERNEL);
+	if (zs == NULL)
+		return ERR_PTR(-ENOMEM);
+	zs->root = root;
+	INIT_DELAYED_WORK(&zs->work, ofs_zstore_worker);
+	spin_lock_init(&zs->lock);
+	atomic_long_set(&zs->nr, 0);
+	atomic_long_set(&zs->bytes, 0);
+	atomic_long_set(&zs->shared, 0);
+	atomic_long_set(&zs->cloned, 0);
+	rc = -ENOMEM;
+	zs->buf = kmalloc(2 * PAGE_CACHE_SIZE, GFP_KERNEL);
+	if (zs->buf == NULL)
+		goto out_free;
+	zs->htable = kcalloc(1 << OFS_ZBLOB_HASH_BITS,
+			     sizeof(struct hlist_head), GFP_KERNEL);
+	if (zs->htable == NULL)
+		goto out_free;
+	if (percpu_counter_init(&zs->loads, 0, GFP_KERNEL))
+		goto out_free;
+	if (percpu_counter_init(&zs->load_ns, 0, GFP_KERNEL))
+		goto out_free;
+
+	for (i = 0; i < ARRAY_SIZE(ofs_zstore_algs); i++) {
+		if (crypto_has_comp(ofs_zstore_algs[i], 0, 0))
+			break;
+	}
+	if (i == ARRAY_SIZE(ofs_zstore_algs)) {
+		ofs_err("No compression algorithm is available.\n");
+		rc = -ENOENT;
+		goto out_free;
+	}
+	zs->tfms = alloc_percpu(struct crypto_comp *);
+	if (zs->tfms == NULL)
+		goto out_free;
+	for_each_possible_cpu(cpu) {
+		tfm = crypto_alloc_comp(ofs_zstore_algs[i], 0, 0);
+		if (IS_ERR(tfm)) {
+			rc = PTR_ERR(tfm);
+			goto out_free;
+		}
+		*per_cpu_ptr(zs->tfms, cpu) = tfm;
+	}
+	ofs_dbg("root<%p>; compressor==\"%s\";\n", root, ofs_zstore_algs[i]);
+	return zs;
+
+out_free:
+	ofs_zstore_free(zs);
+	return ERR_PTR(rc);
+}
+
+/**
+ * @brief Set the interval of option "compress".
+ * @param root: ofs root
+ * @param interval: seconds. 0 stops the scanner.
+ * @retval 0: OK
+ * @retval errno: Indicate the error code
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * The store is created when the option is set for the first time, and
+ *   lives until the super block is put. The pages compressed already stay
+ *   compressed after the scanner stops, until they are accessed.
+ */
+int ofs_zstore_set(struct ofs_root *root, unsigned int interval)
+{
+	struct ofs_zstore *zs = root->zs;
+
+	if (interval == 0) {
+		ACCESS_ONCE(root->mo.compress) = 0;
+		if (zs)
+			cancel_delayed_work_sync(&zs->work);
+		return 0;
+	}
+	if (zs == NULL) {
+		zs = ofs_zstore_new(root);
+		if (IS_ERR(zs))
+			return PTR_ERR(zs);
+		ACCESS_ONCE(root->zs) = zs;
+	}
+	ACCESS_ONCE(root->mo.compress) = interval;
+	mod_delayed_work(system_long_wq, &zs->work,
+			 (unsigned long)interval * HZ);
+	return 0;
+}
+
+/**
+ * @brief Stop the scanner before the inodes are evicted.
+ * @param root: ofs root
+ */
+void ofs_zstore_stop(struct ofs_root *root)
+{
+	if (root->zs)
+		cancel_delayed_work_sync(&root->zs->work);
+}
+
+/**
+ * @brief Destroy the compressed store.
+ * @param root: ofs root
+ * @note
+ * * All inodes must be destroyed already, so no page is compressed.
+ */
+void ofs_zstore_destroy(struct ofs_root *root)
+{
+	struct ofs_zstore *zs = root->zs;
+
+	if (zs == NULL)
+		return;
+	cancel_delayed_work_sync(&zs->work);
+	ofs_dbg("compress: nr==%ld; shared==%ld; loads==%lld; load_ns==%lld;\n",
+		atomic_long_read(&zs->nr), atomic_long_read(&zs->shared),
+		percpu_counter_sum(&zs->loads),
+		percpu_counter_sum(&zs->load_ns));
+	WARN_ON(atomic_long_read(&zs->nr));
+	ofs_zstore_free(zs);
+	root->zs = NULL;
+}
+
+/******** ******** blobs ******** ********/
+/**
+ * @brief Get a compressed page holding some data.
+ * @param zs: compressed store
+ * @param data: the data
+ * @param len: length of the data
+ * @param dedup: whether option "dedup" is set
+ * @return the compressed page, with a new reference
+ * @retval NULL: no memory
+ * @note
+ * * With option "dedup", an identical compressed page is shared if there
+ *   is one, otherwise the new one is hashed. Only the scanner gets
+ *   compressed pages, so the same data is never hashed twice.
+ */
+static
+struct ofs_zblob *ofs_zblob_get(struct ofs_zstore *zs, const u8 *data,
+				unsigned int len, bool dedup)
+{
+	struct ofs_zblob *zb;
+	struct hlist_head *head;
+	u32 hash = jhash(data, len, 0);
+
+	head = &zs->htable[hash_32(hash, OFS_ZBLOB_HASH_BITS)];
+	if (dedup) {
+		spin_lock(&zs->lock);
+		hlist_for_each_entry(zb, head, node) {
+			if (zb->hash == hash && zb->len == len &&
+			    !memcmp(zb->data, data, len)) {
+				zb->ref++;
+				spin_unlock(&zs->lock);
+				atomic_long_inc(&zs->shared);
+				return zb;
+			}
+		}
+		spin_unlock(&zs->lock);
+	}
+
+	zb = kmalloc(sizeof(struct ofs_zblob),
+		     GFP_NOFS | __GFP_NORETRY | __GFP_NOWARN);
+	if (zb == NULL)
+		return NULL;
+	zb->data = kmalloc(len, GFP_NOFS | __GFP_NORETRY | __GFP_NOWARN);
+	if (zb->data == NULL) {
+		kfree(zb);
+		return NULL;
+	}
+	memcpy(zb->data, data, len);
+	INIT_HLIST_NODE(&zb->node);
+	zb->hash = hash;
+	zb->ref = 1;
+	zb->clones = 0;
+	zb->len = len;
+	if (dedup) {
+		spin_lock(&zs->lock);
+		hlist_add_head(&zb->node, head);
+		spin_unlock(&zs->lock);
+	}
+	atomic_long_add(ksize(zb) + ksize(zb->data), &zs->bytes);
+	return zb;
+}
+
+/**
+ * @brief Put a reference of a compressed page.
+ * @param zs: compressed store
+ * @param zb: the compressed page, freed with its last reference
+ * @note
+ * * References don't remember who took them, so a reference taken by a
+ *   clone is put first. zpage_dedup_bytes and zpage_clone_bytes are exact
+ *   unless a compressed page is shared both ways.
+ */
+static
+void ofs_zblob_put(struct ofs_zstore *zs, struct ofs_zblob *zb)
+{
+	bool clone;
+
+	spin_lock(&zs->lock);
+	if (--zb->ref) {
+		clone = zb->clones != 0;
+		if (clone)
+			zb->clones--;
+		spin_unlock(&zs->lock);
+		atomic_long_dec(clone ? &zs->cloned : &zs->shared);
+		return;
+	}
+	hlist_del_init(&zb->node);
+	spin_unlock(&zs->lock);
+	atomic_long_sub(ksize(zb) + ksize(zb->data), &zs->bytes);
+	kfree(zb->data);
+	kfree(zb);
+}
+
+/******** ******** scanner ******** ********/
+/**
+ * @brief Compress a cold page and remove it from the page cache.
+ * @param zs: compressed store
+ * @param inode: inode of the regfile
+ * @param page: the page, referenced by the caller
+ * @note
+ * * The page is skipped if it is locked, mapped, in a huge extent (see
+ *   option "huge"), or can't be compressed into @ref OFS_ZPAGE_MAX bytes
+ *   without option "dedup".
+ * * The page lock keeps readers and writers away: they lock the page and
+ *   find it truncated, then look it up again and get
+ *   @ref ofs_zpage_load().
+ */
+static
+void ofs_zstore_evict(struct ofs_zstore *zs, struct inode *inode,
+		      struct page *page)
+{
+	struct ofs_inode *oi = OFS_INODE(inode);
+	struct ofs_zblob *zb;
+	struct crypto_comp *tfm;
+	unsigned int len = 2 * PAGE_CACHE_SIZE;
+	bool dedup = ACCESS_ONCE(zs->root->mo.dedup);
+	u8 *src;
+	int rc;
+
+	if (!trylock_page(page))
+		return;
+	if (page->mapping != inode->i_mapping || page_mapped(page) ||
+	    !PageUptodate(page) || PageWriteback(page) || OfsPageHuge(page))
+		goto out_unlock;
+	if (!PageDirty(page)) {
+		/* zeros only: drop it */
+		if (PagePrivate(page))
+			ofs_page_unacct(page);
+		delete_from_page_cache(page);
+		goto out_unlock;
+	}
+	if (!PagePrivate(page))
+		goto out_unlock;
+
+	tfm = *per_cpu_ptr(zs->tfms, get_cpu());
+	src = kmap_atomic(page);
+	rc = crypto_comp_compress(tfm, src, PAGE_CACHE_SIZE, zs->buf, &len);
+	if (rc || len > OFS_ZPAGE_MAX) {
+		rc = -E2BIG;
+		if (dedup) {
+			/* store it as is */
+			memcpy(zs->buf, src, PAGE_CACHE_SIZE);
+			len = PAGE_CACHE_SIZE;
+			rc = 0;
+		}
+	}
+	kunmap_atomic(src);
+	put_cpu();
+	if (rc)
+		goto out_unlock;
+	zb = ofs_zblob_get(zs, zs->buf, len, dedup);
+	if (zb == NULL)
+		goto out_unlock;
+	if (radix_tree_preload(GFP_NOFS))
+		goto out_put;
+	spin_lock(&oi->zlock);
+	rc = radix_tree_insert(&oi->zpages, page->index, zb);
+	spin_unlock(&oi->zlock);
+	radix_tree_preload_end();
+	if (rc)
+		goto out_put;
+
+	/* The charge of the page moves to the compressed page. */
+	ClearPagePrivate(page);
+	set_page_private(page, 0);
+	page_cache_release(page);
+	cancel_dirty_page(page, PAGE_CACHE_SIZE);
+	delete_from_page_cache(page);
+	atomic_long_inc(&zs->nr);
+	goto out_unlock;
+
+out_put:
+	ofs_zblob_put(zs, zb);
+out_unlock:
+	unlock_page(page);
+}
+
+/**
+ * @brief Scan the pages of a regfile.
+ * @param zs: compressed store
+ * @param inode: inode of the regfile
+ * @note
+ * * PG_referenced of every page is cleared, and the pages that weren't
+ *   referenced since the last scan are compressed.
+ * * inode->i_mutex is tried for each batch, so the scanner never races
+ *   with writes, truncates and fallocate(), and never waits for them.
+ */
+static
+void ofs_zstore_scan(struct ofs_zstore *zs, struct inode *inode)
+{
+	struct address_space *mapping = inode->i_mapping;
+	struct page *pages[PAGEVEC_SIZE];
+	pgoff_t index = 0;
+	unsigned int nr, i;
+
+	do {
+		if (!mutex_trylock(&inode->i_mutex))
+			return;
+		nr = find_get_pages(mapping, index, PAGEVEC_SIZE, pages);
+		for (i = 0; i < nr; i++) {
+			index = pages[i]->index + 1;
+			if (!TestClearPageReferenced(pages[i]))
+				ofs_zstore_evict(zs, inode, pages[i]);
+			page_cache_release(pages[i]);
+		}
+		mutex_unlock(&inode->i_mutex);
+		cond_resched();
+	} while (nr == PAGEVEC_SIZE);
+}
+
+/**
+ * @brief Test whether the pages of an inode may be compressed.
+ * @param inode: the inode
+ * @retval true: yes
+ * @retval false: no
+ */
+static __always_inline
+bool ofs_zstore_eligible(struct inode *inode)
+{
+	struct ofs_inode *oi = OFS_INODE(inode);
+
+	return S_ISREG(inode->i_mode) && !(oi->state & OI_SINGULARITY) &&
+	       oi->swap == NULL && inode->i_mapping->nrpages;
+}
+
+/**
+ * @brief the scanner of option "compress"
+ * @param work: <b><em>work</em></b> of the compressed store
+ * @note
+ * * The inodes of the super block are walked like
+ *   <em>drop_pagecache_sb()</em> does.
+ */
+static
+void ofs_zstore_worker(struct work_struct *work)
+{
+	struct ofs_zstore *zs = container_of(to_delayed_work(work),
+					     struct ofs_zstore, work);
+	struct super_block *sb = zs->root->sb;
+	struct inode *inode, *toput = NULL;
+	unsigned int interval;
+
+	spin_lock(&KSYM_VAR(inode_sb_list_lock));
+	list_for_each_entry(inode, &sb->s_inodes, i_sb_list) {
+		spin_lock(&inode->i_lock);
+		if ((inode->i_state & (I_FREEING | I_WILL_FREE | I_NEW)) ||
+		    !ofs_zstore_eligible(inode)) {
+			spin_unlock(&inode->i_lock);
+			continue;
+		}
+		atomic_inc(&inode->i_count); /* __iget() */
+		spin_unlock(&inode->i_lock);
+		spin_unlock(&KSYM_VAR(inode_sb_list_lock));
+
+		iput(toput);
+		toput = inode;
+		ofs_zstore_scan(zs, inode);
+		cond_resched();
+
+		spin_lock(&KSYM_VAR(inode_sb_list_lock));
+	}
+	spin_unlock(&KSYM_VAR(inode_sb_list_lock));
+	iput(toput);
+
+	interval = ACCESS_ONCE(zs->root->mo.compress);
+	if (interval)
+		queue_delayed_work(system_long_wq, &zs->work,
+				   (unsigned long)interval * HZ);
+}
+
+/******** ******** compressed pages ******** ********/
+/**
+ * @brief Decompress a page into the page cache.
+ * @param inode: inode of the regfile
+ * @param page: the locked page that isn't uptodate
+ * @retval 1: The page is decompressed. The caller sets it uptodate.
+ * @retval 0: The page isn't compressed.
+ * @retval -EIO: The compressed data is corrupted.
+ * @note
+ * * The page becomes dirty (data) and takes over the charge of the
+ *   compressed page. The time spent is added to zload_ns.
+ * * A compressed page shared by option "dedup" is copied, and only the
+ *   reference of this regfile is put.
+ * * It runs without inode->i_mutex (read() and mmap faults), so the
+ *   compressed page is taken out of the regfile under the zlock before
+ *   decompressing. A concurrent @ref ofs_zpage_truncate() either frees it
+ *   first, and the page is a hole, or doesn't find it any more.
+ */
+int ofs_zpage_load(struct inode *inode, struct page *page)
+{
+	struct ofs_inode *oi = OFS_INODE(inode);
+	struct ofs_root *root = (struct ofs_root *)inode->i_sb->s_fs_info;
+	struct ofs_zstore *zs;
+	struct ofs_zblob *zb;
+	struct crypto_comp *tfm;
+	unsigned int len = PAGE_CACHE_SIZE;
+	ktime_t start;
+	u8 *dst;
+	int rc = 0;
+
+	spin_lock(&oi->zlock);
+	zb = radix_tree_delete(&oi->zpages, page->index);
+	spin_unlock(&oi->zlock);
+	if (zb == NULL)
+		return 0;
+
+	zs = root->zs;
+	start = ktime_get();
+	dst = kmap_atomic(page);
+	if (zb->len == PAGE_CACHE_SIZE) {
+		memcpy(dst, zb->data, PAGE_CACHE_SIZE);
+	} else {
+		tfm = *per_cpu_ptr(zs->tfms, get_cpu());
+		rc = crypto_comp_decompress(tfm, zb->data, zb->len, dst, &len);
+		put_cpu();
+	}
+	kunmap_atomic(dst);
+	if (rc || len != PAGE_CACHE_SIZE) {
+		ofs_err("inode<%p>; index==%lu; corrupted compressed page.\n",
+			inode, page->index);
+		/* Put it back, so the page isn't read as a hole. */
+		spin_lock(&oi->zlock);
+		rc = radix_tree_insert(&oi->zpages, page->index, zb);
+		spin_unlock(&oi->zlock);
+		if (rc) {
+			atomic_long_dec(&zs->nr);
+			ofs_unacct_blocks(root, 1);
+			ofs_zblob_put(zs, zb);
+		}
+		return -EIO;
+	}
+	flush_dcache_page(page);
+
+	/* The charge of the compressed page moves back to the page. */
+	if (PagePrivate(page))
+		ofs_unacct_blocks(root, 1);
+	else
+		ofs_page_acct(page, root);
+	set_page_dirty(page);
+	atomic_long_dec(&zs->nr);
+	ofs_zblob_put(zs, zb);
+	percpu_counter_inc(&zs->loads);
+	percpu_counter_add(&zs->load_ns,
+			   ktime_to_ns(ktime_sub(ktime_get(), start)));
+	return 1;
+}
+
+/**
+ * @brief Decompress the page containing a position back into the page
+ *        cache, if the position is in the middle of a compressed page.
+ * @param inode: inode of the regfile
+ * @param pos: the position
+ * @retval 0: OK
+ * @retval errno: Indicate the error code
+ *                (see <b><a href="/usr/include/asm-generic/errno-base.h">
+ *                 /usr/include/asm-generic/errno-base.h</a></b>).
+ * @note
+ * * It is called before a truncate or a hole punch, so the partial page
+ *   at the edge is zeroed in the page cache.
+ */
+int ofs_zpage_fault_in(struct inode *inode, loff_t pos)
+{
+	pgoff_t index = pos >> PAGE_CACHE_SHIFT;
+	struct page *page;
+
+	if (!(pos & ~PAGE_CACHE_MASK) || ofs_zpage_next(inode, index) != index)
+		return 0;
+	page = read_mapping_page(inode->i_mapping, index, NULL);
+	if (IS_ERR(page))
+		return PTR_ERR(page);
+	page_cache_release(page);
+	return 0;
+}
+
+/**
+ * @brief Free the compressed pages in a range.
+ * @param inode: inode of the regfile
+ * @param start: index of the first page
+ * @param end: index of the page after the range
+ * @note
+ * * It is called after the range is truncated from the page cache, with
+ *   inode->i_mutex held, and when the inode is destroyed.
+ * * A compressed page taken by a concurrent @ref ofs_zpage_load() isn't
+ *   found, so only the pages removed here are put and uncharged.
+ */
+void ofs_zpage_truncate(struct inode *inode, pgoff_t start, pgoff_t end)
+{
+	struct ofs_inode *oi = OFS_INODE(inode);
+	struct ofs_root *root = (struct ofs_root *)inode->i_sb->s_fs_info;
+	struct ofs_zblob *zbs[PAGEVEC_SIZE];
+	void **slots[PAGEVEC_SIZE];
+	unsigned long indices[PAGEVEC_SIZE];
+	unsigned int nr, n, i;
+	bool done = false;
+
+	while (start < end && !done) {
+		spin_lock(&oi->zlock);
+		nr = radix_tree_gang_lookup_slot(&oi->zpages, slots, indices,
+						 start, PAGEVEC_SIZE);
+		for (n = 0; n < nr && indices[n] < end; n++) {
+			zbs[n] = radix_tree_deref_slot_protected(slots[n],
+								 &oi->zlock);
+			radix_tree_delete(&oi->zpages, indices[n]);
+		}
+		spin_unlock(&oi->zlock);
+		if (n == 0)
+			break;
+
+		start = indices[n - 1] + 1;
+		done = n < PAGEVEC_SIZE || start == 0;
+		for (i = 0; i < n; i++)
+			ofs_zblob_put(root->zs, zbs[i]);
+		atomic_long_sub(n, &root->zs->nr);
+		ofs_unacct_blocks(root, n);
+		cond_resched();
+	}
+}
+
+/**
+ * @brief Share a compressed page of a regfile with another regfile.
+ * @param src: inode of the source
+ * @param index: index of the page in the source
+ * @param dst: inode of the destination, of the same ofs
+ * @param dindex: index of the page in the destination, where there is no
+ *                compressed page
+ * @retval 1: The page is shared.
+ * @retval 0: The page of the source isn't compressed.
+ * @retval -ENOSPC: the limit of option "size" is reached.
+ * @retval -ENOMEM: no memory
+ * @note
+ * * It is called with inode->i_mutex of both regfiles held, so neither
+ *   the scanner nor a truncate changes their compressed pages. A
+ *   concurrent @ref ofs_zpage_load() of the source is fine, since the
+ *   reference is taken under the zlock of the source.
+ * * The shared page is charged to option "size" again, and counts in
+ *   zpage_clone_bytes instead of zpage_dedup_bytes.
+ */
+int ofs_zpage_clone(struct inode *src, pgoff_t index, struct inode *dst,
+		    pgoff_t dindex)
+{
+	struct ofs_inode *soi = OFS_INODE(src);
+	struct ofs_inode *doi = OFS_INODE(dst);
+	struct ofs_root *root = (struct ofs_root *)src->i_sb->s_fs_info;
+	struct ofs_zstore *zs = root->zs;
+	struct ofs_zblob *zb;
+	int rc;
+
+	if (zs == NULL)
+		return 0;
+	spin_lock(&soi->zlock);
+	zb = radix_tree_lookup(&soi->zpages, index);
+	if (zb) {
+		spin_lock(&zs->lock);
+		zb->ref++;
+		zb->clones++;
+		spin_unlock(&zs->lock);
+		atomic_long_inc(&zs->cloned);
+	}
+	spin_unlock(&soi->zlock);
+	if (zb == NULL)
+		return 0;
+
+	rc = -ENOSPC;
+	if (ofs_acct_blocks(root, 1))
+		goto out_put;
+	rc = radix_tree_preload(GFP_KERNEL);
+	if (rc)
+		goto out_unacct;
+	spin_lock(&doi->zlock);
+	rc = radix_tree_insert(&doi->zpages, dindex, zb);
+	spin_unlock(&doi->zlock);
+	radix_tree_preload_end();
+	if (rc)
+		goto out_unacct;
+	atomic_long_inc(&zs->nr);
+	return 1;
+
+out_unacct:
+	ofs_unacct_blocks(root, 1);
+out_put:
+	ofs_zblob_put(zs, zb);
+	return rc;
+}
+
+/**
+ * @brief Find the first compressed page from an index.
+ * @param inode: inode of the regfile
+ * @param index: index to start
+ * @return index of the compressed page found
+ * @retval ULONG_MAX: nothing is found.
+ */
+pgoff_t ofs_zpage_next(struct inode *inode, pgoff_t index)
+{
+	struct ofs_inode *oi = OFS_INODE(inode);
+	void **slot;
+	unsigned long next = ULONG_MAX;
+
+	spin_lock(&oi->zlock);
+	if (!radix_tree_gang_lookup_slot(&oi->zpages, &slot, &next, index, 1))
+		next = ULONG_MAX;
+	spin_unlock(&oi->zlock);
+	return next;
+}
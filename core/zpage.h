@@ -0,0 +1,128 @@
+/**
+ * @file
+ * @brief C header for the ofs (octagram filesystem, outlandish filesystem, or
+ *        odd filesystem) kernel module
+ * @author Octagram Sun <octagram@qq.com>
+ * @version 0.1.0
+ * @date 2015
+ * @copyright Octagram Sun <octagram@qq.com>
+ *
+ * @note
+ * C header about the compressed store of cold pages, is used in ofs internal.
+ * 1 tab == 8 spaces.
+ */
+
+#ifndef __OFS_ZPAGE_H__
+#define __OFS_ZPAGE_H__
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ******** ********    header files   ******** ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+#include <linux/types.h>
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/crypto.h>
+#include <linux/workqueue.h>
+#include <linux/percpu_counter.h>
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ******** ********       macro       ******** ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+/**
+ * @brief max size of a compressed page. A page that can't be compressed
+ *        into half a page is left in the page cache, because kmalloc()
+ *        would round it up to a whole page, or is stored as is with option
+ *        "dedup".
+ */
+#define OFS_ZPAGE_MAX		(PAGE_CACHE_SIZE / 2)
+
+/**
+ * @brief number of bits of the hash table of compressed pages
+ */
+#define OFS_ZBLOB_HASH_BITS	12
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ******** ********       types       ******** ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+/**
+ * @brief a compressed page. With option "dedup", identical pages of all
+ *        regfiles share one.
+ */
+struct ofs_zblob {
+	struct hlist_node node;		/**< link in the hash table of the
+					 *   store (unhashed without option
+					 *   "dedup")
+					 */
+	u32 hash;			/**< jhash of data */
+	unsigned int ref;		/**< number of file pages sharing it
+					 *   Protected by the lock of the store.
+					 */
+	unsigned int clones;		/**< references taken by a clone
+					 *   Protected by the lock of the store.
+					 */
+	unsigned int len;		/**< length of data. PAGE_CACHE_SIZE
+					 *   means that the page can't be
+					 *   compressed and is stored as is.
+					 */
+	u8 *data;			/**< the data */
+};
+
+/**
+ * @brief compressed store of an ofs root
+ */
+struct ofs_zstore {
+	struct ofs_root *root;		/**< ofs root */
+	struct crypto_comp * __percpu *tfms;	/**< compressor per cpu */
+	u8 *buf;			/**< output buffer of the scanner */
+	struct delayed_work work;	/**< the scanner */
+	spinlock_t lock;		/**< protects htable and the refs */
+	struct hlist_head *htable;	/**< hash table of compressed pages
+					 *   for option "dedup"
+					 */
+	atomic_long_t nr;		/**< number of compressed pages */
+	atomic_long_t bytes;		/**< memory used by compressed pages */
+	atomic_long_t shared;		/**< pages that share the
+					 *   compressed page of another page
+					 *   by option "dedup"
+					 */
+	atomic_long_t cloned;		/**< pages that share the
+					 *   compressed page of another page
+					 *   by a clone
+					 */
+	struct percpu_counter loads;	/**< pages decompressed */
+	struct percpu_counter load_ns;	/**< nanoseconds spent decompressing */
+};
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ********         function prototypes         ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+extern
+int ofs_zstore_set(struct ofs_root *root, unsigned int interval);
+
+extern
+void ofs_zstore_stop(struct ofs_root *root);
+
+extern
+void ofs_zstore_destroy(struct ofs_root *root);
+
+extern
+int ofs_zpage_load(struct inode *inode, struct page *page);
+
+extern
+int ofs_zpage_fault_in(struct inode *inode, loff_t pos);
+
+extern
+void ofs_zpage_truncate(struct inode *inode, pgoff_t start, pgoff_t end);
+
+extern
+pgoff_t ofs_zpage_next(struct inode *inode, pgoff_t index);
+
+extern
+int ofs_zpage_clone(struct inode *src, pgoff_t index, struct inode *dst,
+		    pgoff_t dindex);
+
+/******** ******** ******** ******** ******** ******** ******** ********
+ ******** ******** ********   .sdata & .data  ******** ******** ********
+ ******** ******** ******** ******** ******** ******** ******** ********/
+
+#endif /* zpage.h */
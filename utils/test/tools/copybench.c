@@ -0,0 +1,162 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include "../../../core/ofs_ioctl.h"
+
+#define MIN_SIZE	(4UL << 10)
+#define MAX_SIZE	(1UL << 30)
+#define PIPE_SIZE	(1UL << 20)
+
+static int fill(int fd, unsigned long size)
+{
+	static char buf[1 << 16];
+	unsigned long off;
+	ssize_t n;
+
+	for (off = 0; off < sizeof(buf); off++)
+		buf[off] = (char)(off * 7 + 1);
+	for (off = 0; off < size; off += n) {
+		n = pwrite(fd, buf, size - off < sizeof(buf) ?
+			   size - off : sizeof(buf), off);
+		if (n <= 0)
+			return n < 0 ? errno : EIO;
+	}
+	return 0;
+}
+
+static int copy_splice(int src, int dst, unsigned long size)
+{
+	loff_t in = 0, out = 0;
+	int pfd[2];
+	ssize_t n, m;
+	int rc = 0;
+
+	if (pipe(pfd))
+		return errno;
+	fcntl(pfd[1], F_SETPIPE_SZ, PIPE_SIZE);
+	while (in < size) {
+		n = splice(src, &in, pfd[1], NULL, size - in, SPLICE_F_MOVE);
+		if (n <= 0) {
+			rc = n < 0 ? errno : EIO;
+			break;
+		}
+		while (n > 0) {
+			m = splice(pfd[0], NULL, dst, &out, n, SPLICE_F_MOVE);
+			if (m <= 0) {
+				rc = m < 0 ? errno : EIO;
+				goto out;
+			}
+			n -= m;
+		}
+	}
+out:
+	close(pfd[0]);
+	close(pfd[1]);
+	return rc;
+}
+
+static int copy_ioctl(int src, int dst, unsigned long size)
+{
+	struct ofs_copy_range cr;
+
+	cr.dest_fd = dst;
+	cr.src_offset = 0;
+	cr.dest_offset = 0;
+	cr.len = size;
+	cr.copied = 0;
+	if (ioctl(src, OFS_IOC_COPYRANGE, &cr))
+		return errno;
+	return cr.copied == size ? 0 : EIO;
+}
+
+static double run(int src, const char *dpath, unsigned long size,
+		  int loops, int use_ioctl, int *err)
+{
+	struct timespec t0, t1;
+	double sec = 0;
+	int dst, i;
+
+	for (i = 0; i < loops && !*err; i++) {
+		dst = open(dpath, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+		if (dst < 0) {
+			*err = errno;
+			break;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		if (use_ioctl)
+			*err = copy_ioctl(src, dst, size);
+		else
+			*err = copy_splice(src, dst, size);
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		sec += (t1.tv_sec - t0.tv_sec) +
+		       (t1.tv_nsec - t0.tv_nsec) / 1e9;
+		close(dst);
+	}
+	unlink(dpath);
+	return sec;
+}
+
+int main(int argc, char *argv[], char **envs)
+{
+	char spath[4096], dpath[4096];
+	unsigned long size, max = MAX_SIZE, total;
+	double sec[2];
+	int src, loops, err = 0;
+	int i;
+
+	if (argc < 3) {
+		printf("Usage: %s <ofs dir> <dest dir> [-m max] [-l loops]\n"
+		       "  -m max: largest copy in MiB (default 1024)\n"
+		       "  -l loops: bytes copied per size (in MiB, default "
+		       "1024)\n", argv[0]);
+		exit(EINVAL);
+	}
+	loops = 1024;
+	for (i = 3; i < argc; i++) {
+		if (strcmp(argv[i], "-m") == 0 && i + 1 < argc)
+			max = strtoul(argv[++i], NULL, 0) << 20;
+		else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+			loops = atoi(argv[++i]);
+	}
+	if (max < MIN_SIZE || loops <= 0) {
+		printf("Invalid argument.\n");
+		exit(EINVAL);
+	}
+	total = (unsigned long)loops << 20;
+	snprintf(spath, sizeof(spath), "%s/copybench.src", argv[1]);
+	snprintf(dpath, sizeof(dpath), "%s/copybench.dst", argv[2]);
+
+	printf("%12s %12s %12s %8s\n", "size", "splice GB/s", "ioctl GB/s",
+	       "speedup");
+	for (size = MIN_SIZE; size <= max && !err; size <<= 2) {
+		src = open(spath, O_CREAT | O_TRUNC | O_RDWR, 0644);
+		if (src < 0) {
+			err = errno;
+			break;
+		}
+		err = fill(src, size);
+		loops = total / size ? total / size : 1;
+		if (!err)
+			sec[0] = run(src, dpath, size, loops, 0, &err);
+		if (!err)
+			sec[1] = run(src, dpath, size, loops, 1, &err);
+		close(src);
+		unlink(spath);
+		if (err)
+			break;
+		printf("%12lu %12.3f %12.3f %7.2fx\n", size,
+		       sec[0] > 0 ? size * (double)loops / sec[0] / 1e9 : 0.0,
+		       sec[1] > 0 ? size * (double)loops / sec[1] / 1e9 : 0.0,
+		       sec[1] > 0 ? sec[0] / sec[1] : 0.0);
+	}
+	if (err)
+		printf("size %lu: errno=%d, %s\n", size, err, strerror(err));
+	return err;
+}
@@ -0,0 +1,159 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include "../../../core/ofs_ioctl.h"
+
+struct bench {
+	const char *dir;
+	int loops;
+	int use_ioctl;
+	unsigned long entries;
+	int err;
+};
+
+static int scan_getdents(int fd, unsigned long *entries)
+{
+	static __thread char buf[32768];
+	long n, off;
+	unsigned short reclen;
+
+	if (lseek(fd, 0, SEEK_SET) < 0)
+		return errno;
+	for (;;) {
+		n = syscall(SYS_getdents64, fd, buf, sizeof(buf));
+		if (n < 0)
+			return errno;
+		if (n == 0)
+			return 0;
+		for (off = 0; off < n; off += reclen) {
+			/* d_reclen of struct linux_dirent64 */
+			memcpy(&reclen, buf + off + 16, sizeof(reclen));
+			(*entries)++;
+		}
+	}
+}
+
+static int scan_ioctl(int fd, unsigned long *entries)
+{
+	static __thread uint64_t buf[32768 / sizeof(uint64_t)];
+	struct ofs_readdirplus rdp;
+
+	rdp.pos = OFS_READDIRPLUS_START;
+	do {
+		rdp.buf = (uintptr_t)buf;
+		rdp.len = sizeof(buf);
+		if (ioctl(fd, OFS_IOC_READDIRPLUS, &rdp))
+			return errno;
+		*entries += rdp.nr;
+	} while (rdp.nr);
+	return 0;
+}
+
+static void *reader(void *arg)
+{
+	struct bench *b = arg;
+	int fd, i;
+
+	fd = open(b->dir, O_RDONLY | O_DIRECTORY);
+	if (fd < 0) {
+		b->err = errno;
+		return NULL;
+	}
+	for (i = 0; i < b->loops && !b->err; i++) {
+		if (b->use_ioctl)
+			b->err = scan_ioctl(fd, &b->entries);
+		else
+			b->err = scan_getdents(fd, &b->entries);
+	}
+	close(fd);
+	return NULL;
+}
+
+static int populate(const char *dir, int nr)
+{
+	char path[4096];
+	int i, fd;
+
+	for (i = 0; i < nr; i++) {
+		snprintf(path, sizeof(path), "%s/f%07d", dir, i);
+		fd = open(path, O_CREAT | O_WRONLY, 0644);
+		if (fd < 0)
+			return errno;
+		close(fd);
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[], char **envs)
+{
+	struct bench *b;
+	pthread_t *tids;
+	struct timespec t0, t1;
+	unsigned long total = 0;
+	double sec;
+	int nthreads, loops, nr = 0, use_ioctl = 0;
+	int i, rc;
+
+	if (argc < 4) {
+		printf("Usage: %s <dir> <threads> <loops> [-c nr] [-i]\n"
+		       "  -c nr: create nr empty files in <dir> first\n"
+		       "  -i: read by OFS_IOC_READDIRPLUS instead of "
+		       "getdents64\n", argv[0]);
+		exit(EINVAL);
+	}
+	nthreads = atoi(argv[2]);
+	loops = atoi(argv[3]);
+	for (i = 4; i < argc; i++) {
+		if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+			nr = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-i") == 0)
+			use_ioctl = 1;
+	}
+	if (nthreads <= 0 || loops <= 0) {
+		printf("Invalid argument.\n");
+		exit(EINVAL);
+	}
+
+	if (nr) {
+		rc = populate(argv[1], nr);
+		if (rc) {
+			printf("create: errno=%d, %s\n", rc, strerror(rc));
+			return rc;
+		}
+	}
+
+	b = calloc(nthreads, sizeof(*b));
+	tids = calloc(nthreads, sizeof(*tids));
+	if (b == NULL || tids == NULL)
+		return ENOMEM;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < nthreads; i++) {
+		b[i].dir = argv[1];
+		b[i].loops = loops;
+		b[i].use_ioctl = use_ioctl;
+		pthread_create(&tids[i], NULL, reader, &b[i]);
+	}
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(tids[i], NULL);
+		if (b[i].err)
+			printf("thread %d: errno=%d, %s\n", i, b[i].err,
+			       strerror(b[i].err));
+		total += b[i].entries;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	sec = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+	printf("%s: %d threads, %d loops, %lu entries, %.3f s, "
+	       "%.0f entries/s\n", use_ioctl ? "readdirplus" : "getdents64",
+	       nthreads, loops, total, sec, sec > 0 ? total / sec : 0.0);
+	free(tids);
+	free(b);
+	return 0;
+}
@@ -0,0 +1,55 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/ioctl.h>
+#include "../../../core/ofs_ioctl.h"
+
+int main(int argc, char *argv[], char **envs)
+{
+	struct ofs_readdirplus rdp;
+	struct ofs_dirent_plus *rec;
+	static uint64_t buf[4096 / sizeof(uint64_t)];
+	unsigned long total = 0;
+	unsigned int i;
+	int fd, rc;
+
+	if (argc < 2) {
+		printf("Invalid argument.\n");
+		exit(EINVAL);
+	}
+
+	fd = open(argv[1], O_RDONLY);
+	if (fd < 0) {
+		printf("open: errno=%d, %s\n", errno, strerror(errno));
+		return errno;
+	}
+	rdp.pos = OFS_READDIRPLUS_START;
+	do {
+		rdp.buf = (uintptr_t)buf;
+		rdp.len = sizeof(buf);
+		rc = ioctl(fd, OFS_IOC_READDIRPLUS, &rdp);
+		if (rc) {
+			printf("rc=%d, errno=%d, %s\n", rc, errno,
+			       strerror(errno));
+			close(fd);
+			return errno;
+		}
+		rec = (struct ofs_dirent_plus *)buf;
+		for (i = 0; i < rdp.nr; i++) {
+			printf("%-8llu 0%06o %3u %10lld %lld.%09u %s\n",
+			       (unsigned long long)rec->ino, rec->mode,
+			       rec->nlink, (long long)rec->size,
+			       (long long)rec->mtime_sec, rec->mtime_nsec,
+			       rec->name);
+			rec = OFS_DIRENT_PLUS_NEXT(rec);
+		}
+		total += rdp.nr;
+	} while (rdp.nr);
+	printf("total: %lu\n", total);
+	close(fd);
+	return 0;
+}
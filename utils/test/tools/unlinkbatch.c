@@ -0,0 +1,58 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/ioctl.h>
+#include "../../../core/ofs_ioctl.h"
+
+int main(int argc, char *argv[], char **envs)
+{
+	struct ofs_unlinkbatch ub;
+	char *names;
+	size_t len = 0;
+	int fd, rc, i;
+
+	if (argc < 3) {
+		printf("Usage: %s <dir> -p <prefix>\n"
+		       "       %s <dir> <name> [name ...]\n",
+		       argv[0], argv[0]);
+		exit(EINVAL);
+	}
+
+	fd = open(argv[1], O_RDONLY);
+	if (fd < 0) {
+		printf("open: errno=%d, %s\n", errno, strerror(errno));
+		return errno;
+	}
+	if (strcmp(argv[2], "-p") == 0) {
+		names = argc > 3 ? argv[3] : "";
+		ub.names = (uintptr_t)names;
+		ub.len = strlen(names);
+		ub.flags = OFS_UNLINK_PREFIX;
+	} else {
+		for (i = 2; i < argc; i++)
+			len += strlen(argv[i]) + 1;
+		names = malloc(len);
+		if (names == NULL) {
+			close(fd);
+			return ENOMEM;
+		}
+		len = 0;
+		for (i = 2; i < argc; i++) {
+			strcpy(names + len, argv[i]);
+			len += strlen(argv[i]) + 1;
+		}
+		ub.names = (uintptr_t)names;
+		ub.len = len;
+		ub.flags = 0;
+	}
+	ub.nr = 0;
+	rc = ioctl(fd, OFS_IOC_UNLINKBATCH, &ub);
+	printf("rc=%d, errno=%d, %s, nr=%llu\n", rc, rc ? errno : 0,
+	       strerror(rc ? errno : 0), (unsigned long long)ub.nr);
+	close(fd);
+	return rc ? errno : 0;
+}